@@ -0,0 +1,245 @@
+#ifndef BATCHED_HPP
+#define BATCHED_HPP
+#include <vector>
+#include <cmath>
+#include <cstdint>
+using namespace std;
+
+// Lanes doubles operated on lane by lane (GCC/Clang vector extension).
+// Comparisons give a Mask, 0 or -1 per lane, that ?: selects with.
+template<int Lanes>
+struct LaneTypes;
+
+template<>
+struct LaneTypes<2> {
+    typedef double Vector __attribute__((vector_size(16)));
+    typedef decltype(Vector() < Vector()) Mask;
+};
+
+template<>
+struct LaneTypes<4> {
+    typedef double Vector __attribute__((vector_size(32)));
+    typedef decltype(Vector() < Vector()) Mask;
+};
+
+template<>
+struct LaneTypes<8> {
+    typedef double Vector __attribute__((vector_size(64)));
+    typedef decltype(Vector() < Vector()) Mask;
+};
+
+// Many independent N x N systems Ax = b, solved together: the same
+// Gaussian elimination with partial pivoting as trial.cpp, with N fixed at
+// compile time so every loop over rows and columns unrolls.
+//
+// Systems are stored interleaved, Lanes at a time: element (i, j) of the
+// Lanes systems of a pack is one LaneVector, so every step of the
+// elimination is a SIMD instruction and each lane works through a
+// different system. Pivoting differs between lanes, so row swaps are done
+// with lane-wise selects rather than branches. Build with -march=native (or
+// at least -mavx2) for 4-wide vectors; plain x86-64 runs them as pairs.
+// Lanes is 2, 4 or 8.
+template<int N, int Lanes = 4>
+class SmallSystemBatch {
+    static_assert(N >= 1 && N <= 32, "SmallSystemBatch is meant for small systems");
+
+private:
+    typedef typename LaneTypes<Lanes>::Vector LaneVector;
+    typedef typename LaneTypes<Lanes>::Mask Mask;
+
+    struct Pack {
+        LaneVector a[N * N];
+        LaneVector b[N];
+        LaneVector det;
+    };
+
+    vector<Pack> packs;
+    vector<char> singular;
+    int count;
+
+    // Pivots smaller than this make a system singular, as in Matrix
+    static constexpr double singularPivot = 1e-10;
+
+    template<bool WithRhs>
+    void eliminate(Pack& p, char* flags);
+    void backSubstitute(Pack& p);
+    int record(size_t q, const char* flags);
+
+public:
+    // count systems, each starting out as I x = 0
+    explicit SmallSystemBatch(int count);
+
+    int size() const { return count; }
+
+    // Entry access for system s
+    double& a(int s, int i, int j) { return packs[s / Lanes].a[i * N + j][s % Lanes]; }
+    double& b(int s, int i) { return packs[s / Lanes].b[i][s % Lanes]; }
+    void setMatrix(int s, const double* A);  // row-major N x N
+    void setRhs(int s, const double* rhs);
+
+    // Solve every system. A is overwritten by its elimination and b by the
+    // solution; each determinant comes along. Returns how many systems are
+    // singular. Their solutions are not meaningful.
+    int solve();
+    // Only the elimination, for the determinants; b is left alone
+    int computeDeterminants();
+
+    void solution(int s, double* x) const;
+    double determinant(int s) const { return packs[s / Lanes].det[s % Lanes]; }
+    bool isSingular(int s) const { return singular[s] != 0; }
+};
+
+template<int N, int Lanes>
+SmallSystemBatch<N, Lanes>::SmallSystemBatch(int n) : packs((n + Lanes - 1) / Lanes), singular(n, 0), count(n) {
+    // The identity everywhere, so the lanes padding the last pack stay regular
+    for (Pack& p : packs) {
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) {
+                p.a[i * N + j] = LaneVector{} + (i == j ? 1.0 : 0.0);
+            }
+            p.b[i] = LaneVector{};
+        }
+        p.det = LaneVector{} + 1.0;
+    }
+}
+
+template<int N, int Lanes>
+void SmallSystemBatch<N, Lanes>::setMatrix(int s, const double* A) {
+    Pack& p = packs[s / Lanes];
+    int l = s % Lanes;
+    for (int k = 0; k < N * N; k++) {
+        p.a[k][l] = A[k];
+    }
+}
+
+template<int N, int Lanes>
+void SmallSystemBatch<N, Lanes>::setRhs(int s, const double* rhs) {
+    Pack& p = packs[s / Lanes];
+    int l = s % Lanes;
+    for (int i = 0; i < N; i++) {
+        p.b[i][l] = rhs[i];
+    }
+}
+
+template<int N, int Lanes>
+void SmallSystemBatch<N, Lanes>::solution(int s, double* x) const {
+    const Pack& p = packs[s / Lanes];
+    for (int i = 0; i < N; i++) {
+        x[i] = p.b[i][s % Lanes];
+    }
+}
+
+// Forward elimination of one pack, leaving U in the upper triangle (the
+// multipliers below it are not kept) and the determinant in det. flags
+// gets 1 for every lane whose pivot is numerically zero.
+template<int N, int Lanes>
+template<bool WithRhs>
+void SmallSystemBatch<N, Lanes>::eliminate(Pack& p, char* flags) {
+    LaneVector* A = p.a;
+    LaneVector det = LaneVector{} + 1.0;
+    Mask bad = {}, zero = {};
+
+    for (int k = 0; k < N; k++) {
+        // Pivot row of every lane
+        LaneVector piv = LaneVector{} + k;
+        LaneVector best = A[k * N + k] < 0 ? -A[k * N + k] : A[k * N + k];
+        for (int r = k + 1; r < N; r++) {
+            LaneVector v = A[r * N + k] < 0 ? -A[r * N + k] : A[r * N + k];
+            Mask larger = v > best;
+            best = larger ? v : best;
+            piv = larger ? (LaneVector{} + r) : piv;
+        }
+
+        // Swap rows k and piv lane by lane, skipping rows no lane picked;
+        // only columns from k on matter
+        for (int r = k + 1; r < N; r++) {
+            Mask take = piv == r;
+            bool any = false;
+            for (int l = 0; l < Lanes; l++) {
+                any |= take[l] != 0;
+            }
+            if (!any) {
+                continue;
+            }
+            for (int j = k; j < N; j++) {
+                LaneVector x = A[k * N + j], y = A[r * N + j];
+                A[k * N + j] = take ? y : x;
+                A[r * N + j] = take ? x : y;
+            }
+            if (WithRhs) {
+                LaneVector x = p.b[k], y = p.b[r];
+                p.b[k] = take ? y : x;
+                p.b[r] = take ? x : y;
+            }
+        }
+
+        LaneVector d = A[k * N + k];
+        det *= (piv != k) ? -d : d;
+        bad |= (d < 0 ? -d : d) < singularPivot;
+        zero |= d == 0;
+        LaneVector inv = 1.0 / d;
+
+        for (int r = k + 1; r < N; r++) {
+            LaneVector f = A[r * N + k] * inv;
+            for (int j = k + 1; j < N; j++) {
+                A[r * N + j] -= f * A[k * N + j];
+            }
+            if (WithRhs) {
+                p.b[r] -= f * p.b[k];
+            }
+        }
+    }
+
+    // As in trial.cpp a zero pivot gives 0, whatever 1/0 did afterwards
+    p.det = zero ? LaneVector{} : det;
+    for (int l = 0; l < Lanes; l++) {
+        flags[l] = bad[l] != 0;
+    }
+}
+
+template<int N, int Lanes>
+void SmallSystemBatch<N, Lanes>::backSubstitute(Pack& p) {
+    for (int i = N - 1; i >= 0; i--) {
+        LaneVector x = p.b[i];
+        for (int j = i + 1; j < N; j++) {
+            x -= p.a[i * N + j] * p.b[j];
+        }
+        p.b[i] = x / p.a[i * N + i];
+    }
+}
+
+// Copies the flags of pack q's real systems out; returns how many are set
+template<int N, int Lanes>
+int SmallSystemBatch<N, Lanes>::record(size_t q, const char* flags) {
+    int bad = 0;
+    for (int l = 0; l < Lanes && (int)q * Lanes + l < count; l++) {
+        singular[q * Lanes + l] = flags[l];
+        bad += flags[l];
+    }
+    return bad;
+}
+
+template<int N, int Lanes>
+int SmallSystemBatch<N, Lanes>::solve() {
+    int bad = 0;
+    for (size_t q = 0; q < packs.size(); q++) {
+        char flags[Lanes];
+        eliminate<true>(packs[q], flags);
+        backSubstitute(packs[q]);
+        bad += record(q, flags);
+    }
+    return bad;
+}
+
+template<int N, int Lanes>
+int SmallSystemBatch<N, Lanes>::computeDeterminants() {
+    int bad = 0;
+    for (size_t q = 0; q < packs.size(); q++) {
+        char flags[Lanes];
+        eliminate<false>(packs[q], flags);
+        bad += record(q, flags);
+    }
+    return bad;
+}
+
+#endif
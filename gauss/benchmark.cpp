@@ -0,0 +1,117 @@
+// Systems per second for SmallSystemBatch against trial.cpp's
+// gaussianElimination called once per system, for N from 3 to 16.
+//
+//   g++ -std=c++17 -O2 -march=native -o benchmark benchmark.cpp
+//   ./benchmark [systems]        default 1000000
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "batched.hpp"
+using namespace std;
+
+// trial.cpp's elimination with N a template parameter
+template<int N>
+void gaussianElimination(double A[N][N], double b[N], double x[N]) {
+    for (int i = 0; i < N; i++) {
+        int maxRow = i;
+        for (int k = i + 1; k < N; k++) {
+            if (fabs(A[k][i]) > fabs(A[maxRow][i])) {
+                maxRow = k;
+            }
+        }
+
+        // Swap rows
+        for (int k = 0; k < N; k++) {
+            swap(A[i][k], A[maxRow][k]);
+        }
+        swap(b[i], b[maxRow]);
+
+        // Make diagonal 1 and reduce below
+        for (int k = i + 1; k < N; k++) {
+            double factor = A[k][i] / A[i][i];
+            for (int j = i; j < N; j++) {
+                A[k][j] -= factor * A[i][j];
+            }
+            b[k] -= factor * b[i];
+        }
+    }
+
+    // Back substitution
+    for (int i = N - 1; i >= 0; i--) {
+        x[i] = b[i];
+        for (int j = i + 1; j < N; j++) {
+            x[i] -= A[i][j] * x[j];
+        }
+        x[i] /= A[i][i];
+    }
+}
+
+double seconds(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+template<int N>
+void run(int systems) {
+    // Random systems with a heavy diagonal, so none is near singular
+    srand(N);
+    vector<double> As((size_t)systems * N * N), bs((size_t)systems * N);
+    for (double& v : As) v = (rand() % 2000 - 1000) / 1000.0;
+    for (double& v : bs) v = (rand() % 2000 - 1000) / 1000.0;
+    for (int s = 0; s < systems; s++)
+        for (int i = 0; i < N; i++) As[((size_t)s * N + i) * N + i] += N;
+
+    // One system at a time; the copy is part of the cost, since the
+    // elimination destroys A
+    vector<double> xLoop((size_t)systems * N);
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < systems; s++) {
+        double A[N][N], b[N];
+        memcpy(A, &As[(size_t)s * N * N], sizeof(A));
+        memcpy(b, &bs[(size_t)s * N], sizeof(b));
+        gaussianElimination<N>(A, b, &xLoop[(size_t)s * N]);
+    }
+    double tLoop = seconds(start);
+
+    // Interleaving the input is timed separately; data produced straight
+    // into the batch never pays it. Allocation is not timed at all, a batch
+    // would be reused.
+    SmallSystemBatch<N> batch(systems);
+    start = chrono::steady_clock::now();
+    for (int s = 0; s < systems; s++) {
+        batch.setMatrix(s, &As[(size_t)s * N * N]);
+        batch.setRhs(s, &bs[(size_t)s * N]);
+    }
+    double tPack = seconds(start);
+    start = chrono::steady_clock::now();
+    int bad = batch.solve();
+    double tBatch = seconds(start);
+
+    double maxDiff = 0.0;
+    double x[N];
+    for (int s = 0; s < systems; s++) {
+        batch.solution(s, x);
+        for (int i = 0; i < N; i++) {
+            maxDiff = max(maxDiff, fabs(x[i] - xLoop[(size_t)s * N + i]));
+        }
+    }
+
+    cout << setw(4) << N << fixed << setprecision(2)
+         << setw(13) << systems / tLoop / 1e6 << setw(13) << systems / tBatch / 1e6
+         << setw(13) << systems / (tBatch + tPack) / 1e6 << setw(9) << tLoop / tBatch << "x"
+         << scientific << setprecision(1) << setw(11) << maxDiff << setw(9) << bad << defaultfloat << endl;
+}
+
+int main(int argc, char** argv) {
+    int systems = argc > 1 ? atoi(argv[1]) : 1000000;
+    cout << setw(4) << "N" << setw(13) << "loop Msys/s" << setw(13) << "batch Msys/s" << setw(13) << "+pack Msys/s"
+         << setw(10) << "speedup" << setw(11) << "max diff" << setw(9) << "singular" << endl;
+    run<3>(systems);
+    run<4>(systems);
+    run<6>(systems);
+    run<8>(systems);
+    run<12>(systems);
+    run<16>(systems);
+    return 0;
+}
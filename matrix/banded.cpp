@@ -0,0 +1,468 @@
+#include "banded.hpp"
+#include "threadpool.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Pivots smaller than this make the system numerically singular, as in
+// LUFactorization
+const double singularPivot = 1e-10;
+
+// Rows per thread task in a cyclic reduction step and the band product
+const int bandRowTile = 4096;
+
+// Below this size, or with one thread, Thomas beats cyclic reduction
+const int cyclicReductionMinSize = 1 << 16;
+
+}
+
+BandedMatrix::BandedMatrix() : n(0), kl(0), ku(0), width(1) {}
+
+BandedMatrix::BandedMatrix(int size, int lower, int upper)
+    : n(size), kl(lower), ku(upper), width(lower + upper + 1), band((size_t)size * (lower + upper + 1), 0.0) {}
+
+BandedMatrix BandedMatrix::fromDense(const Matrix& A, int lower, int upper) {
+    if (A.getRows() != A.getCols() || lower < 0 || upper < 0) {
+        return BandedMatrix();
+    }
+    int n = A.getRows();
+    BandedMatrix B(n, lower, upper);
+    for (int i = 0; i < n; i++) {
+        for (int j = max(0, i - lower); j <= min(n - 1, i + upper); j++) {
+            B.at(i, j) = A(i, j);
+        }
+    }
+    return B;
+}
+
+Matrix BandedMatrix::toDense() const {
+    Matrix A(n, n);
+    for (int i = 0; i < n; i++) {
+        for (int j = max(0, i - kl); j <= min(n - 1, i + ku); j++) {
+            A(i, j) = get(i, j);
+        }
+    }
+    return A;
+}
+
+void BandedMatrix::multiply(const vector<double>& x, vector<double>& y) const {
+    y.resize(n);
+    parallelTiles(n, 1, bandRowTile, 1, [&](int i0, int i1, int, int) {
+        for (int i = i0; i < i1; i++) {
+            int j0 = max(0, i - kl), j1 = min(n - 1, i + ku);
+            const double* row = band.data() + (size_t)i * width + (j0 - i + kl);
+            double s = 0.0;
+            for (int j = j0; j <= j1; j++) {
+                s += row[j - j0] * x[j];
+            }
+            y[i] = s;
+        }
+    });
+}
+
+vector<double> BandedMatrix::operator*(const vector<double>& x) const {
+    if ((int)x.size() != n) {
+        return vector<double>();
+    }
+    vector<double> y(n);
+    multiply(x, y);
+    return y;
+}
+
+BandedLUFactorization::BandedLUFactorization()
+    : n(0), kl(0), ku(0), width(1), swaps(0), singular(true),
+      failure(StatusCode::InvalidArgument, "Nothing has been factored") {}
+
+BandedLUFactorization::BandedLUFactorization(const BandedMatrix& A)
+    : n(A.size()), kl(A.lowerBandwidth()), ku(A.upperBandwidth()), width(2 * kl + ku + 1),
+      lu((size_t)n * width, 0.0), multipliers((size_t)n * kl, 0.0), pivots(n), swaps(0), singular(false) {
+    TELEMETRY_SCOPE("banded.factor");
+    for (int i = 0; i < n; i++) {
+        for (int j = max(0, i - kl); j <= min(n - 1, i + ku); j++) {
+            at(i, j) = A.get(i, j);
+        }
+    }
+
+    for (int j = 0; j < n; j++) {
+        int last = min(n - 1, j + kl);       // rows with an entry in column j
+        int right = min(n - 1, j + kl + ku);  // columns row j can reach after swaps
+        int p = j;
+        double best = fabs(at(j, j));
+        for (int i = j + 1; i <= last; i++) {
+            if (fabs(at(i, j)) > best) {
+                best = fabs(at(i, j));
+                p = i;
+            }
+        }
+        pivots[j] = p;
+        if (p != j) {
+            for (int c = j; c <= right; c++) {
+                swap(at(j, c), at(p, c));
+            }
+            swaps++;
+        }
+
+        double d = at(j, j);
+        if (fabs(d) < singularPivot) {
+            singular = true;
+        }
+        if (d == 0) {
+            continue;
+        }
+        double* m = multipliers.data() + (size_t)j * kl;
+        for (int i = j + 1; i <= last; i++) {
+            double f = at(i, j) / d;
+            m[i - j - 1] = f;
+            at(i, j) = 0.0;
+            if (f == 0.0) {
+                continue;
+            }
+            double* row = &at(i, j + 1);
+            const double* pivotRow = &at(j, j + 1);
+            for (int c = 0; c < right - j; c++) {
+                row[c] -= f * pivotRow[c];
+            }
+        }
+    }
+    if (singular) {
+        failure = Status(StatusCode::Singular, "Matrix is singular or nearly singular");
+    }
+}
+
+// Forward through the interleaved swaps and multipliers, then back through U
+void BandedLUFactorization::solveColumn(double* x) const {
+    for (int j = 0; j < n; j++) {
+        if (pivots[j] != j) {
+            swap(x[j], x[pivots[j]]);
+        }
+        const double* m = multipliers.data() + (size_t)j * kl;
+        int last = min(n - 1, j + kl);
+        for (int i = j + 1; i <= last; i++) {
+            x[i] -= m[i - j - 1] * x[j];
+        }
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        int right = min(n - 1, i + kl + ku);
+        const double* row = &at(i, i);
+        double s = x[i];
+        for (int c = 1; c <= right - i; c++) {
+            s -= row[c] * x[i + c];
+        }
+        x[i] = s / row[0];
+    }
+}
+
+vector<double> BandedLUFactorization::solve(const vector<double>& b) const {
+    return trySolve(b).value();
+}
+
+Result<vector<double>> BandedLUFactorization::trySolve(const vector<double>& b) const {
+    return trySolveMany(b, 1);
+}
+
+Result<vector<double>> BandedLUFactorization::trySolveMany(const vector<double>& B, int nrhs) const {
+    if (!failure) {
+        return failure;
+    }
+    if (nrhs < 0 || B.size() != (size_t)n * nrhs) {
+        return Result<vector<double>>(StatusCode::DimensionMismatch, "Dimensions mismatch in banded LU solver");
+    }
+
+    TELEMETRY_SCOPE("banded.solve");
+    vector<double> X = B;
+    if (nrhs == 1) {
+        solveColumn(X.data());
+    } else {
+        ThreadPool::instance().run(nrhs, [&](int r) { solveColumn(X.data() + (size_t)r * n); });
+    }
+    return X;
+}
+
+double BandedLUFactorization::determinant() const {
+    double det = (swaps % 2 == 0) ? 1.0 : -1.0;
+    for (int i = 0; i < n; i++) {
+        det *= at(i, i);
+    }
+    return det;
+}
+
+BandedCholeskyFactorization::BandedCholeskyFactorization()
+    : n(0), kd(0), positiveDefinite(false), failure(StatusCode::InvalidArgument, "Nothing has been factored") {}
+
+BandedCholeskyFactorization::BandedCholeskyFactorization(const BandedMatrix& A, bool checkSymmetry)
+    : n(0), kd(0), positiveDefinite(false) {
+    if (A.lowerBandwidth() != A.upperBandwidth()) {
+        failure = Status(StatusCode::NotSymmetric, "Band must be symmetric for banded Cholesky decomposition");
+        return;
+    }
+    n = A.size();
+    kd = A.lowerBandwidth();
+    if (checkSymmetry) {
+        for (int i = 0; i < n; i++) {
+            for (int j = max(0, i - kd); j < i; j++) {
+                if (fabs(A.get(i, j) - A.get(j, i)) > 1e-10) {
+                    failure = Status(StatusCode::NotSymmetric,
+                                     "Matrix must be symmetric for banded Cholesky decomposition");
+                    return;
+                }
+            }
+        }
+    }
+
+    TELEMETRY_SCOPE("banded.cholesky");
+    l.assign((size_t)n * (kd + 1), 0.0);
+    // Row by row: L(i, c) is a dot product of row i with row c of L over
+    // the columns i - kd .. c - 1 they share
+    for (int i = 0; i < n; i++) {
+        int j0 = max(0, i - kd);
+        for (int c = j0; c <= i; c++) {
+            double s = A.get(i, c);
+            const double* li = &at(i, j0);
+            const double* lc = &at(c, j0);
+            for (int p = 0; p < c - j0; p++) {
+                s -= li[p] * lc[p];
+            }
+            if (c < i) {
+                at(i, c) = s / at(c, c);
+            } else if (s <= 0) {
+                failure = Status(StatusCode::NotPositiveDefinite, "Matrix is not positive definite");
+                return;
+            } else {
+                at(i, i) = sqrt(s);
+            }
+        }
+    }
+    positiveDefinite = true;
+}
+
+vector<double> BandedCholeskyFactorization::solve(const vector<double>& b) const {
+    return trySolve(b).value();
+}
+
+Result<vector<double>> BandedCholeskyFactorization::trySolve(const vector<double>& b) const {
+    if (!positiveDefinite) {
+        return failure;
+    }
+    if ((int)b.size() != n) {
+        return Result<vector<double>>(StatusCode::DimensionMismatch, "Dimensions mismatch in banded Cholesky solver");
+    }
+
+    // Ly = b by rows, then L^T x = y by columns of L (its rows)
+    vector<double> x = b;
+    for (int i = 0; i < n; i++) {
+        int j0 = max(0, i - kd);
+        const double* li = &at(i, j0);
+        double s = x[i];
+        for (int j = j0; j < i; j++) {
+            s -= li[j - j0] * x[j];
+        }
+        x[i] = s / li[i - j0];
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        int j0 = max(0, i - kd);
+        x[i] /= at(i, i);
+        const double* li = &at(i, j0);
+        for (int j = j0; j < i; j++) {
+            x[j] -= li[j - j0] * x[i];
+        }
+    }
+    return x;
+}
+
+double BandedCholeskyFactorization::determinant() const {
+    double det = 1.0;
+    for (int i = 0; i < n; i++) {
+        det *= at(i, i) * at(i, i);
+    }
+    return det;
+}
+
+TridiagonalMatrix::TridiagonalMatrix() : n(0) {}
+
+TridiagonalMatrix::TridiagonalMatrix(int size) : n(size), sub(size, 0.0), diag(size, 0.0), super(size, 0.0) {}
+
+TridiagonalMatrix::TridiagonalMatrix(const vector<double>& lower, const vector<double>& diagonal,
+                                     const vector<double>& upper) : n(0) {
+    int size = (int)diagonal.size();
+    if (size == 0 || (int)lower.size() != size - 1 || (int)upper.size() != size - 1) {
+        return;
+    }
+    *this = TridiagonalMatrix(size);
+    copy(lower.begin(), lower.end(), sub.begin() + 1);
+    copy(diagonal.begin(), diagonal.end(), diag.begin());
+    copy(upper.begin(), upper.end(), super.begin());
+}
+
+TridiagonalMatrix TridiagonalMatrix::fromDense(const Matrix& A) {
+    if (A.getRows() != A.getCols()) {
+        return TridiagonalMatrix();
+    }
+    int n = A.getRows();
+    TridiagonalMatrix T(n);
+    for (int i = 0; i < n; i++) {
+        T.diag[i] = A(i, i);
+        if (i > 0) {
+            T.sub[i] = A(i, i - 1);
+        }
+        if (i + 1 < n) {
+            T.super[i] = A(i, i + 1);
+        }
+    }
+    return T;
+}
+
+double TridiagonalMatrix::get(int i, int j) const {
+    if (i == j) {
+        return diag[i];
+    }
+    if (j == i - 1) {
+        return sub[i];
+    }
+    if (j == i + 1) {
+        return super[i];
+    }
+    return 0.0;
+}
+
+Matrix TridiagonalMatrix::toDense() const {
+    return toBanded().toDense();
+}
+
+BandedMatrix TridiagonalMatrix::toBanded() const {
+    BandedMatrix B(n, 1, 1);
+    for (int i = 0; i < n; i++) {
+        B.at(i, i) = diag[i];
+        if (i > 0) {
+            B.at(i, i - 1) = sub[i];
+        }
+        if (i + 1 < n) {
+            B.at(i, i + 1) = super[i];
+        }
+    }
+    return B;
+}
+
+void TridiagonalMatrix::multiply(const vector<double>& x, vector<double>& y) const {
+    y.resize(n);
+    for (int i = 0; i < n; i++) {
+        double s = diag[i] * x[i];
+        if (i > 0) {
+            s += sub[i] * x[i - 1];
+        }
+        if (i + 1 < n) {
+            s += super[i] * x[i + 1];
+        }
+        y[i] = s;
+    }
+}
+
+bool TridiagonalMatrix::isDiagonallyDominant() const {
+    for (int i = 0; i < n; i++) {
+        if (fabs(diag[i]) <= fabs(sub[i]) + fabs(super[i])) {
+            return false;
+        }
+    }
+    return n > 0;
+}
+
+Result<vector<double>> TridiagonalMatrix::thomasSolve(const vector<double>& b) const {
+    if ((int)b.size() != n) {
+        return Result<vector<double>>(StatusCode::DimensionMismatch, "Dimensions mismatch in tridiagonal solver");
+    }
+
+    TELEMETRY_SCOPE("tridiagonal.thomas");
+    // c[i] is the upper entry of row i once the diagonal is scaled to 1
+    vector<double> c(n), x(n);
+    double prevC = 0.0, prevX = 0.0;
+    for (int i = 0; i < n; i++) {
+        double d = diag[i] - sub[i] * prevC;
+        if (fabs(d) < singularPivot) {
+            return Result<vector<double>>(StatusCode::Singular, "Zero pivot in tridiagonal solver");
+        }
+        prevC = c[i] = super[i] / d;
+        prevX = x[i] = (b[i] - sub[i] * prevX) / d;
+    }
+    for (int i = n - 2; i >= 0; i--) {
+        x[i] -= c[i] * x[i + 1];
+    }
+    return x;
+}
+
+Result<vector<double>> TridiagonalMatrix::cyclicReductionSolve(const vector<double>& b) const {
+    if ((int)b.size() != n) {
+        return Result<vector<double>>(StatusCode::DimensionMismatch, "Dimensions mismatch in tridiagonal solver");
+    }
+
+    TELEMETRY_SCOPE("tridiagonal.cyclic_reduction");
+    // Row i reads a[i] x[i - s] + d[i] x[i] + c[i] x[i + s] = r[i]. Adding
+    // multiples of rows i - s and i + s cancels x[i - s] and x[i + s] and
+    // brings in x[i - 2s] and x[i + 2s]; entries past either end stay zero.
+    vector<double> a = sub, d = diag, c = super, r = b;
+    vector<double> a2(n), d2(n), c2(n), r2(n);
+    atomic<bool> zeroPivot(false);
+    for (int s = 1; s < n; s *= 2) {
+        parallelTiles(n, 1, bandRowTile, 1, [&](int i0, int i1, int, int) {
+            for (int i = i0; i < i1; i++) {
+                double ai = 0.0, di = d[i], ci = 0.0, ri = r[i];
+                if (i - s >= 0) {
+                    if (fabs(d[i - s]) < singularPivot) {
+                        zeroPivot = true;
+                        return;
+                    }
+                    double f = a[i] / d[i - s];
+                    ai = -f * a[i - s];
+                    di -= f * c[i - s];
+                    ri -= f * r[i - s];
+                }
+                if (i + s < n) {
+                    if (fabs(d[i + s]) < singularPivot) {
+                        zeroPivot = true;
+                        return;
+                    }
+                    double g = c[i] / d[i + s];
+                    ci = -g * c[i + s];
+                    di -= g * a[i + s];
+                    ri -= g * r[i + s];
+                }
+                a2[i] = ai;
+                d2[i] = di;
+                c2[i] = ci;
+                r2[i] = ri;
+            }
+        });
+        if (zeroPivot) {
+            return Result<vector<double>>(StatusCode::Singular, "Zero pivot in tridiagonal solver");
+        }
+        a.swap(a2);
+        d.swap(d2);
+        c.swap(c2);
+        r.swap(r2);
+    }
+
+    vector<double> x(n);
+    for (int i = 0; i < n; i++) {
+        if (fabs(d[i]) < singularPivot) {
+            return Result<vector<double>>(StatusCode::Singular, "Zero pivot in tridiagonal solver");
+        }
+        x[i] = r[i] / d[i];
+    }
+    return x;
+}
+
+vector<double> TridiagonalMatrix::solve(const vector<double>& b) const {
+    return trySolve(b).value();
+}
+
+Result<vector<double>> TridiagonalMatrix::trySolve(const vector<double>& b) const {
+    if (!isDiagonallyDominant()) {
+        return BandedLUFactorization(toBanded()).trySolve(b);
+    }
+    if (n >= cyclicReductionMinSize && getNumThreads() > 1) {
+        return cyclicReductionSolve(b);
+    }
+    return thomasSolve(b);
+}
@@ -0,0 +1,154 @@
+#ifndef BANDED_HPP
+#define BANDED_HPP
+#include "matrix.hpp"
+
+// n x n matrix with kl diagonals below the main one and ku above it; every
+// other entry is zero. Storage is LAPACK's general band layout turned on
+// its side to match Matrix: row i keeps columns i - kl .. i + ku
+// contiguously, n * (kl + ku + 1) doubles in all, with the slots that fall
+// outside the matrix left at zero.
+class BandedMatrix {
+private:
+    int n, kl, ku;
+    int width;  // kl + ku + 1
+    vector<double> band;
+
+public:
+    BandedMatrix();
+    BandedMatrix(int size, int lower, int upper);
+    // Entries of A outside the band are dropped; see Matrix::bandwidth
+    static BandedMatrix fromDense(const Matrix& A, int lower, int upper);
+
+    int size() const { return n; }
+    int lowerBandwidth() const { return kl; }
+    int upperBandwidth() const { return ku; }
+    bool inBand(int i, int j) const { return j - i <= ku && i - j <= kl; }
+
+    // Zero outside the band; at() asserts (i, j) is inside it
+    double get(int i, int j) const { return inBand(i, j) ? band[(size_t)i * width + (j - i + kl)] : 0.0; }
+    double& at(int i, int j) {
+        assert(i >= 0 && i < n && j >= 0 && j < n && inBand(i, j));
+        return band[(size_t)i * width + (j - i + kl)];
+    }
+    const double* raw() const { return band.data(); }
+    Matrix toDense() const;
+
+    // y = A x in O(n * (kl + ku)); operator* returns an empty vector when x
+    // has the wrong size
+    void multiply(const vector<double>& x, vector<double>& y) const;
+    vector<double> operator*(const vector<double>& x) const;
+};
+
+// PA = LU with partial pivoting inside the band, as LAPACK's dgbtrf: row
+// swaps widen U to kl + ku diagonals above the main one, and L keeps the kl
+// multipliers of each step together with the swaps interleaved. Factoring
+// costs O(n * kl * (kl + ku)) and each solve O(n * (kl + ku)).
+class BandedLUFactorization {
+private:
+    int n, kl, ku;
+    int width;  // 2 * kl + ku + 1: row i of the factor spans i - kl .. i + kl + ku
+    vector<double> lu;
+    vector<double> multipliers;  // step j's are j * kl .. j * kl + kl
+    vector<int> pivots;
+    int swaps;
+    bool singular;
+    Status failure;
+
+    double& at(int i, int j) { return lu[(size_t)i * width + (j - i + kl)]; }
+    const double& at(int i, int j) const { return lu[(size_t)i * width + (j - i + kl)]; }
+    void solveColumn(double* x) const;
+
+public:
+    BandedLUFactorization();
+    explicit BandedLUFactorization(const BandedMatrix& A);
+
+    int size() const { return n; }
+    bool isSingular() const { return singular; }
+    const Status& status() const { return failure; }
+
+    vector<double> solve(const vector<double>& b) const;
+    Result<vector<double>> trySolve(const vector<double>& b) const;
+    // nrhs right-hand sides stored column-major, solved in parallel
+    Result<vector<double>> trySolveMany(const vector<double>& B, int nrhs) const;
+
+    double determinant() const;
+};
+
+// A = L L^T for a symmetric positive definite band matrix (kl == ku). L has
+// the same kl diagonals below the main one and nothing above it, so no
+// storage is added: row i of L keeps columns i - kl .. i.
+class BandedCholeskyFactorization {
+private:
+    int n, kd;
+    vector<double> l;
+    bool positiveDefinite;
+    Status failure;
+
+    double& at(int i, int j) { return l[(size_t)i * (kd + 1) + (j - i + kd)]; }
+    const double& at(int i, int j) const { return l[(size_t)i * (kd + 1) + (j - i + kd)]; }
+
+public:
+    BandedCholeskyFactorization();
+    // checkSymmetry = false trusts the lower half of the band and skips the
+    // O(n * kd) comparison with the upper half
+    explicit BandedCholeskyFactorization(const BandedMatrix& A, bool checkSymmetry = true);
+
+    int size() const { return n; }
+    bool isPositiveDefinite() const { return positiveDefinite; }
+    const Status& status() const { return failure; }
+
+    vector<double> solve(const vector<double>& b) const;
+    Result<vector<double>> trySolve(const vector<double>& b) const;
+
+    double determinant() const;
+};
+
+// Tridiagonal matrix as its three diagonals: lower(i) = A(i, i - 1),
+// diagonal(i) = A(i, i), upper(i) = A(i, i + 1). lower(0) and upper(n - 1)
+// are kept at zero.
+class TridiagonalMatrix {
+private:
+    int n;
+    vector<double> sub, diag, super;
+
+public:
+    TridiagonalMatrix();
+    explicit TridiagonalMatrix(int size);
+    // The n - 1 entries below the diagonal, the n on it and the n - 1 above;
+    // sizes that do not fit give an empty matrix
+    TridiagonalMatrix(const vector<double>& lower, const vector<double>& diagonal, const vector<double>& upper);
+    static TridiagonalMatrix fromDense(const Matrix& A);
+
+    int size() const { return n; }
+    double& lower(int i) { return sub[i]; }
+    double& diagonal(int i) { return diag[i]; }
+    double& upper(int i) { return super[i]; }
+    double lower(int i) const { return sub[i]; }
+    double diagonal(int i) const { return diag[i]; }
+    double upper(int i) const { return super[i]; }
+
+    double get(int i, int j) const;
+    Matrix toDense() const;
+    BandedMatrix toBanded() const;
+    void multiply(const vector<double>& x, vector<double>& y) const;
+    bool isDiagonallyDominant() const;
+
+    // Thomas algorithm: elimination without pivoting, 8n flops, strictly
+    // sequential. Safe for diagonally dominant or SPD matrices; otherwise a
+    // small pivot fails with Singular or, worse, goes unnoticed.
+    Result<vector<double>> thomasSolve(const vector<double>& b) const;
+    // Parallel cyclic reduction: step k couples each row with the rows 2^k
+    // away and eliminates the neighbours in between, so after log2(n) steps
+    // every unknown stands alone. All rows of a step are independent and
+    // split over the thread pool; the price is O(n log n) work against
+    // Thomas's O(n). Same stability conditions as Thomas.
+    Result<vector<double>> cyclicReductionSolve(const vector<double>& b) const;
+
+    // Thomas, or cyclic reduction when there are threads to spread it over
+    // and n is large, for a diagonally dominant matrix; banded LU with
+    // pivoting otherwise.
+    vector<double> solve(const vector<double>& b) const;
+    Result<vector<double>> trySolve(const vector<double>& b) const;
+};
+
+#endif
@@ -0,0 +1,928 @@
+// Timing harness for the Matrix kernels.
+//
+//   g++ -std=c++17 -O2 -march=native -pthread -o benchmark benchmark.cpp matrix.cpp gemm.cpp
+//       threadpool.cpp lu.cpp cholesky.cpp sparse.cpp krylov.cpp textio.cpp telemetry.cpp status.cpp
+//       precision.cpp banded.cpp solver.cpp
+//   ./benchmark [n ...]          old vs new layout for every kernel
+//   ./benchmark gemm [n ...]     GFLOP/s of the blocked GEMM vs the triple loop
+//   ./benchmark threads [n]      scaling from 1 thread up to the pool size
+//   ./benchmark sparse [nx]      CSR Jacobi / Gauss-Seidel / SOR on an nx*nx 5-point grid
+//   ./benchmark jacobi [n ...]   dense Gauss-Jacobi iteration cost and reordering for dominance, old vs new
+//   ./benchmark io [n ...]       text vs binary save/load/mmap throughput
+//   ./benchmark krylov [nx]      CG / BiCGSTAB / GMRES vs Gauss-Seidel on the same grid
+//   ./benchmark expr [n ...]     A + B - C and A * B + C, one temporary per operator vs fused
+//   ./benchmark transpose [n ...]
+//                                element loop vs blocked vs in-place transpose, A^T * B formed vs lazy
+//   ./benchmark banded [n ...]   dense LU vs band-detecting gaussianElimination, Thomas vs cyclic reduction
+//   ./benchmark mixed [n ...]    float LU + double refinement vs double gaussianElimination
+//   ./benchmark auto [n ...]     pivoted LU vs solve() on general, dominant, SPD, banded and sparse matrices
+//   ./benchmark suite [--sizes 256,512] [--threads 1,2,4] [--reps 3] [--json out.json]
+//                                every Matrix kernel: time, GFLOP/s and bytes/flop
+//   ./benchmark compare base.json new.json [threshold]
+//                                flags kernels slower than base by more than threshold
+//                                (default 0.10); exits with 2 when any are
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <cmath>
+#include "matrix.hpp"
+#include "threadpool.hpp"
+#include "sparse.hpp"
+#include "krylov.hpp"
+#include "lu.hpp"
+#include "cholesky.hpp"
+#include "banded.hpp"
+#include "solver.hpp"
+using namespace std;
+
+// The vector<vector<double>> kernels Matrix used before it moved onto a
+// single contiguous buffer, kept as the "before" side of the comparison.
+namespace legacy {
+
+typedef vector<vector<double>> Grid;
+
+Grid multiply(const Grid& a, const Grid& b) {
+    int n = a.size(), m = b[0].size(), p = b.size();
+    Grid c(n, vector<double>(m, 0));
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            for (int k = 0; k < p; k++)
+                c[i][j] += a[i][k] * b[k][j];
+    return c;
+}
+
+bool isSymmetric(const Grid& a) {
+    int n = a.size();
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < i; j++)
+            if (fabs(a[i][j] - a[j][i]) > 1e-10) return false;
+    return true;
+}
+
+bool isDiagonallyDominant(const Grid& a) {
+    int n = a.size();
+    for (int i = 0; i < n; i++) {
+        double rowSum = 0.0;
+        for (int j = 0; j < n; j++)
+            if (i != j) rowSum += fabs(a[i][j]);
+        if (fabs(a[i][i]) <= rowSum) return false;
+    }
+    return true;
+}
+
+Grid transpose(const Grid& a) {
+    int n = a.size(), m = a[0].size();
+    Grid t(m, vector<double>(n, 0));
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            t[j][i] = a[i][j];
+    return t;
+}
+
+Grid add(const Grid& a, const Grid& b) {
+    int n = a.size(), m = a[0].size();
+    Grid c(n, vector<double>(m, 0));
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            c[i][j] = a[i][j] + b[i][j];
+    return c;
+}
+
+double doolittleTrace(const Grid& a) {
+    int n = a.size();
+    Grid L(n, vector<double>(n, 0)), U(n, vector<double>(n, 0));
+    for (int i = 0; i < n; i++) L[i][i] = 1.0;
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i <= j; i++) {
+            double sum = 0.0;
+            for (int k = 0; k < i; k++) sum += L[i][k] * U[k][j];
+            U[i][j] = a[i][j] - sum;
+        }
+        for (int i = j + 1; i < n; i++) {
+            double sum = 0.0;
+            for (int k = 0; k < j; k++) sum += L[i][k] * U[k][j];
+            L[i][j] = (a[i][j] - sum) / U[j][j];
+        }
+    }
+    return U[n - 1][n - 1];
+}
+
+// The Gauss-Jacobi loop: j != i test in the inner loop, a separate error
+// pass and a full copy of the iterate every iteration.
+vector<double> jacobi(const Grid& a, const vector<double>& b, int iterations) {
+    int n = a.size();
+    vector<double> x(n, 0.0), x_new(n, 0.0);
+    for (int iter = 0; iter < iterations; iter++) {
+        for (int i = 0; i < n; i++) {
+            double sum = 0.0;
+            for (int j = 0; j < n; j++)
+                if (j != i) sum += a[i][j] * x[j];
+            x_new[i] = (b[i] - sum) / a[i][i];
+        }
+        double error = 0.0;
+        for (int i = 0; i < n; i++) error += fabs(x_new[i] - x[i]);
+        x = x_new;
+        if (error < 0) break;
+    }
+    return x;
+}
+
+// The greedy reordering: for each row that is not dominant, full row sums
+// of the rows below it until one would be, then a swap of whole rows
+bool makeDiagonallyDominant(Grid& a) {
+    int n = a.size();
+    for (int i = 0; i < n; i++) {
+        double rowSum = 0.0;
+        for (int j = 0; j < n; j++)
+            if (i != j) rowSum += fabs(a[i][j]);
+        if (fabs(a[i][i]) > rowSum) continue;
+        int bestRow = i;
+        for (int k = i + 1; k < n && bestRow == i; k++) {
+            double potentialSum = 0.0;
+            for (int j = 0; j < n; j++)
+                if (j != i) potentialSum += fabs(a[k][j]);
+            if (fabs(a[k][i]) > potentialSum) bestRow = k;
+        }
+        if (bestRow == i) return false;
+        swap(a[i], a[bestRow]);
+    }
+    return true;
+}
+
+}
+
+// Diagonally dominant test matrix, so every solver in the suite applies.
+Matrix makeTestMatrix(int n, unsigned seed) {
+    srand(seed);
+    Matrix m(n, n);
+    for (int i = 0; i < n; i++) {
+        double rowSum = 0.0;
+        for (int j = 0; j < n; j++) {
+            if (i == j) continue;
+            m(i, j) = (rand() % 2000 - 1000) / 1000.0;
+            rowSum += fabs(m(i, j));
+        }
+        m(i, i) = rowSum + 1.0;
+    }
+    return m;
+}
+
+legacy::Grid toGrid(const Matrix& m) {
+    legacy::Grid g(m.getRows(), vector<double>(m.getCols()));
+    for (int i = 0; i < m.getRows(); i++)
+        for (int j = 0; j < m.getCols(); j++)
+            g[i][j] = m(i, j);
+    return g;
+}
+
+// Best-of-`reps` wall time in seconds.
+double timeIt(const function<void()>& fn, int reps = 3) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto start = chrono::steady_clock::now();
+        fn();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+// The i-j-k loop Matrix::operator* used before the blocked GEMM.
+Matrix naiveMultiply(const Matrix& a, const Matrix& b) {
+    Matrix c(a.getRows(), b.getCols());
+    for (int i = 0; i < a.getRows(); i++)
+        for (int j = 0; j < b.getCols(); j++) {
+            double sum = 0.0;
+            for (int k = 0; k < a.getCols(); k++) sum += a(i, k) * b(k, j);
+            c(i, j) = sum;
+        }
+    return c;
+}
+
+double gflops(int n, double seconds) {
+    return 2.0 * n * n * (double)n / seconds * 1e-9;
+}
+
+// The triple loop takes minutes past this size, so it is only timed below.
+const int naiveLimit = 1024;
+
+void gemmSweep(const vector<int>& sizes) {
+    cout << right << setw(7) << "n" << setw(14) << "loop GF/s" << setw(14) << "gemm GF/s"
+         << setw(14) << "C+=AB GF/s" << setw(10) << "speedup" << endl;
+    for (int n : sizes) {
+        Matrix A = makeTestMatrix(n, 1);
+        Matrix B = makeTestMatrix(n, 2);
+        Matrix C(n, n);
+        volatile double sink = 0;
+
+        double tBlocked = timeIt([&] { sink = Matrix(A * B)(0, 0); }, 2);
+        double tAccum = timeIt([&] { C.multiplyAdd(A, B); sink = C(0, 0); }, 2);
+        cout << fixed << setprecision(2) << setw(7) << n;
+        if (n <= naiveLimit) {
+            double tLoop = timeIt([&] { sink = naiveMultiply(A, B)(0, 0); }, 1);
+            cout << setw(14) << gflops(n, tLoop);
+            cout << setw(14) << gflops(n, tBlocked) << setw(14) << gflops(n, tAccum)
+                 << setw(9) << tLoop / tBlocked << "x" << endl;
+        } else {
+            cout << setw(14) << "-" << setw(14) << gflops(n, tBlocked)
+                 << setw(14) << gflops(n, tAccum) << setw(10) << "-" << endl;
+        }
+        (void)sink;
+    }
+}
+
+void threadSweep(int n) {
+    Matrix A = makeTestMatrix(n, 1);
+    Matrix B = makeTestMatrix(n, 2);
+    volatile double sink = 0;
+
+    int maxThreads = getNumThreads();
+    vector<int> counts;
+    for (int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+    counts.push_back(maxThreads);
+
+    cout << "n = " << n << endl;
+    cout << right << setw(8) << "threads" << setw(14) << "multiply[s]" << setw(10) << "speedup"
+         << setw(12) << "add[s]" << setw(10) << "speedup"
+         << setw(14) << "transpose[s]" << setw(10) << "speedup" << endl;
+    double base[3] = {0, 0, 0};
+    for (int t : counts) {
+        setNumThreads(t);
+        double times[3] = {
+            timeIt([&] { sink = Matrix(A * B)(0, 0); }, 2),
+            timeIt([&] { sink = Matrix(A + B)(0, 0); }),
+            timeIt([&] { sink = Matrix(A.transpose())(0, 0); })
+        };
+        if (t == 1) {
+            for (int k = 0; k < 3; k++) base[k] = times[k];
+        }
+        cout << setw(8) << t << fixed;
+        for (int k = 0; k < 3; k++) {
+            cout << setprecision(4) << setw(k == 0 ? 14 : (k == 1 ? 12 : 14)) << times[k]
+                 << setprecision(2) << setw(9) << base[k] / times[k] << "x";
+        }
+        cout << endl;
+    }
+    setNumThreads(maxThreads);
+    (void)sink;
+}
+
+// 5-point Laplacian on an nx x nx grid plus `shift` on the diagonal, the
+// operator of one implicit diffusion step. Strictly dominant for shift > 0.
+SparseMatrix laplacian2D(int nx, double shift) {
+    vector<Triplet> t;
+    t.reserve((size_t)5 * nx * nx);
+    for (int gy = 0; gy < nx; gy++) {
+        for (int gx = 0; gx < nx; gx++) {
+            int i = gy * nx + gx;
+            t.push_back({i, i, 4.0 + shift});
+            if (gx > 0) t.push_back({i, i - 1, -1.0});
+            if (gx < nx - 1) t.push_back({i, i + 1, -1.0});
+            if (gy > 0) t.push_back({i, i - nx, -1.0});
+            if (gy < nx - 1) t.push_back({i, i + nx, -1.0});
+        }
+    }
+    return SparseMatrix::fromTriplets(nx * nx, nx * nx, t);
+}
+
+void sparseSweep(int nx) {
+    auto start = chrono::steady_clock::now();
+    SparseMatrix A = laplacian2D(nx, 1.0);
+    chrono::duration<double> build = chrono::steady_clock::now() - start;
+    int n = A.getRows();
+    vector<double> b(n, 1.0);
+    double tolerance = 1e-8 * n;
+
+    cout << "n = " << n << ", nnz = " << A.nonZeros()
+         << ", build " << fixed << setprecision(3) << build.count() << " s" << endl;
+    double tJacobi = timeIt([&] { A.gaussJacobi(b, 1000, tolerance); }, 1);
+    double tSeidel = timeIt([&] { A.gaussSeidel(b, 1000, tolerance); }, 1);
+    double tColored = timeIt([&] { A.multicolorGaussSeidel(b, 1000, 1e-8); }, 1);
+    double tSor = timeIt([&] { A.sor(b, 1.5, 1000, 1e-8); }, 1);
+    double tSpmv = timeIt([&] { vector<double> y = A * b; }, 5);
+    cout << "jacobi " << tJacobi << " s, seidel " << tSeidel << " s, red-black seidel " << tColored
+         << " s, red-black sor(1.5) " << tSor << " s, spmv "
+         << setprecision(2) << 2.0 * A.nonZeros() / tSpmv * 1e-9 << " GF/s" << endl;
+}
+
+double relativeResidual(const SparseMatrix& A, const vector<double>& x, const vector<double>& b) {
+    if (x.empty()) return 1.0;
+    vector<double> r = A * x;
+    double num = 0, den = 0;
+    for (size_t i = 0; i < b.size(); i++) {
+        num += (b[i] - r[i]) * (b[i] - r[i]);
+        den += b[i] * b[i];
+    }
+    return sqrt(num / den);
+}
+
+// A nearly singular Poisson problem: Gauss-Seidel crawls, Krylov methods
+// need O(nx) iterations, fewer with a good preconditioner.
+void krylovSweep(int nx) {
+    SparseMatrix A = laplacian2D(nx, 1e-3);
+    int n = A.getRows();
+    vector<double> b(n, 1.0);
+    SparseOperator op(A);
+    JacobiPreconditioner jacobi(A);
+    ILU0Preconditioner ilu(A);
+    const double tolerance = 1e-8;
+    const int seidelIterations = 2000;
+
+    cout << "n = " << n << ", nnz = " << A.nonZeros() << ", stop at ||r||/||b|| < " << tolerance << endl;
+    cout << left << setw(22) << "method" << right << setw(8) << "iters"
+         << setw(12) << "time[s]" << setw(14) << "residual" << endl;
+    auto row = [&](const string& name, int iterations, double t, const vector<double>& x) {
+        cout << left << setw(22) << name << right << setw(8) << iterations << fixed << setprecision(3)
+             << setw(12) << t << scientific << setprecision(2) << setw(14)
+             << relativeResidual(A, x, b) << endl;
+    };
+
+    vector<double> x;
+    double t = timeIt([&] { x = A.gaussSeidel(b, seidelIterations, 0.0).value().x; }, 1);
+    row("gauss-seidel", seidelIterations, t, x);
+
+    struct Run { string name; function<Result<IterativeResult>()> solve; };
+    vector<Run> runs = {
+        {"cg", [&] { return conjugateGradient(op, b, nullptr, 10000, tolerance); }},
+        {"cg + jacobi", [&] { return conjugateGradient(op, b, &jacobi, 10000, tolerance); }},
+        {"cg + ilu0", [&] { return conjugateGradient(op, b, &ilu, 10000, tolerance); }},
+        {"bicgstab + ilu0", [&] { return biCGSTAB(op, b, &ilu, 10000, tolerance); }},
+        {"gmres(30) + ilu0", [&] { return gmres(op, b, &ilu, 30, 10000, tolerance); }},
+    };
+    for (const Run& run : runs) {
+        IterativeResult result;
+        t = timeIt([&] { result = run.solve().value(); }, 1);
+        row(run.name, result.iterations, t, result.x);
+    }
+}
+
+void report(const string& kernel, int n, double before, double after) {
+    cout << left << setw(12) << kernel << right << setw(7) << n
+         << fixed << setprecision(4)
+         << setw(12) << before << setw(12) << after
+         << setprecision(2) << setw(9) << before / after << "x" << endl;
+}
+
+// The ifstream >> loop readFromFile used before the chunked parser
+Matrix streamReadText(const string& filename) {
+    ifstream inFile(filename + ".txt");
+    int r, c;
+    inFile >> r >> c;
+    Matrix mat(r, c);
+    for (int i = 0; i < r; i++)
+        for (int j = 0; j < c; j++)
+            inFile >> mat(i, j);
+    return mat;
+}
+
+// Save/load throughput of the text and binary formats. Files go to the
+// current directory and are removed afterwards.
+void ioSweep(const vector<int>& sizes) {
+    const string name = "benchmark_io";
+    cout << left << setw(16) << "path" << right << setw(7) << "n" << setw(12) << "time[s]"
+         << setw(12) << "MB/s" << endl;
+    for (int n : sizes) {
+        Matrix A = makeTestMatrix(n, 1);
+        double mb = (double)n * n * sizeof(double) / 1e6;
+        volatile double sink = 0;
+        auto row = [&](const string& path, double t) {
+            cout << left << setw(16) << path << right << setw(7) << n << fixed << setprecision(4)
+                 << setw(12) << t << setprecision(1) << setw(12) << mb / t << endl;
+        };
+
+        row("text save", timeIt([&] { A.writeToFile(name); }, 1));
+        row("text load >>", timeIt([&] { sink = streamReadText(name)(n - 1, n - 1); }, 1));
+        row("text load", timeIt([&] { sink = Matrix::readFromFile(name)(n - 1, n - 1); }, 1));
+        row("binary save", timeIt([&] { A.saveBinary(name); }));
+        row("binary load", timeIt([&] { sink = Matrix::loadBinary(name)(n - 1, n - 1); }));
+        row("mmap", timeIt([&] { sink = Matrix::mapBinary(name)(n - 1, n - 1); }));
+        // Mapping is lazy; this includes faulting in and checking every page
+        row("mmap + verify", timeIt([&] { sink = Matrix::mapBinary(name, true)(n - 1, n - 1); }));
+        remove((name + ".txt").c_str());
+        remove((name + ".bin").c_str());
+        (void)sink;
+    }
+}
+
+// Time per Jacobi iteration on dense dominant systems, old loop vs new, and
+// the cost of finding a dominant row order
+void jacobiSweep(const vector<int>& sizes) {
+    const int iterations = 20;
+    cout << left << setw(12) << "kernel" << right << setw(7) << "n"
+         << setw(12) << "before[s]" << setw(12) << "after[s]" << setw(10) << "speedup" << endl;
+    for (int n : sizes) {
+        Matrix A = makeTestMatrix(n, 1);
+        legacy::Grid a = toGrid(A);
+        vector<double> b(n, 1.0);
+        double before = timeIt([&] { legacy::jacobi(a, b, iterations); }, 1);
+        // Zero tolerance forces every iteration to run
+        double after = timeIt([&] { A.gaussJacobi(b, iterations, 0.0); }, 1);
+        report("jacobi/iter", n, before / iterations, after / iterations);
+
+        // Rows in reverse, so every row has to be found a place
+        Matrix R(n, n);
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++) R(i, j) = A(n - 1 - i, j);
+        legacy::Grid r = toGrid(R);
+        vector<int> order;
+        report("reorder", n, timeIt([&] { legacy::makeDiagonallyDominant(r); }, 1),
+               timeIt([&] { R.diagonallyDominantOrder(order); }, 1));
+    }
+}
+
+// Expression chains evaluated the way the by-value operators used to, one
+// Matrix per operator, against the fused expression assigned into an
+// existing D: a single elementwise pass, and a single accumulating GEMM.
+void exprSweep(const vector<int>& sizes) {
+    cout << left << setw(12) << "kernel" << right << setw(7) << "n"
+         << setw(12) << "before[s]" << setw(12) << "after[s]" << setw(10) << "speedup" << endl;
+    for (int n : sizes) {
+        Matrix A = makeTestMatrix(n, 1);
+        Matrix B = makeTestMatrix(n, 2);
+        Matrix C = makeTestMatrix(n, 3);
+        Matrix D(n, n);
+        volatile double sink = 0;
+
+        report("A+B-C", n,
+               timeIt([&] { Matrix T(A + B); D = Matrix(T - C); sink = D(0, 0); }),
+               timeIt([&] { D = A + B - C; sink = D(0, 0); }));
+        report("A*B+C", n,
+               timeIt([&] { Matrix T(A * B); D = Matrix(T + C); sink = D(0, 0); }, 1),
+               timeIt([&] { D = A * B + C; sink = D(0, 0); }, 1));
+        (void)sink;
+    }
+}
+
+// The element-by-element transpose against the blocked copy and the
+// in-place swap, then A^T * B with the transpose formed against handing it
+// to GEMM
+void transposeSweep(const vector<int>& sizes) {
+    cout << left << setw(12) << "kernel" << right << setw(7) << "n"
+         << setw(12) << "before[s]" << setw(12) << "after[s]" << setw(10) << "speedup" << endl;
+    for (int n : sizes) {
+        Matrix A = makeTestMatrix(n, 1);
+        Matrix B = makeTestMatrix(n, 2);
+        Matrix T(n, n), D(n, n);
+        volatile double sink = 0;
+
+        double naive = timeIt([&] {
+            for (int i = 0; i < n; i++)
+                for (int j = 0; j < n; j++) T(j, i) = A(i, j);
+            sink = T(0, 0);
+        });
+        report("blocked", n, naive, timeIt([&] { T = A.transpose(); sink = T(0, 0); }));
+        report("in place", n, naive, timeIt([&] { A.transposeInPlace(); sink = A(0, 0); }));
+        report("A^T*B", n,
+               timeIt([&] { T = A.transpose(); D = T * B; sink = D(0, 0); }, 1),
+               timeIt([&] { D = A.transpose() * B; sink = D(0, 0); }, 1));
+        (void)sink;
+    }
+}
+
+// Dominant, with kd diagonals on either side
+Matrix makeBandMatrix(int n, int kd, unsigned seed) {
+    srand(seed);
+    Matrix m(n, n);
+    for (int i = 0; i < n; i++) {
+        double rowSum = 0.0;
+        for (int j = max(0, i - kd); j <= min(n - 1, i + kd); j++) {
+            if (i == j) continue;
+            m(i, j) = (rand() % 2000 - 1000) / 1000.0;
+            rowSum += fabs(m(i, j));
+        }
+        m(i, i) = rowSum + 1.0;
+    }
+    return m;
+}
+
+// Dense LU against gaussianElimination, which finds the band and solves
+// with banded LU (Thomas for kd = 1); then Thomas against parallel cyclic
+// reduction on a long tridiagonal system
+void bandedSweep(const vector<int>& sizes) {
+    cout << left << setw(12) << "kernel" << right << setw(9) << "n"
+         << setw(12) << "before[s]" << setw(12) << "after[s]" << setw(10) << "speedup" << endl;
+    auto line = [](const string& kernel, int n, double before, double after) {
+        cout << left << setw(12) << kernel << right << setw(9) << n << fixed << setprecision(4)
+             << setw(12) << before << setw(12) << after << setprecision(2) << setw(9) << before / after << "x"
+             << defaultfloat << endl;
+    };
+    for (int n : sizes) {
+        vector<double> b(n);
+        for (int i = 0; i < n; i++) b[i] = sin(i + 1.0);
+        for (int kd : {1, 8, 64}) {
+            Matrix A = makeBandMatrix(n, kd, kd);
+            vector<double> x;
+            line("band " + to_string(kd), n,
+                 timeIt([&] { x = LUFactorization(A).solve(b); }, 1),
+                 timeIt([&] { x = A.gaussianElimination(b); }, 1));
+        }
+    }
+
+    int n = 1 << 22;
+    TridiagonalMatrix T(n);
+    for (int i = 0; i < n; i++) {
+        T.diagonal(i) = 4.0;
+        if (i > 0) T.lower(i) = -1.0;
+        if (i + 1 < n) T.upper(i) = -1.5;
+    }
+    vector<double> b(n, 1.0), x;
+    line("pcr", n, timeIt([&] { x = T.thomasSolve(b).value(); }),
+         timeIt([&] { x = T.cyclicReductionSolve(b).value(); }));
+}
+
+double relativeResidual(const Matrix& A, const vector<double>& x, const vector<double>& b) {
+    vector<double> Ax;
+    DenseOperator(A).apply(x, Ax);
+    double r = 0.0, bb = 0.0;
+    for (size_t i = 0; i < b.size(); i++) {
+        r += (b[i] - Ax[i]) * (b[i] - Ax[i]);
+        bb += b[i] * b[i];
+    }
+    return sqrt(r / bb);
+}
+
+// The double LU solve against the float LU refined in double, with the
+// accuracy each reaches
+void mixedSweep(const vector<int>& sizes) {
+    cout << left << setw(7) << "n" << right << setw(12) << "double[s]" << setw(12) << "mixed[s]"
+         << setw(10) << "speedup" << setw(7) << "steps" << setw(14) << "res double" << setw(14) << "res mixed"
+         << endl;
+    for (int n : sizes) {
+        Matrix A = makeTestMatrix(n, 1);
+        vector<double> b(n);
+        for (int i = 0; i < n; i++) b[i] = sin(i + 1.0);
+
+        vector<double> xDouble;
+        IterativeResult mixed;
+        double tDouble = timeIt([&] { xDouble = A.gaussianElimination(b); }, 1);
+        double tMixed = timeIt([&] { mixed = A.tryMixedPrecisionSolve(b).value(); }, 1);
+        cout << left << setw(7) << n << right << fixed << setprecision(4) << setw(12) << tDouble
+             << setw(12) << tMixed << setprecision(2) << setw(9) << tDouble / tMixed << "x"
+             << setw(7) << mixed.iterations << scientific << setprecision(2)
+             << setw(14) << relativeResidual(A, xDouble, b) << setw(14) << relativeResidual(A, mixed.x, b)
+             << defaultfloat << endl;
+    }
+}
+
+// Symmetric, strictly dominant with a positive diagonal, so SPD
+Matrix makeSpdMatrix(int n, unsigned seed) {
+    srand(seed);
+    Matrix m(n, n);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < i; j++)
+            m(i, j) = m(j, i) = (rand() % 2000 - 1000) / 1000.0;
+    for (int i = 0; i < n; i++) {
+        double rowSum = 0.0;
+        for (int j = 0; j < n; j++)
+            if (j != i) rowSum += fabs(m(i, j));
+        m(i, i) = rowSum + 1.0;
+    }
+    return m;
+}
+
+// Symmetric and dominant with about 8 off-diagonal entries per row spread
+// over the whole row, so neither dense nor banded
+Matrix makeSparseSpdMatrix(int n, unsigned seed) {
+    srand(seed);
+    Matrix m(n, n);
+    for (int i = 0; i < n; i++)
+        for (int k = 0; k < 4; k++) {
+            int j = rand() % n;
+            if (j != i) m(i, j) = m(j, i) = (rand() % 2000 - 1000) / 1000.0;
+        }
+    for (int i = 0; i < n; i++) {
+        double rowSum = 0.0;
+        for (int j = 0; j < n; j++)
+            if (j != i) rowSum += fabs(m(i, j));
+        m(i, i) = rowSum + 1.0;
+    }
+    return m;
+}
+
+// Pivoted LU, the menu's default, against solve() on matrices of each
+// structure it looks for; the analysis is part of solve()'s time
+void autoSweep(const vector<int>& sizes) {
+    cout << left << setw(12) << "matrix" << right << setw(7) << "n" << setw(12) << "lu[s]" << setw(12) << "auto[s]"
+         << setw(10) << "speedup" << "  chosen" << endl;
+    for (int n : sizes) {
+        vector<double> b(n);
+        for (int i = 0; i < n; i++) b[i] = sin(i + 1.0);
+        Matrix general = makeTestMatrix(n, 3);
+        for (int i = 0; i < n; i++) general(i, i) = 0.5;
+        vector<pair<string, Matrix>> cases = {{"general", general},
+                                              {"dominant", makeTestMatrix(n, 1)},
+                                              {"spd", makeSpdMatrix(n, 2)},
+                                              {"band 8", makeBandMatrix(n, 8, 8)},
+                                              {"sparse spd", makeSparseSpdMatrix(n, 4)}};
+        for (const auto& c : cases) {
+            vector<double> x;
+            Result<SolveReport> solved = SolveReport();
+            double after = timeIt([&] { solved = solve(c.second, b); }, 1);
+            double before = timeIt([&] { x = LUFactorization(c.second).solve(b); }, 1);
+            cout << left << setw(12) << c.first << right << setw(7) << n << fixed << setprecision(4)
+                 << setw(12) << before << setw(12) << after << setprecision(2) << setw(9) << before / after << "x"
+                 << defaultfloat << "  " << (solved ? solveMethodName(solved->method()) : "failed") << endl;
+        }
+    }
+}
+
+// One timed kernel at one size and thread count. flops and bytes are the
+// nominal counts: bytes is the data the kernel must touch at least once
+// (per iteration for the iterative solvers), so bytes/flop is a floor on
+// its memory traffic.
+struct SuiteResult {
+    string kernel;
+    int n;
+    int threads;
+    double seconds;
+    double flops;
+    double bytes;
+};
+
+vector<int> parseList(const string& s) {
+    vector<int> v;
+    size_t start = 0;
+    while (start < s.size()) {
+        size_t comma = s.find(',', start);
+        if (comma == string::npos) comma = s.size();
+        v.push_back(atoi(s.substr(start, comma - start).c_str()));
+        start = comma + 1;
+    }
+    return v;
+}
+
+// Every public Matrix kernel at each size and thread count, best of `reps`
+vector<SuiteResult> runSuite(const vector<int>& sizes, const vector<int>& threadCounts, int reps) {
+    const int iterations = 20;
+    int maxThreads = getNumThreads();
+    vector<SuiteResult> results;
+    for (int n : sizes) {
+        Matrix A = makeTestMatrix(n, 1);
+        Matrix B = makeTestMatrix(n, 2);
+        Matrix S = makeSpdMatrix(n, 3);
+        vector<double> b(n, 1.0);
+        double nn = (double)n * n, nnn = nn * n, matrixBytes = nn * sizeof(double);
+        volatile double sink = 0;
+
+        struct Kernel {
+            string name;
+            double flops, bytes;
+            function<void()> run;
+        };
+        vector<Kernel> kernels = {
+            {"multiply", 2 * nnn, 3 * matrixBytes, [&] { sink = Matrix(A * B)(0, 0); }},
+            {"gaussianElimination", 2 * nnn / 3, matrixBytes, [&] { sink = A.gaussianElimination(b)[0]; }},
+            {"luFactorize", 2 * nnn / 3, matrixBytes, [&] { sink = A.luFactorize().determinant(); }},
+            {"luDecompositionDoolittle", 2 * nnn / 3, 3 * matrixBytes,
+             [&] { sink = A.luDecompositionDoolittle().second(n - 1, n - 1); }},
+            {"choleskyDecomposition", nnn / 3, 2 * matrixBytes,
+             [&] { sink = S.choleskyDecomposition(false)(n - 1, n - 1); }},
+            {"choleskyFactorize", nnn / 3, matrixBytes, [&] { sink = S.choleskyFactorize(false).determinant(); }},
+            // Zero tolerance runs every iteration; reported per iteration
+            {"gaussJacobi/iter", 2 * nn, matrixBytes, [&] { sink = A.gaussJacobi(b, iterations, 0.0)[0]; }},
+            {"gaussSeidel/iter", 2 * nn, matrixBytes, [&] { sink = A.gaussSeidel(b, iterations, 0.0)[0]; }},
+        };
+
+        for (int t : threadCounts) {
+            setNumThreads(t);
+            for (const Kernel& k : kernels) {
+                double seconds = timeIt(k.run, reps);
+                if (k.name.find("/iter") != string::npos) seconds /= iterations;
+                results.push_back({k.name, n, t, seconds, k.flops, k.bytes});
+                cout << left << setw(26) << k.name << right << setw(7) << n << setw(9) << t
+                     << fixed << setprecision(6) << setw(13) << seconds
+                     << setprecision(2) << setw(10) << k.flops / seconds * 1e-9
+                     << setprecision(4) << setw(12) << k.bytes / k.flops << endl;
+            }
+        }
+        (void)sink;
+    }
+    setNumThreads(maxThreads);
+    return results;
+}
+
+// One result per line, so compare() can read the file back without a
+// general JSON parser
+bool writeSuiteJson(const string& path, const vector<SuiteResult>& results) {
+    ofstream out(path);
+    if (!out) {
+        cout << "Error opening " << path << " for writing!" << endl;
+        return false;
+    }
+    out << "{\"hardware_threads\": " << thread::hardware_concurrency() << ", \"results\": [\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const SuiteResult& r = results[k];
+        out << setprecision(9) << "  {\"kernel\": \"" << r.kernel << "\", \"n\": " << r.n
+            << ", \"threads\": " << r.threads << ", \"seconds\": " << r.seconds
+            << ", \"gflops\": " << r.flops / r.seconds * 1e-9
+            << ", \"bytes_per_flop\": " << r.bytes / r.flops << "}"
+            << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]}\n";
+    return (bool)out;
+}
+
+// Pulls the number (or quoted string) after "key": on a result line
+bool jsonField(const string& line, const string& key, string& value) {
+    size_t at = line.find("\"" + key + "\": ");
+    if (at == string::npos) return false;
+    at += key.size() + 4;
+    if (at < line.size() && line[at] == '"') {
+        size_t end = line.find('"', at + 1);
+        value = line.substr(at + 1, end - at - 1);
+    } else {
+        size_t end = line.find_first_of(",}", at);
+        value = line.substr(at, end - at);
+    }
+    return true;
+}
+
+bool readSuiteJson(const string& path, vector<SuiteResult>& results) {
+    ifstream in(path);
+    if (!in) {
+        cout << "Error opening " << path << "!" << endl;
+        return false;
+    }
+    string line;
+    while (getline(in, line)) {
+        string kernel, n, threads, seconds;
+        if (jsonField(line, "kernel", kernel) && jsonField(line, "n", n) &&
+            jsonField(line, "threads", threads) && jsonField(line, "seconds", seconds)) {
+            results.push_back({kernel, atoi(n.c_str()), atoi(threads.c_str()), atof(seconds.c_str()), 0, 0});
+        }
+    }
+    return true;
+}
+
+// Flags every (kernel, n, threads) whose time grew by more than
+// `threshold` (0.10 = 10%) over the baseline. Returns the regression count.
+int compareSuites(const vector<SuiteResult>& baseline, const vector<SuiteResult>& current, double threshold) {
+    int regressions = 0;
+    cout << left << setw(26) << "kernel" << right << setw(7) << "n" << setw(9) << "threads"
+         << setw(13) << "baseline[s]" << setw(13) << "current[s]" << setw(10) << "change" << endl;
+    for (const SuiteResult& c : current) {
+        const SuiteResult* base = nullptr;
+        for (const SuiteResult& b : baseline)
+            if (b.kernel == c.kernel && b.n == c.n && b.threads == c.threads) base = &b;
+        cout << left << setw(26) << c.kernel << right << setw(7) << c.n << setw(9) << c.threads;
+        if (!base) {
+            cout << setw(13) << "-" << fixed << setprecision(6) << setw(13) << c.seconds << "  (new)" << endl;
+            continue;
+        }
+        double change = c.seconds / base->seconds - 1.0;
+        bool regressed = change > threshold;
+        regressions += regressed;
+        cout << fixed << setprecision(6) << setw(13) << base->seconds << setw(13) << c.seconds
+             << setprecision(1) << setw(9) << showpos << change * 100 << noshowpos << "%"
+             << (regressed ? "  REGRESSION" : "") << endl;
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "suite") {
+        vector<int> sizes = {256, 512, 1024}, threadCounts;
+        string jsonPath;
+        int reps = 3;
+        for (int i = 2; i + 1 < argc; i += 2) {
+            string flag = argv[i];
+            if (flag == "--sizes") sizes = parseList(argv[i + 1]);
+            else if (flag == "--threads") threadCounts = parseList(argv[i + 1]);
+            else if (flag == "--json") jsonPath = argv[i + 1];
+            else if (flag == "--reps") reps = atoi(argv[i + 1]);
+        }
+        if (threadCounts.empty()) {
+            for (int t = 1; t < getNumThreads(); t *= 2) threadCounts.push_back(t);
+            threadCounts.push_back(getNumThreads());
+        }
+        cout << left << setw(26) << "kernel" << right << setw(7) << "n" << setw(9) << "threads"
+             << setw(13) << "time[s]" << setw(10) << "GFLOP/s" << setw(12) << "bytes/flop" << endl;
+        vector<SuiteResult> results = runSuite(sizes, threadCounts, reps);
+        if (!jsonPath.empty() && !writeSuiteJson(jsonPath, results)) return 1;
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "compare") {
+        if (argc < 4) {
+            cout << "usage: benchmark compare baseline.json current.json [threshold]" << endl;
+            return 1;
+        }
+        vector<SuiteResult> baseline, current;
+        if (!readSuiteJson(argv[2], baseline) || !readSuiteJson(argv[3], current)) return 1;
+        double threshold = argc > 4 ? atof(argv[4]) : 0.10;
+        int regressions = compareSuites(baseline, current, threshold);
+        cout << regressions << " regression(s) beyond " << threshold * 100 << "%" << endl;
+        return regressions > 0 ? 2 : 0;
+    }
+
+    int first = 1;
+    string mode = "layout";
+    if (argc > 1 && (string(argv[1]) == "gemm" || string(argv[1]) == "threads" ||
+                     string(argv[1]) == "sparse" || string(argv[1]) == "krylov" ||
+                     string(argv[1]) == "jacobi" || string(argv[1]) == "io" ||
+                     string(argv[1]) == "expr" || string(argv[1]) == "mixed" ||
+                     string(argv[1]) == "transpose" || string(argv[1]) == "banded" ||
+                     string(argv[1]) == "auto")) {
+        mode = argv[1];
+        first = 2;
+    }
+    vector<int> sizes;
+    for (int i = first; i < argc; i++) sizes.push_back(atoi(argv[i]));
+
+    if (mode == "gemm") {
+        if (sizes.empty()) sizes = {256, 512, 1024, 2048, 4096};
+        gemmSweep(sizes);
+        return 0;
+    }
+    if (mode == "sparse") {
+        sparseSweep(sizes.empty() ? 1000 : sizes[0]);
+        return 0;
+    }
+    if (mode == "io") {
+        if (sizes.empty()) sizes = {1000, 4000};
+        ioSweep(sizes);
+        return 0;
+    }
+    if (mode == "jacobi") {
+        if (sizes.empty()) sizes = {1000, 2000, 4000};
+        jacobiSweep(sizes);
+        return 0;
+    }
+    if (mode == "expr") {
+        if (sizes.empty()) sizes = {512, 1024, 2048};
+        exprSweep(sizes);
+        return 0;
+    }
+    if (mode == "transpose") {
+        if (sizes.empty()) sizes = {1000, 2048, 4000};
+        transposeSweep(sizes);
+        return 0;
+    }
+    if (mode == "banded") {
+        if (sizes.empty()) sizes = {1000, 2000, 4000};
+        bandedSweep(sizes);
+        return 0;
+    }
+    if (mode == "auto") {
+        if (sizes.empty()) sizes = {1000, 2000, 4000};
+        autoSweep(sizes);
+        return 0;
+    }
+    if (mode == "mixed") {
+        if (sizes.empty()) sizes = {1000, 2000, 4000};
+        mixedSweep(sizes);
+        return 0;
+    }
+    if (mode == "krylov") {
+        krylovSweep(sizes.empty() ? 300 : sizes[0]);
+        return 0;
+    }
+    if (mode == "threads") {
+        threadSweep(sizes.empty() ? 2048 : sizes[0]);
+        return 0;
+    }
+    if (sizes.empty()) sizes = {128, 256, 512};
+
+    cout << left << setw(12) << "kernel" << right << setw(7) << "n"
+         << setw(12) << "before[s]" << setw(12) << "after[s]" << setw(10) << "speedup" << endl;
+
+    for (int n : sizes) {
+        Matrix A = makeTestMatrix(n, 1);
+        Matrix B = makeTestMatrix(n, 2);
+        legacy::Grid a = toGrid(A), b = toGrid(B);
+        volatile double sink = 0;
+
+        report("add", n,
+               timeIt([&] { sink = legacy::add(a, b)[0][0]; }),
+               timeIt([&] { sink = Matrix(A + B)(0, 0); }));
+        report("transpose", n,
+               timeIt([&] { sink = legacy::transpose(a)[0][0]; }),
+               timeIt([&] { sink = Matrix(A.transpose())(0, 0); }));
+        report("multiply", n,
+               timeIt([&] { sink = legacy::multiply(a, b)[0][0]; }, 1),
+               timeIt([&] { sink = Matrix(A * B)(0, 0); }, 1));
+        report("doolittle", n,
+               timeIt([&] { sink = legacy::doolittleTrace(a); }, 1),
+               timeIt([&] { sink = A.luDecompositionDoolittle().second(n - 1, n - 1); }, 1));
+        // The structure checks of a session: the menu's, then a Cholesky
+        // and a Jacobi solve's. set() drops the cached analysis each round.
+        Matrix S(A + A.transpose());
+        legacy::Grid s = toGrid(S);
+        report("checks x3", n,
+               timeIt([&] {
+                   for (int k = 0; k < 3; k++) sink = legacy::isSymmetric(s) + legacy::isDiagonallyDominant(s);
+               }),
+               timeIt([&] {
+                   S.set(0, 0, S.get(0, 0));
+                   for (int k = 0; k < 3; k++) sink = S.isSymmetric() + S.isDiagonallyDominant();
+               }));
+        (void)sink;
+    }
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include "cholesky.hpp"
+#include "gemm.hpp"
+#include "threadpool.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+typedef CholeskyFactorization CF;
+
+// In-place Cholesky of one lower tile. Returns false when a pivot is not
+// positive. The strictly upper part is cleared.
+bool factorTile(double* a) {
+    const int nb = CF::NB;
+    for (int j = 0; j < nb; j++) {
+        double* rowJ = a + (size_t)j * nb;
+        double d = rowJ[j];
+        for (int p = 0; p < j; p++) {
+            d -= rowJ[p] * rowJ[p];
+        }
+        if (d <= 0) {
+            return false;
+        }
+        d = sqrt(d);
+        rowJ[j] = d;
+        for (int i = j + 1; i < nb; i++) {
+            double* rowI = a + (size_t)i * nb;
+            double s = rowI[j];
+            for (int p = 0; p < j; p++) {
+                s -= rowI[p] * rowJ[p];
+            }
+            rowI[j] = s / d;
+        }
+        for (int c = j + 1; c < nb; c++) {
+            rowJ[c] = 0.0;
+        }
+    }
+    return true;
+}
+
+// Row blocks of the SYRK update of a diagonal tile
+const int syrkBlock = 32;
+static_assert(CF::NB % syrkBlock == 0, "SYRK row blocks must tile NB");
+
+// C -= A A^T on the lower triangle of diagonal tile C (SYRK): each block
+// of syrkBlock rows is one GEMM over the columns up to the end of its
+// diagonal block, so about 5/8 of a full tile update's flops with NB = 128.
+// The little of the upper triangle that also gets written is scratch,
+// which factorTile clears.
+void syrkTile(const double* A, double* C) {
+    const int nb = CF::NB;
+    for (int r = 0; r < nb; r += syrkBlock) {
+        gemm(false, true, syrkBlock, r + syrkBlock, nb, -1.0, A + (size_t)r * nb, nb, A, nb, 1.0,
+             C + (size_t)r * nb, nb);
+    }
+}
+
+// X = X * L^-T for one tile, i.e. solve X L^T = A row by row.
+void solveTile(const double* L, double* x) {
+    const int nb = CF::NB;
+    for (int r = 0; r < nb; r++) {
+        double* xr = x + (size_t)r * nb;
+        for (int j = 0; j < nb; j++) {
+            const double* lj = L + (size_t)j * nb;
+            double s = xr[j];
+            for (int p = 0; p < j; p++) {
+                s -= xr[p] * lj[p];
+            }
+            xr[j] = s / lj[j];
+        }
+    }
+}
+
+}
+
+CholeskyFactorization::CholeskyFactorization()
+    : n(0), tilesPerSide(0), positiveDefinite(false),
+      failure(StatusCode::InvalidArgument, "Nothing has been factored") {}
+
+CholeskyFactorization::CholeskyFactorization(const Matrix& A, bool checkSymmetry)
+    : n(0), tilesPerSide(0), positiveDefinite(false) {
+    if (A.getRows() != A.getCols()) {
+        failure = Status(StatusCode::NotSquare, "Matrix must be square for Cholesky decomposition");
+        return;
+    }
+    if (checkSymmetry && !A.isSymmetric()) {
+        failure = Status(StatusCode::NotSymmetric, "Matrix must be symmetric for Cholesky decomposition");
+        return;
+    }
+
+    n = A.getRows();
+    tilesPerSide = (n + NB - 1) / NB;
+    size_t tileCount = (size_t)tilesPerSide * (tilesPerSide + 1) / 2;
+    tiles.resize(tileCount * NB * NB);
+
+    // Copy the lower triangle in, padding the ragged edge with the identity
+    parallelTiles(tilesPerSide, tilesPerSide, 1, 1, [&](int I, int, int J, int) {
+        if (J > I) {
+            return;
+        }
+        double* t = tile(I, J);
+        for (int r = 0; r < NB; r++) {
+            int i = I * NB + r;
+            for (int c = 0; c < NB; c++) {
+                int j = J * NB + c;
+                if (i < n && j < n) {
+                    t[r * NB + c] = A(i, j);
+                } else {
+                    t[r * NB + c] = (i == j) ? 1.0 : 0.0;
+                }
+            }
+        }
+    });
+
+    factor();
+    if (!positiveDefinite) {
+        failure = Status(StatusCode::NotPositiveDefinite, "Matrix is not positive definite");
+    }
+}
+
+double* CholeskyFactorization::tile(int I, int J) {
+    return tiles.data() + ((size_t)I * (I + 1) / 2 + J) * NB * NB;
+}
+
+const double* CholeskyFactorization::tile(int I, int J) const {
+    return tiles.data() + ((size_t)I * (I + 1) / 2 + J) * NB * NB;
+}
+
+void CholeskyFactorization::factor() {
+    int nt = tilesPerSide;
+    ThreadPool& pool = ThreadPool::instance();
+    vector<pair<int, int>> updates;
+
+    TELEMETRY_SCOPE("cholesky.factor");
+    TelemetryPhase diagonal("cholesky.diagonal_tile");
+    TelemetryPhase panel("cholesky.panel_solve");
+    TelemetryPhase update("cholesky.trailing_update");
+
+    for (int k = 0; k < nt; k++) {
+        diagonal.begin();
+        bool positive = factorTile(tile(k, k));
+        diagonal.end();
+        if (!positive) {
+            positiveDefinite = false;
+            return;
+        }
+
+        const double* Lkk = tile(k, k);
+        panel.begin();
+        pool.run(nt - k - 1, [&](int t) {
+            solveTile(Lkk, tile(k + 1 + t, k));
+        });
+        panel.end();
+
+        // Trailing update A(i, j) -= L(i, k) L(j, k)^T for k < j <= i, one
+        // task per tile (SYRK on the diagonal, GEMM elsewhere)
+        updates.clear();
+        for (int i = k + 1; i < nt; i++) {
+            for (int j = k + 1; j <= i; j++) {
+                updates.push_back(make_pair(i, j));
+            }
+        }
+        update.begin();
+        pool.run((int)updates.size(), [&](int t) {
+            int i = updates[t].first;
+            int j = updates[t].second;
+            if (i == j) {
+                syrkTile(tile(i, k), tile(i, i));
+            } else {
+                gemm(false, true, NB, NB, NB, -1.0, tile(i, k), NB, tile(j, k), NB, 1.0, tile(i, j), NB);
+            }
+        });
+        update.end();
+    }
+    positiveDefinite = true;
+}
+
+double CholeskyFactorization::get(int i, int j) const {
+    if (j > i) {
+        return 0.0;
+    }
+    return tile(i / NB, j / NB)[(i % NB) * NB + (j % NB)];
+}
+
+Matrix CholeskyFactorization::lower() const {
+    if (!positiveDefinite) {
+        return Matrix();
+    }
+    Matrix L(n, n);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j <= i; j++) {
+            L(i, j) = get(i, j);
+        }
+    }
+    return L;
+}
+
+// Solve L L^T x = b in place on a vector padded to a whole number of tiles
+void CholeskyFactorization::solveColumn(double* x) const {
+    int nt = tilesPerSide;
+
+    // L y = b
+    for (int I = 0; I < nt; I++) {
+        double* xi = x + (size_t)I * NB;
+        for (int J = 0; J < I; J++) {
+            const double* t = tile(I, J);
+            const double* xj = x + (size_t)J * NB;
+            for (int r = 0; r < NB; r++) {
+                double s = 0.0;
+                for (int c = 0; c < NB; c++) {
+                    s += t[r * NB + c] * xj[c];
+                }
+                xi[r] -= s;
+            }
+        }
+        const double* d = tile(I, I);
+        for (int r = 0; r < NB; r++) {
+            double s = xi[r];
+            for (int c = 0; c < r; c++) {
+                s -= d[r * NB + c] * xi[c];
+            }
+            xi[r] = s / d[r * NB + r];
+        }
+    }
+
+    // L^T x = y
+    for (int I = nt - 1; I >= 0; I--) {
+        double* xi = x + (size_t)I * NB;
+        for (int J = I + 1; J < nt; J++) {
+            const double* t = tile(J, I);
+            const double* xj = x + (size_t)J * NB;
+            for (int r = 0; r < NB; r++) {
+                const double* row = t + r * NB;
+                for (int c = 0; c < NB; c++) {
+                    xi[c] -= row[c] * xj[r];
+                }
+            }
+        }
+        const double* d = tile(I, I);
+        for (int r = NB - 1; r >= 0; r--) {
+            xi[r] /= d[r * NB + r];
+            for (int c = 0; c < r; c++) {
+                xi[c] -= d[r * NB + c] * xi[r];
+            }
+        }
+    }
+}
+
+vector<double> CholeskyFactorization::solve(const vector<double>& b) const {
+    return trySolveMany(b, 1).value();
+}
+
+Result<vector<double>> CholeskyFactorization::trySolve(const vector<double>& b) const {
+    return trySolveMany(b, 1);
+}
+
+vector<double> CholeskyFactorization::solveMany(const vector<double>& B, int nrhs) const {
+    return trySolveMany(B, nrhs).value();
+}
+
+Result<vector<double>> CholeskyFactorization::trySolveMany(const vector<double>& B, int nrhs) const {
+    if (!positiveDefinite) {
+        return failure;
+    }
+    if (nrhs < 0 || B.size() != (size_t)n * nrhs) {
+        return Result<vector<double>>(StatusCode::DimensionMismatch, "Dimensions mismatch in Cholesky solver");
+    }
+
+    TELEMETRY_SCOPE("cholesky.solve");
+    vector<double> X(B.size());
+    ThreadPool::instance().run(nrhs, [&](int r) {
+        vector<double> x((size_t)tilesPerSide * NB, 0.0);
+        copy(B.begin() + (size_t)r * n, B.begin() + (size_t)(r + 1) * n, x.begin());
+        solveColumn(x.data());
+        copy(x.begin(), x.begin() + n, X.begin() + (size_t)r * n);
+    });
+    return X;
+}
+
+double CholeskyFactorization::determinant() const {
+    double det = 1.0;
+    for (int i = 0; i < n; i++) {
+        double d = get(i, i);
+        det *= d * d;
+    }
+    return det;
+}
@@ -0,0 +1,53 @@
+#ifndef CHOLESKY_HPP
+#define CHOLESKY_HPP
+#include "matrix.hpp"
+
+// A = L L^T for a symmetric positive definite A.
+//
+// Only the lower triangle of L is kept, as NB x NB tiles (I >= J) that are
+// each contiguous, so the factor takes about half the memory of a dense
+// n x n matrix. The last tile row/column is padded with the identity, which
+// leaves the factorization of the real part untouched.
+//
+// The factorization is right-looking over tiles: factor the diagonal tile,
+// solve the tile column below it, then apply the SYRK/GEMM update to every
+// trailing tile. Each step's tiles are independent and run in parallel.
+class CholeskyFactorization {
+private:
+    int n;
+    int tilesPerSide;
+    vector<double, AlignedAllocator<double>> tiles;
+    bool positiveDefinite;
+    Status failure;  // why there is no factor
+
+    double* tile(int I, int J);
+    const double* tile(int I, int J) const;
+    void factor();
+    void solveColumn(double* x) const;
+
+public:
+    static const int NB = 128;
+
+    CholeskyFactorization();
+    // checkSymmetry = false skips the O(n^2) symmetry scan when the caller
+    // already knows A is symmetric; only the lower triangle is read.
+    explicit CholeskyFactorization(const Matrix& A, bool checkSymmetry = true);
+
+    int size() const { return n; }
+    bool isPositiveDefinite() const { return positiveDefinite; }
+    const Status& status() const { return failure; }
+
+    double get(int i, int j) const;  // L(i, j), zero above the diagonal
+    Matrix lower() const;
+
+    // Empty results when there is no factor or the sizes do not match
+    vector<double> solve(const vector<double>& b) const;
+    Result<vector<double>> trySolve(const vector<double>& b) const;
+    // nrhs right-hand sides stored column-major, solved in parallel
+    vector<double> solveMany(const vector<double>& B, int nrhs) const;
+    Result<vector<double>> trySolveMany(const vector<double>& B, int nrhs) const;
+
+    double determinant() const;
+};
+
+#endif
@@ -0,0 +1,573 @@
+#include "cli.hpp"
+#include "matrix.hpp"
+#include "lu.hpp"
+#include "cholesky.hpp"
+#include "sparse.hpp"
+#include "krylov.hpp"
+#include "solver.hpp"
+#include "gemm.hpp"
+#include "textio.hpp"
+#include "threadpool.hpp"
+#include "telemetry.hpp"
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <tuple>
+#include <chrono>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+namespace {
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+string formatNumber(double v) {
+    char buf[32];
+    to_chars_result r = to_chars(buf, buf + sizeof(buf), v);
+    return string(buf, r.ptr);
+}
+
+// One JSON object, fields in insertion order
+class JsonLine {
+private:
+    string text;
+
+    void key(const string& k) {
+        text += text.empty() ? "{" : ", ";
+        text += quote(k) + ": ";
+    }
+
+public:
+    static string quote(const string& s) {
+        string q = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                q += '\\';
+                q += c;
+            } else if ((unsigned char)c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                q += buf;
+            } else {
+                q += c;
+            }
+        }
+        return q + "\"";
+    }
+
+    JsonLine& field(const string& k, const string& v) { key(k); text += quote(v); return *this; }
+    JsonLine& field(const string& k, const char* v) { return field(k, string(v)); }
+    JsonLine& field(const string& k, long long v) { key(k); text += to_string(v); return *this; }
+    JsonLine& field(const string& k, int v) { return field(k, (long long)v); }
+    JsonLine& field(const string& k, bool v) { key(k); text += v ? "true" : "false"; return *this; }
+    // JSON has no inf or nan; those become null
+    JsonLine& field(const string& k, double v) {
+        key(k);
+        text += isfinite(v) ? formatNumber(v) : "null";
+        return *this;
+    }
+
+    string str() const { return text.empty() ? "{}" : text + "}"; }
+};
+
+struct Arguments {
+    string command;
+    map<string, string> values;
+    vector<string> flags;  // options without a value
+
+    bool has(const string& name) const {
+        return values.count(name) || find(flags.begin(), flags.end(), name) != flags.end();
+    }
+    string get(const string& name, const string& fallback = "") const {
+        auto it = values.find(name);
+        return it == values.end() ? fallback : it->second;
+    }
+};
+
+// Options that never take a value
+bool isSwitch(const string& name) {
+    return name == "sparse" || name == "help";
+}
+
+bool parseArguments(int argc, char* argv[], Arguments& args, string& error) {
+    for (int k = 1; k < argc; k++) {
+        string arg = argv[k];
+        if (arg.compare(0, 2, "--") != 0) {
+            if (!args.command.empty()) {
+                error = "unexpected argument '" + arg + "'";
+                return false;
+            }
+            args.command = arg;
+            continue;
+        }
+        string name = arg.substr(2);
+        size_t eq = name.find('=');
+        if (eq != string::npos) {
+            args.values[name.substr(0, eq)] = name.substr(eq + 1);
+        } else if (isSwitch(name)) {
+            args.flags.push_back(name);
+        } else if (k + 1 < argc) {
+            args.values[name] = argv[++k];
+        } else {
+            error = "missing value for --" + name;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseInt(const string& s, int& v) {
+    from_chars_result r = from_chars(s.data(), s.data() + s.size(), v);
+    return r.ec == errc() && r.ptr == s.data() + s.size();
+}
+
+bool parseDouble(const string& s, double& v) {
+    from_chars_result r = from_chars(s.data(), s.data() + s.size(), v);
+    return r.ec == errc() && r.ptr == s.data() + s.size();
+}
+
+bool endsWith(const string& s, const string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// NAME, NAME.txt or NAME.bin; a bare NAME prefers NAME.bin
+bool loadMatrix(const string& name, Matrix& A, string& error) {
+    string stem = name;
+    bool binary = false;
+    if (endsWith(name, ".bin")) {
+        stem = name.substr(0, name.size() - 4);
+        binary = true;
+    } else if (endsWith(name, ".txt")) {
+        stem = name.substr(0, name.size() - 4);
+    } else {
+        binary = (bool)ifstream(stem + ".bin");
+    }
+
+    if (binary) {
+        Result<Matrix> mapped = Matrix::tryMapBinary(stem);
+        if (!mapped) {
+            error = stem + ".bin: " + mapped.status().message();
+            return false;
+        }
+        A = move(*mapped);
+        return true;
+    }
+    TextParseError parseError;
+    if (!parseMatrixText(stem + ".txt", A, parseError)) {
+        error = describe(stem + ".txt", parseError);
+        return false;
+    }
+    return true;
+}
+
+bool loadVector(const string& name, vector<double>& v, string& error) {
+    string path = endsWith(name, ".txt") ? name : name + ".txt";
+    TextParseError parseError;
+    if (!parseVectorText(path, v, parseError)) {
+        error = describe(path, parseError);
+        return false;
+    }
+    return true;
+}
+
+bool writeVector(const vector<double>& v, const string& name) {
+    ofstream out(name + ".txt", ios::binary);
+    if (!out) {
+        return false;
+    }
+    string text = to_string(v.size()) + "\n";
+    for (double val : v) {
+        text += formatNumber(val) + "\n";
+    }
+    out.write(text.data(), (streamsize)text.size());
+    return (bool)out;
+}
+
+// ||b - A x||_2, with per-tile partial sums added in a fixed order
+double residualNorm(const Matrix& A, const vector<double>& x, const vector<double>& b) {
+    const int tile = 64;
+    int n = A.getRows();
+    vector<double> partial((n + tile - 1) / tile, 0.0);
+    parallelTiles(n, A.getCols(), tile, max(A.getCols(), 1), [&](int i0, int i1, int, int) {
+        double s = 0.0;
+        for (int i = i0; i < i1; i++) {
+            double r = b[i] - dotProduct(A.raw() + (size_t)i * A.stride(), x.data(), A.getCols());
+            s += r * r;
+        }
+        partial[i0 / tile] = s;
+    });
+    double sum = 0.0;
+    for (double p : partial) {
+        sum += p;
+    }
+    return sqrt(sum);
+}
+
+double vectorNorm(const vector<double>& v) {
+    double s = 0.0;
+    for (double e : v) {
+        s += e * e;
+    }
+    return sqrt(s);
+}
+
+// Shared tail of every command: the result line, and the exit code
+int finish(ostream& out, JsonLine& line, const string& error) {
+    if (!error.empty()) {
+        line.field("status", "error").field("message", error);
+    } else {
+        line.field("status", "ok");
+    }
+    out << line.str() << endl;
+    return error.empty() ? 0 : 1;
+}
+
+// Same, for a library failure, whose code goes in the line too
+int finish(ostream& out, JsonLine& line, const Status& failure) {
+    if (!failure) {
+        line.field("code", statusCodeName(failure.code()));
+    }
+    return finish(out, line, failure.message());
+}
+
+// Take the solution out of a solver's result, or the reason there is none
+Status takeSolution(Result<vector<double>> result, vector<double>& x) {
+    if (result) {
+        x = move(*result);
+    }
+    return result.status();
+}
+
+Status takeSolution(Result<IterativeResult> result, JsonLine& line, vector<double>& x) {
+    if (result) {
+        line.field("iterations", result->iterations).field("converged", result->converged);
+        x = move(result->x);
+    }
+    return result.status();
+}
+
+int multiplyCommand(const Arguments& args, ostream& out, JsonLine& line) {
+    Matrix A, B;
+    string error;
+    auto start = chrono::steady_clock::now();
+    if (!loadMatrix(args.get("a"), A, error) || !loadMatrix(args.get("b"), B, error)) {
+        return finish(out, line, error);
+    }
+    line.field("load_seconds", secondsSince(start));
+    if (A.getCols() != B.getRows()) {
+        return finish(out, line, "A.cols != B.rows");
+    }
+    line.field("rows", A.getRows()).field("inner", A.getCols()).field("cols", B.getCols());
+
+    start = chrono::steady_clock::now();
+    Matrix C = A * B;
+    double seconds = secondsSince(start);
+    line.field("seconds", seconds)
+        .field("gflops", 2.0 * A.getRows() * A.getCols() * B.getCols() / seconds * 1e-9);
+
+    if (args.has("out")) {
+        string format = args.get("format", "text");
+        Status written;
+        if (format == "binary") {
+            written = C.saveBinary(args.get("out"));
+        } else if (format == "text") {
+            written = C.writeToFile(args.get("out"));
+        } else {
+            return finish(out, line, "unknown format '" + format + "'");
+        }
+        if (!written) {
+            return finish(out, line, written);
+        }
+        line.field("output", args.get("out"));
+    }
+    return finish(out, line, "");
+}
+
+int solveCommand(const Arguments& args, ostream& out, JsonLine& line) {
+    string method = args.get("method", "lu");
+    line.field("method", method);
+
+    int maxIterations = 1000, restart = 30;
+    double tolerance = 1e-8, omega = 1.5;
+    if ((args.has("max-iter") && !parseInt(args.get("max-iter"), maxIterations)) ||
+        (args.has("restart") && !parseInt(args.get("restart"), restart)) ||
+        (args.has("tol") && !parseDouble(args.get("tol"), tolerance)) ||
+        (args.has("omega") && !parseDouble(args.get("omega"), omega))) {
+        return finish(out, line, "invalid numeric option");
+    }
+    // What Seidel, SOR and SSOR stop on
+    string stop = args.get("stop", "change");
+    if (stop != "change" && stop != "residual") {
+        return finish(out, line, "--stop must be change or residual");
+    }
+    Convergence criterion = stop == "residual" ? Convergence::RelativeResidual : Convergence::MaxChange;
+
+    Matrix A;
+    vector<double> b, expected;
+    string error;
+    auto start = chrono::steady_clock::now();
+    if (!loadMatrix(args.get("a"), A, error) || !loadVector(args.get("rhs"), b, error) ||
+        (args.has("expect") && !loadVector(args.get("expect"), expected, error))) {
+        return finish(out, line, error);
+    }
+    line.field("load_seconds", secondsSince(start));
+
+    int n = A.getRows();
+    line.field("n", n);
+    if (A.getCols() != n) {
+        return finish(out, line, "matrix must be square");
+    }
+    if ((int)b.size() != n || (!expected.empty() && (int)expected.size() != n)) {
+        return finish(out, line, "vector size does not match the matrix");
+    }
+
+    vector<double> x;
+    Status solved;
+    start = chrono::steady_clock::now();
+    if (method == "lu") {
+        Result<LUFactorization> lu = A.tryLuFactorize();
+        line.field("factor_seconds", secondsSince(start));
+        if (!lu) {
+            return finish(out, line, lu.status());
+        }
+        start = chrono::steady_clock::now();
+        solved = takeSolution(lu->trySolve(b), x);
+    } else if (method == "cholesky") {
+        Result<CholeskyFactorization> chol = A.tryCholeskyFactorize();
+        line.field("factor_seconds", secondsSince(start));
+        if (!chol) {
+            return finish(out, line, chol.status());
+        }
+        start = chrono::steady_clock::now();
+        solved = takeSolution(chol->trySolve(b), x);
+    } else if (method == "gauss") {
+        solved = takeSolution(A.tryGaussianElimination(b), x);
+    } else if (method == "auto") {
+        // solver.hpp picks the backend; --tol and --max-iter only bound its
+        // iterative ones
+        SolveOptions options;
+        options.tolerance = args.has("tol") ? tolerance : options.tolerance;
+        options.maxIterations = maxIterations;
+        Result<SolveReport> report = solve(A, b, options);
+        if (report) {
+            string path;
+            for (const SolveAttempt& attempt : report->attempts) {
+                path += string(path.empty() ? "" : ",") + solveMethodName(attempt.method);
+            }
+            line.field("chosen", solveMethodName(report->method()))
+                .field("reason", report->attempts.back().reason)
+                .field("path", path);
+            x = move(report->x);
+        }
+        solved = report.status();
+    } else if (method == "jacobi") {
+        solved = takeSolution(A.tryGaussJacobi(b, maxIterations, tolerance), line, x);
+    } else if (method == "seidel") {
+        solved = takeSolution(A.tryGaussSeidel(b, maxIterations, tolerance, criterion), line, x);
+    } else if (method == "sor") {
+        solved = takeSolution(A.trySor(b, omega, maxIterations, tolerance, criterion), line, x);
+    } else if (method == "ssor") {
+        solved = takeSolution(A.trySsor(b, omega, maxIterations, tolerance, criterion), line, x);
+    } else if (method == "mixed") {
+        // Its own defaults: a few refinement steps, to double accuracy
+        solved = takeSolution(A.tryMixedPrecisionSolve(b, args.has("max-iter") ? maxIterations : 30,
+                                                       args.has("tol") ? tolerance : 1e-14),
+                              line, x);
+    } else if (method == "cg" || method == "bicgstab" || method == "gmres") {
+        // Straight to krylov.hpp, to choose the operator
+        SparseMatrix S;
+        unique_ptr<LinearOperator> op;
+        unique_ptr<JacobiPreconditioner> M;
+        if (args.has("sparse")) {
+            S = SparseMatrix::fromDense(A);
+            op.reset(new SparseOperator(S));
+            M.reset(new JacobiPreconditioner(S));
+        } else {
+            op.reset(new DenseOperator(A));
+            M.reset(new JacobiPreconditioner(A));
+        }
+        if (method == "cg") {
+            solved = takeSolution(conjugateGradient(*op, b, M.get(), maxIterations, tolerance), line, x);
+        } else if (method == "bicgstab") {
+            solved = takeSolution(biCGSTAB(*op, b, M.get(), maxIterations, tolerance), line, x);
+        } else {
+            solved = takeSolution(gmres(*op, b, M.get(), restart, maxIterations, tolerance), line, x);
+        }
+    } else {
+        return finish(out, line, "unknown method '" + method + "'");
+    }
+    line.field("solve_seconds", secondsSince(start));
+    if (!solved) {
+        return finish(out, line, solved);
+    }
+
+    double r = residualNorm(A, x, b);
+    double bNorm = vectorNorm(b);
+    line.field("residual", r).field("relative_residual", bNorm > 0 ? r / bNorm : r);
+    if (!expected.empty()) {
+        double maxError = 0.0;
+        for (int i = 0; i < n; i++) {
+            maxError = max(maxError, fabs(x[i] - expected[i]));
+        }
+        line.field("max_error", maxError);
+    }
+    if (args.has("out")) {
+        if (!writeVector(x, args.get("out"))) {
+            return finish(out, line, "cannot write " + args.get("out") + ".txt");
+        }
+        line.field("output", args.get("out"));
+    }
+    return finish(out, line, "");
+}
+
+int factorCommand(const Arguments& args, ostream& out, JsonLine& line) {
+    string method = args.get("method", "lu");
+    line.field("method", method);
+
+    Matrix A;
+    string error;
+    auto start = chrono::steady_clock::now();
+    if (!loadMatrix(args.get("a"), A, error)) {
+        return finish(out, line, error);
+    }
+    line.field("load_seconds", secondsSince(start)).field("n", A.getRows());
+    if (A.getRows() != A.getCols()) {
+        return finish(out, line, "matrix must be square");
+    }
+
+    Matrix L, U;
+    // Row interchanges of the pivoted LU, written as a vector file
+    vector<double> pivots;
+    start = chrono::steady_clock::now();
+    if (method == "lu") {
+        LUFactorization lu = A.luFactorize();
+        line.field("seconds", secondsSince(start))
+            .field("singular", lu.isSingular())
+            .field("determinant", lu.determinant());
+        if (args.has("out")) {
+            L = lu.lower();
+            U = lu.upper();
+            pivots.assign(lu.pivotVector().begin(), lu.pivotVector().end());
+        }
+    } else if (method == "cholesky") {
+        CholeskyFactorization chol = A.choleskyFactorize();
+        line.field("seconds", secondsSince(start)).field("positive_definite", chol.isPositiveDefinite());
+        if (!chol.isPositiveDefinite()) {
+            return finish(out, line, chol.status());
+        }
+        line.field("determinant", chol.determinant());
+        if (args.has("out")) {
+            L = chol.lower();
+        }
+    } else if (method == "doolittle" || method == "crout") {
+        Result<pair<Matrix, Matrix>> LU =
+            method == "doolittle" ? A.tryLuDecompositionDoolittle() : A.tryLuDecompositionCrout();
+        line.field("seconds", secondsSince(start));
+        if (!LU) {
+            return finish(out, line, LU.status());
+        }
+        tie(L, U) = move(*LU);
+    } else {
+        return finish(out, line, "unknown method '" + method + "'");
+    }
+
+    if (args.has("out")) {
+        Status written = L.writeToFile(args.get("out") + "_L");
+        if (written && U.getRows() > 0) {
+            written = U.writeToFile(args.get("out") + "_U");
+        }
+        if (!written) {
+            return finish(out, line, written);
+        }
+        if (!pivots.empty() && !writeVector(pivots, args.get("out") + "_P")) {
+            return finish(out, line, "cannot write " + args.get("out") + "_P.txt");
+        }
+        line.field("output", args.get("out"));
+    }
+    return finish(out, line, "");
+}
+
+int determinantCommand(const Arguments& args, ostream& out, JsonLine& line) {
+    Matrix A;
+    string error;
+    auto start = chrono::steady_clock::now();
+    if (!loadMatrix(args.get("a"), A, error)) {
+        return finish(out, line, error);
+    }
+    line.field("load_seconds", secondsSince(start)).field("n", A.getRows());
+    if (A.getRows() != A.getCols()) {
+        return finish(out, line, "matrix must be square");
+    }
+    start = chrono::steady_clock::now();
+    LUFactorization lu = A.luFactorize();
+    line.field("seconds", secondsSince(start)).field("determinant", lu.determinant());
+    // The determinant itself over- or underflows long before n gets large
+    double logAbs = 0.0;
+    for (int i = 0; i < lu.size(); i++) {
+        logAbs += log(fabs(lu.packed()(i, i)));
+    }
+    line.field("log_abs_determinant", logAbs);
+    return finish(out, line, "");
+}
+
+}
+
+int runCli(int argc, char* argv[]) {
+    ostream& out = cout;
+
+    Arguments args;
+    string error;
+    JsonLine line;
+    if (!parseArguments(argc, argv, args, error)) {
+        return finish(out, line, error);
+    }
+    line.field("command", args.command);
+    if (args.has("help") || args.command.empty()) {
+        cerr << "usage: " << argv[0] << " multiply|solve|factor|det [options], see cli.hpp" << endl;
+        return args.command.empty() ? finish(out, line, "no command given") : 0;
+    }
+
+    if (args.has("threads")) {
+        int threads;
+        if (!parseInt(args.get("threads"), threads) || threads < 1) {
+            return finish(out, line, "invalid thread count");
+        }
+        setNumThreads(threads);
+    }
+    line.field("threads", getNumThreads());
+    if (args.command != "multiply" && args.command != "solve" && args.command != "factor" &&
+        args.command != "det") {
+        return finish(out, line, "unknown command");
+    }
+    if (!args.has("a") || (args.command == "multiply" && !args.has("b")) ||
+        (args.command == "solve" && !args.has("rhs"))) {
+        return finish(out, line, "missing input (--a, --b or --rhs)");
+    }
+
+    if (args.has("telemetry") && !telemetryEnabled) {
+        return finish(out, line, "built without MATRIX_TELEMETRY");
+    }
+
+    int status;
+    if (args.command == "multiply") {
+        status = multiplyCommand(args, out, line);
+    } else if (args.command == "solve") {
+        status = solveCommand(args, out, line);
+    } else if (args.command == "factor") {
+        status = factorCommand(args, out, line);
+    } else {
+        status = determinantCommand(args, out, line);
+    }
+    if (args.has("telemetry") && !writeTelemetry(args.get("telemetry"))) {
+        cerr << "Error writing " << args.get("telemetry") << endl;
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,30 @@
+#ifndef CLI_HPP
+#define CLI_HPP
+
+// Non-interactive driver, used by main() whenever it is given arguments:
+//
+//   matrix multiply --a A --b B [--out C] [--format text|binary]
+//   matrix solve    --a A --rhs b --method=lu|auto|gauss|mixed|cholesky|jacobi|seidel|sor|ssor|cg|bicgstab|gmres
+//                   [--tol T] [--max-iter N] [--omega W] [--stop change|residual] [--restart M] [--sparse]
+//                   [--expect x] [--out x]
+//   matrix factor   --a A --method=lu|doolittle|crout|cholesky [--out prefix]
+//   matrix det      --a A
+//
+// Every command also takes --threads N, and --telemetry FILE (.json or
+// .csv) in builds with MATRIX_TELEMETRY, to dump the recorded events.
+// Matrices are named as in the menu: A means A.bin (mapped) when it
+// exists, otherwise A.txt; vectors are text files. Flags are written
+// --name value or --name=value. factor --out writes prefix_L and prefix_U,
+// and for lu also the vector prefix_P.txt: the row swapped with row i at
+// step i. --stop picks what seidel, sor and ssor stop on: the largest change
+// of an entry (the default) or the relative residual.
+//
+// Each command prints exactly one JSON object on one line to stdout, with
+// "status": "ok" or "error" (and a "message", plus the library's status
+// "code" when the library refused), the timings in seconds and, for solves,
+// the residual and, for iterative methods, the iteration count. --method=auto
+// adds the backend solver.hpp settled on, why, and every one it tried. The exit
+// code is 0 on success.
+int runCli(int argc, char* argv[]);
+
+#endif
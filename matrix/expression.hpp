@@ -0,0 +1,503 @@
+#ifndef EXPRESSION_HPP
+#define EXPRESSION_HPP
+// Lazy Matrix arithmetic; included at the end of matrix.hpp.
+//
+// A + B - 2.0 * C builds a small tree of nodes and nothing is computed
+// until it is assigned to a Matrix, which then evaluates it in one parallel
+// pass with no intermediate matrices. A product stays a product: A * B + C
+// is one GEMM accumulating onto C, and D += A * B is one GEMM accumulating
+// onto D. A.transpose() is a view: in a product GEMM reads A as transposed,
+// and on its own it is copied out block by block. Anything else involving a
+// product (a product of sums, A * B * C) is evaluated eagerly.
+//
+// Nodes refer to their operands, so they must not outlive the statement
+// that builds them: assign them to a Matrix, never to auto.
+#include <type_traits>
+#include "threadpool.hpp"
+
+// Elementwise expressions: rows(), cols() and entry (i, j) through
+// operator(). Shapes that do not match make an empty expression, in the
+// same way a mismatch has always given an empty Matrix.
+template<typename E>
+class MatrixExpr {
+public:
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+class MatrixRef : public MatrixExpr<MatrixRef> {
+private:
+    const Matrix& m;
+    const double* p;
+    int ld;
+
+public:
+    explicit MatrixRef(const Matrix& mat) : m(mat), p(mat.raw()), ld(mat.stride()) {}
+
+    const Matrix& matrix() const { return m; }
+    int rows() const { return m.getRows(); }
+    int cols() const { return m.getCols(); }
+    double operator()(int i, int j) const { return p[(size_t)i * ld + j]; }
+    // Whether entry (i, j) depends on anything of dest but its entry (i, j),
+    // in which case dest cannot be evaluated in place
+    bool readsTransposed(const Matrix&) const { return false; }
+};
+
+// A^T, read in place
+class TransposeExpr : public MatrixExpr<TransposeExpr> {
+private:
+    const Matrix& m;
+    const double* p;
+    int ld;
+
+public:
+    explicit TransposeExpr(const Matrix& mat) : m(mat), p(mat.raw()), ld(mat.stride()) {}
+
+    const Matrix& matrix() const { return m; }
+    int rows() const { return m.getCols(); }
+    int cols() const { return m.getRows(); }
+    double operator()(int i, int j) const { return p[(size_t)j * ld + i]; }
+    bool readsTransposed(const Matrix& dest) const { return &m == &dest; }
+};
+
+inline TransposeExpr Matrix::transpose() const {
+    return TransposeExpr(*this);
+}
+
+struct AddOp {
+    static double apply(double a, double b) { return a + b; }
+};
+
+struct SubtractOp {
+    static double apply(double a, double b) { return a - b; }
+};
+
+template<typename L, typename R, typename Op>
+class ElementwiseExpr : public MatrixExpr<ElementwiseExpr<L, R, Op>> {
+private:
+    L l;
+    R r;
+    int nr, nc;
+
+public:
+    ElementwiseExpr(const L& a, const R& b) : l(a), r(b) {
+        bool same = a.rows() == b.rows() && a.cols() == b.cols();
+        nr = same ? a.rows() : 0;
+        nc = same ? a.cols() : 0;
+    }
+
+    int rows() const { return nr; }
+    int cols() const { return nc; }
+    double operator()(int i, int j) const { return Op::apply(l(i, j), r(i, j)); }
+    bool readsTransposed(const Matrix& dest) const { return l.readsTransposed(dest) || r.readsTransposed(dest); }
+};
+
+template<typename E>
+class ScaledExpr : public MatrixExpr<ScaledExpr<E>> {
+private:
+    E e;
+    double alpha;
+
+public:
+    ScaledExpr(const E& x, double a) : e(x), alpha(a) {}
+
+    const E& operand() const { return e; }
+    double scale() const { return alpha; }
+    int rows() const { return e.rows(); }
+    int cols() const { return e.cols(); }
+    double operator()(int i, int j) const { return alpha * e(i, j); }
+    bool readsTransposed(const Matrix& dest) const { return e.readsTransposed(dest); }
+};
+
+// The elementwise node standing for a Matrix or an expression
+inline MatrixRef exprOperand(const Matrix& m) {
+    return MatrixRef(m);
+}
+
+template<typename E>
+const E& exprOperand(const MatrixExpr<E>& e) {
+    return e.self();
+}
+
+template<typename T>
+using ExprOperand = typename decay<decltype(exprOperand(declval<const T&>()))>::type;
+
+template<typename T>
+struct IsElementwise
+    : integral_constant<bool, is_same<T, Matrix>::value || is_base_of<MatrixExpr<T>, T>::value> {};
+
+template<typename L, typename R>
+using EnableElementwise = typename enable_if<IsElementwise<L>::value && IsElementwise<R>::value>::type;
+
+template<typename T>
+using EnableElementwiseOne = typename enable_if<IsElementwise<T>::value>::type;
+
+template<typename L, typename R, typename = EnableElementwise<L, R>>
+ElementwiseExpr<ExprOperand<L>, ExprOperand<R>, AddOp> operator+(const L& a, const R& b) {
+    return ElementwiseExpr<ExprOperand<L>, ExprOperand<R>, AddOp>(exprOperand(a), exprOperand(b));
+}
+
+template<typename L, typename R, typename = EnableElementwise<L, R>>
+ElementwiseExpr<ExprOperand<L>, ExprOperand<R>, SubtractOp> operator-(const L& a, const R& b) {
+    return ElementwiseExpr<ExprOperand<L>, ExprOperand<R>, SubtractOp>(exprOperand(a), exprOperand(b));
+}
+
+template<typename T, typename = EnableElementwiseOne<T>>
+ScaledExpr<ExprOperand<T>> operator*(double s, const T& a) {
+    return ScaledExpr<ExprOperand<T>>(exprOperand(a), s);
+}
+
+template<typename T, typename = EnableElementwiseOne<T>>
+ScaledExpr<ExprOperand<T>> operator*(const T& a, double s) {
+    return ScaledExpr<ExprOperand<T>>(exprOperand(a), s);
+}
+
+template<typename T, typename = EnableElementwiseOne<T>>
+ScaledExpr<ExprOperand<T>> operator/(const T& a, double s) {
+    return ScaledExpr<ExprOperand<T>>(exprOperand(a), 1.0 / s);
+}
+
+template<typename T, typename = EnableElementwiseOne<T>>
+ScaledExpr<ExprOperand<T>> operator-(const T& a) {
+    return ScaledExpr<ExprOperand<T>>(exprOperand(a), -1.0);
+}
+
+// The elementwise part of a ProductExpr, when there is none
+struct NoTerm {};
+
+inline bool termFits(const NoTerm&, int, int) {
+    return true;
+}
+
+template<typename E>
+bool termFits(const E& e, int r, int c) {
+    return e.rows() == r && e.cols() == c;
+}
+
+inline bool termReadsTransposed(const NoTerm&, const Matrix&) {
+    return false;
+}
+
+template<typename E>
+bool termReadsTransposed(const E& e, const Matrix& dest) {
+    return e.readsTransposed(dest);
+}
+
+// alpha * op(A) * op(B) + term, where op transposes or not and term is
+// elementwise or NoTerm. Evaluating it writes term into the destination and
+// lets GEMM accumulate onto it.
+template<typename R>
+class ProductExpr {
+private:
+    const Matrix& a;
+    const Matrix& b;
+    bool transA, transB;
+    double alpha;
+    R rest;
+
+    int innerLeft() const { return transA ? a.getRows() : a.getCols(); }
+    int innerRight() const { return transB ? b.getCols() : b.getRows(); }
+    int outerRows() const { return transA ? a.getCols() : a.getRows(); }
+    int outerCols() const { return transB ? b.getRows() : b.getCols(); }
+
+public:
+    ProductExpr(const Matrix& A, bool tA, const Matrix& B, bool tB, double s, const R& t)
+        : a(A), b(B), transA(tA), transB(tB), alpha(s), rest(t) {}
+
+    const Matrix& left() const { return a; }
+    const Matrix& right() const { return b; }
+    bool leftTransposed() const { return transA; }
+    bool rightTransposed() const { return transB; }
+    double scale() const { return alpha; }
+    const R& term() const { return rest; }
+
+    bool valid() const { return innerLeft() == innerRight() && termFits(rest, outerRows(), outerCols()); }
+    int rows() const { return valid() ? outerRows() : 0; }
+    int cols() const { return valid() ? outerCols() : 0; }
+    // GEMM reads all of A and B while writing, and the term is written
+    // before GEMM runs, so dest must not be any of them
+    bool aliases(const Matrix& dest) const {
+        return &a == &dest || &b == &dest || termReadsTransposed(rest, dest);
+    }
+};
+
+// Combining the elementwise term of a product with another operand
+template<typename T>
+T addTerm(const NoTerm&, const T& x) {
+    return x;
+}
+
+template<typename R, typename T>
+ElementwiseExpr<R, T, AddOp> addTerm(const R& r, const T& x) {
+    return ElementwiseExpr<R, T, AddOp>(r, x);
+}
+
+template<typename T>
+ScaledExpr<T> subtractTerm(const NoTerm&, const T& x) {
+    return ScaledExpr<T>(x, -1.0);
+}
+
+template<typename R, typename T>
+ElementwiseExpr<R, T, SubtractOp> subtractTerm(const R& r, const T& x) {
+    return ElementwiseExpr<R, T, SubtractOp>(r, x);
+}
+
+// x - term
+template<typename T>
+T subtractFrom(const T& x, const NoTerm&) {
+    return x;
+}
+
+template<typename T, typename R>
+ElementwiseExpr<T, R, SubtractOp> subtractFrom(const T& x, const R& r) {
+    return ElementwiseExpr<T, R, SubtractOp>(x, r);
+}
+
+inline NoTerm scaleTerm(const NoTerm&, double) {
+    return NoTerm();
+}
+
+template<typename R>
+ScaledExpr<R> scaleTerm(const R& r, double s) {
+    return ScaledExpr<R>(r, s);
+}
+
+// p's factors with a new scale and term
+template<typename P, typename R>
+ProductExpr<R> makeProduct(const P& p, double s, const R& term) {
+    return ProductExpr<R>(p.left(), p.leftTransposed(), p.right(), p.rightTransposed(), s, term);
+}
+
+inline ProductExpr<NoTerm> operator*(const Matrix& A, const Matrix& B) {
+    return ProductExpr<NoTerm>(A, false, B, false, 1.0, NoTerm());
+}
+
+inline ProductExpr<NoTerm> operator*(const ScaledExpr<MatrixRef>& sA, const Matrix& B) {
+    return ProductExpr<NoTerm>(sA.operand().matrix(), false, B, false, sA.scale(), NoTerm());
+}
+
+inline ProductExpr<NoTerm> operator*(const Matrix& A, const ScaledExpr<MatrixRef>& sB) {
+    return ProductExpr<NoTerm>(A, false, sB.operand().matrix(), false, sB.scale(), NoTerm());
+}
+
+inline ProductExpr<NoTerm> operator*(const TransposeExpr& At, const Matrix& B) {
+    return ProductExpr<NoTerm>(At.matrix(), true, B, false, 1.0, NoTerm());
+}
+
+inline ProductExpr<NoTerm> operator*(const Matrix& A, const TransposeExpr& Bt) {
+    return ProductExpr<NoTerm>(A, false, Bt.matrix(), true, 1.0, NoTerm());
+}
+
+inline ProductExpr<NoTerm> operator*(const TransposeExpr& At, const TransposeExpr& Bt) {
+    return ProductExpr<NoTerm>(At.matrix(), true, Bt.matrix(), true, 1.0, NoTerm());
+}
+
+template<typename R>
+auto operator*(double s, const ProductExpr<R>& p) {
+    return makeProduct(p, s * p.scale(), scaleTerm(p.term(), s));
+}
+
+template<typename R>
+auto operator*(const ProductExpr<R>& p, double s) {
+    return s * p;
+}
+
+template<typename R>
+auto operator-(const ProductExpr<R>& p) {
+    return -1.0 * p;
+}
+
+template<typename R, typename T, typename = EnableElementwiseOne<T>>
+auto operator+(const ProductExpr<R>& p, const T& x) {
+    return makeProduct(p, p.scale(), addTerm(p.term(), exprOperand(x)));
+}
+
+template<typename T, typename R, typename = EnableElementwiseOne<T>>
+auto operator+(const T& x, const ProductExpr<R>& p) {
+    return p + x;
+}
+
+template<typename R, typename T, typename = EnableElementwiseOne<T>>
+auto operator-(const ProductExpr<R>& p, const T& x) {
+    return makeProduct(p, p.scale(), subtractTerm(p.term(), exprOperand(x)));
+}
+
+template<typename T, typename R, typename = EnableElementwiseOne<T>>
+auto operator-(const T& x, const ProductExpr<R>& p) {
+    return makeProduct(p, -p.scale(), subtractFrom(exprOperand(x), p.term()));
+}
+
+// Two products cannot share a GEMM: the first is evaluated, the second
+// accumulated onto it
+template<typename R1, typename R2>
+Matrix operator+(const ProductExpr<R1>& p, const ProductExpr<R2>& q) {
+    Matrix result(p);
+    result += q;
+    return result;
+}
+
+template<typename R1, typename R2>
+Matrix operator-(const ProductExpr<R1>& p, const ProductExpr<R2>& q) {
+    Matrix result(p);
+    result += -q;
+    return result;
+}
+
+// Everything else multiplies evaluated operands
+inline const Matrix& evaluated(const Matrix& m) {
+    return m;
+}
+
+template<typename E>
+Matrix evaluated(const MatrixExpr<E>& e) {
+    return Matrix(e);
+}
+
+template<typename R>
+Matrix evaluated(const ProductExpr<R>& p) {
+    return Matrix(p);
+}
+
+template<typename T>
+struct IsProduct : false_type {};
+
+template<typename R>
+struct IsProduct<ProductExpr<R>> : true_type {};
+
+template<typename L, typename R>
+using EnableEagerProduct = typename enable_if<(IsElementwise<L>::value || IsProduct<L>::value) &&
+                                              (IsElementwise<R>::value || IsProduct<R>::value)>::type;
+
+template<typename L, typename R, typename = EnableEagerProduct<L, R>>
+Matrix operator*(const L& a, const R& b) {
+    const Matrix& A = evaluated(a);
+    const Matrix& B = evaluated(b);
+    return Matrix(A * B);
+}
+
+// Evaluation into a Matrix
+
+template<typename E>
+Matrix::Matrix(const MatrixExpr<E>& e) : Matrix(e.self().rows(), e.self().cols(), Uninitialized()) {
+    assignElements(e.self());
+}
+
+template<typename R>
+Matrix::Matrix(const ProductExpr<R>& p) : Matrix(p.rows(), p.cols(), Uninitialized()) {
+    assignProduct(p);
+}
+
+// Each entry is read only to compute the same entry, so the destination
+// may appear in the expression, except transposed; that and a change of
+// shape need a new buffer. A = A.transpose() swaps in place when A is square.
+template<typename E>
+Matrix& Matrix::operator=(const MatrixExpr<E>& e) {
+    if (is_same<E, TransposeExpr>::value && e.self().readsTransposed(*this) && rows == cols) {
+        transposeInPlace();
+        return *this;
+    }
+    if (rows != e.self().rows() || cols != e.self().cols() || e.self().readsTransposed(*this)) {
+        return *this = Matrix(e);
+    }
+    assignElements(e.self());
+    return *this;
+}
+
+template<typename R>
+Matrix& Matrix::operator=(const ProductExpr<R>& p) {
+    if (p.aliases(*this) || rows != p.rows() || cols != p.cols()) {
+        return *this = Matrix(p);
+    }
+    assignProduct(p);
+    return *this;
+}
+
+// The compound forms leave the matrix alone on a shape mismatch
+template<typename E>
+Matrix& Matrix::operator+=(const MatrixExpr<E>& e) {
+    if (rows == e.self().rows() && cols == e.self().cols()) {
+        *this = ElementwiseExpr<MatrixRef, E, AddOp>(MatrixRef(*this), e.self());
+    }
+    return *this;
+}
+
+template<typename E>
+Matrix& Matrix::operator-=(const MatrixExpr<E>& e) {
+    if (rows == e.self().rows() && cols == e.self().cols()) {
+        *this = ElementwiseExpr<MatrixRef, E, SubtractOp>(MatrixRef(*this), e.self());
+    }
+    return *this;
+}
+
+template<typename R>
+Matrix& Matrix::operator+=(const ProductExpr<R>& p) {
+    if (rows != p.rows() || cols != p.cols()) {
+        return *this;
+    }
+    if (&p.left() == this || &p.right() == this) {
+        return *this = Matrix(*this + p);
+    }
+    addTermTo(p.term());
+    productUpdate(p.left(), p.leftTransposed(), p.right(), p.rightTransposed(), p.scale(), 1.0);
+    return *this;
+}
+
+template<typename R>
+Matrix& Matrix::operator-=(const ProductExpr<R>& p) {
+    return *this += -p;
+}
+
+inline Matrix& Matrix::operator+=(const Matrix& other) {
+    return *this += MatrixRef(other);
+}
+
+inline Matrix& Matrix::operator-=(const Matrix& other) {
+    return *this -= MatrixRef(other);
+}
+
+inline Matrix& Matrix::operator*=(double s) {
+    assignElements(ScaledExpr<MatrixRef>(MatrixRef(*this), s));
+    return *this;
+}
+
+template<typename E>
+void Matrix::assignElements(const E& e) {
+    invalidate();
+    double* out = base;
+    int stride = ld;
+    parallelTiles(rows, cols, elementwiseTileRows, elementwiseTileCols, [&](int i0, int i1, int j0, int j1) {
+        for (int i = i0; i < i1; i++) {
+            double* row = out + (size_t)i * stride;
+            for (int j = j0; j < j1; j++) {
+                row[j] = e(i, j);
+            }
+        }
+    });
+}
+
+template<typename R>
+void Matrix::assignProduct(const ProductExpr<R>& p) {
+    if (rows == 0 || cols == 0) {
+        return;
+    }
+    double beta = assignTerm(p.term()) ? 1.0 : 0.0;
+    productUpdate(p.left(), p.leftTransposed(), p.right(), p.rightTransposed(), p.scale(), beta);
+}
+
+inline bool Matrix::assignTerm(const NoTerm&) {
+    return false;
+}
+
+template<typename E>
+bool Matrix::assignTerm(const MatrixExpr<E>& e) {
+    assignElements(e.self());
+    return true;
+}
+
+inline void Matrix::addTermTo(const NoTerm&) {}
+
+template<typename E>
+void Matrix::addTermTo(const MatrixExpr<E>& e) {
+    *this += e;
+}
+
+#endif
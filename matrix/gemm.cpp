@@ -0,0 +1,508 @@
+#include "gemm.hpp"
+#include "matrix.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GEMM_HAVE_AVX2_KERNEL 1
+#endif
+
+using namespace std;
+
+namespace {
+
+// Register tile, per scalar type. MR x NR accumulators fill 12 of the 16
+// ymm registers: two registers a row, of 4 doubles or 8 floats. long double
+// only has the portable kernel.
+template<typename T>
+struct Tile {
+    static const int MR = 6;
+    static const int NR = 8;
+};
+
+template<>
+struct Tile<float> {
+    static const int MR = 6;
+    static const int NR = 16;
+};
+
+template<>
+struct Tile<long double> {
+    static const int MR = 4;
+    static const int NR = 4;
+};
+
+// Cache blocking: an MR x KC sliver of A plus a KC x NR sliver of B stay in
+// L1, an MC x KC block of A in L2 and a KC x NC panel of B in L3.
+const int KC = 256;
+const int MC = 96;
+const int NC = 4096;
+
+// Width of the C column slice one thread task owns; a multiple of every NR
+// so partial register tiles only ever occur at the matrix edge.
+const int TILE_N = 512;
+
+// Below this many multiply-adds packing costs more than it saves.
+const long long smallProduct = 32LL * 32 * 32;
+
+template<typename T>
+using Buffer = vector<T, AlignedAllocator<T>>;
+
+template<typename T>
+using MicroKernel = void (*)(int kc, const T* a, const T* b, T* c, int ldc, T alpha, T beta);
+
+// c[MR x NR] = alpha * a * b + beta * c, with a packed as kc columns of MR
+// and b as kc rows of NR.
+template<typename T>
+void kernelScalar(int kc, const T* a, const T* b, T* c, int ldc, T alpha, T beta) {
+    const int MR = Tile<T>::MR, NR = Tile<T>::NR;
+    T acc[MR][NR] = {};
+    for (int p = 0; p < kc; p++) {
+        for (int i = 0; i < MR; i++) {
+            for (int j = 0; j < NR; j++) {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+    for (int i = 0; i < MR; i++) {
+        T* ci = c + (size_t)i * ldc;
+        for (int j = 0; j < NR; j++) {
+            ci[j] = (beta == 0) ? alpha * acc[i][j] : alpha * acc[i][j] + beta * ci[j];
+        }
+    }
+}
+
+#ifdef GEMM_HAVE_AVX2_KERNEL
+__attribute__((target("avx2,fma")))
+void kernelAvx2(int kc, const double* a, const double* b,
+                double* c, int ldc, double alpha, double beta) {
+    const int MR = Tile<double>::MR, NR = Tile<double>::NR;
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+    for (int p = 0; p < kc; p++) {
+        __m256d b0 = _mm256_load_pd(b);
+        __m256d b1 = _mm256_load_pd(b + 4);
+        __m256d ai;
+        ai = _mm256_broadcast_sd(a + 0);
+        c00 = _mm256_fmadd_pd(ai, b0, c00); c01 = _mm256_fmadd_pd(ai, b1, c01);
+        ai = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_fmadd_pd(ai, b0, c10); c11 = _mm256_fmadd_pd(ai, b1, c11);
+        ai = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_fmadd_pd(ai, b0, c20); c21 = _mm256_fmadd_pd(ai, b1, c21);
+        ai = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_fmadd_pd(ai, b0, c30); c31 = _mm256_fmadd_pd(ai, b1, c31);
+        ai = _mm256_broadcast_sd(a + 4);
+        c40 = _mm256_fmadd_pd(ai, b0, c40); c41 = _mm256_fmadd_pd(ai, b1, c41);
+        ai = _mm256_broadcast_sd(a + 5);
+        c50 = _mm256_fmadd_pd(ai, b0, c50); c51 = _mm256_fmadd_pd(ai, b1, c51);
+        a += MR;
+        b += NR;
+    }
+
+    __m256d acc[MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                          {c30, c31}, {c40, c41}, {c50, c51}};
+    __m256d va = _mm256_set1_pd(alpha);
+    __m256d vb = _mm256_set1_pd(beta);
+    for (int i = 0; i < MR; i++) {
+        double* ci = c + (size_t)i * ldc;
+        for (int h = 0; h < 2; h++) {
+            __m256d r = _mm256_mul_pd(va, acc[i][h]);
+            if (beta != 0.0) {
+                r = _mm256_fmadd_pd(vb, _mm256_loadu_pd(ci + 4 * h), r);
+            }
+            _mm256_storeu_pd(ci + 4 * h, r);
+        }
+    }
+}
+
+// The same register tile in single precision, 8 lanes to a register
+__attribute__((target("avx2,fma")))
+void kernelAvx2Float(int kc, const float* a, const float* b,
+                     float* c, int ldc, float alpha, float beta) {
+    const int MR = Tile<float>::MR, NR = Tile<float>::NR;
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for (int p = 0; p < kc; p++) {
+        __m256 b0 = _mm256_load_ps(b);
+        __m256 b1 = _mm256_load_ps(b + 8);
+        __m256 ai;
+        ai = _mm256_broadcast_ss(a + 0);
+        c00 = _mm256_fmadd_ps(ai, b0, c00); c01 = _mm256_fmadd_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(a + 1);
+        c10 = _mm256_fmadd_ps(ai, b0, c10); c11 = _mm256_fmadd_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(a + 2);
+        c20 = _mm256_fmadd_ps(ai, b0, c20); c21 = _mm256_fmadd_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(a + 3);
+        c30 = _mm256_fmadd_ps(ai, b0, c30); c31 = _mm256_fmadd_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(a + 4);
+        c40 = _mm256_fmadd_ps(ai, b0, c40); c41 = _mm256_fmadd_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(a + 5);
+        c50 = _mm256_fmadd_ps(ai, b0, c50); c51 = _mm256_fmadd_ps(ai, b1, c51);
+        a += MR;
+        b += NR;
+    }
+
+    __m256 acc[MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                         {c30, c31}, {c40, c41}, {c50, c51}};
+    __m256 va = _mm256_set1_ps(alpha);
+    __m256 vb = _mm256_set1_ps(beta);
+    for (int i = 0; i < MR; i++) {
+        float* ci = c + (size_t)i * ldc;
+        for (int h = 0; h < 2; h++) {
+            __m256 r = _mm256_mul_ps(va, acc[i][h]);
+            if (beta != 0.0f) {
+                r = _mm256_fmadd_ps(vb, _mm256_loadu_ps(ci + 8 * h), r);
+            }
+            _mm256_storeu_ps(ci + 8 * h, r);
+        }
+    }
+}
+
+bool haveAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#endif
+
+template<typename T>
+MicroKernel<T> selectKernel() {
+    return kernelScalar<T>;
+}
+
+template<>
+MicroKernel<double> selectKernel<double>() {
+#ifdef GEMM_HAVE_AVX2_KERNEL
+    if (haveAvx2()) {
+        return kernelAvx2;
+    }
+#endif
+    return kernelScalar<double>;
+}
+
+template<>
+MicroKernel<float> selectKernel<float>() {
+#ifdef GEMM_HAVE_AVX2_KERNEL
+    if (haveAvx2()) {
+        return kernelAvx2Float;
+    }
+#endif
+    return kernelScalar<float>;
+}
+
+typedef double (*DotKernel)(const double* x, const double* y, int n);
+
+double dotScalar(const double* x, const double* y, int n) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        s0 += x[k] * y[k];
+        s1 += x[k + 1] * y[k + 1];
+        s2 += x[k + 2] * y[k + 2];
+        s3 += x[k + 3] * y[k + 3];
+    }
+    for (; k < n; k++) {
+        s0 += x[k] * y[k];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef GEMM_HAVE_AVX2_KERNEL
+// Four independent accumulators hide the FMA latency
+__attribute__((target("avx2,fma")))
+double dotAvx2(const double* x, const double* y, int n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    int k = 0;
+    for (; k + 16 <= n; k += 16) {
+        a0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k), _mm256_loadu_pd(y + k), a0);
+        a1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k + 4), _mm256_loadu_pd(y + k + 4), a1);
+        a2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k + 8), _mm256_loadu_pd(y + k + 8), a2);
+        a3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k + 12), _mm256_loadu_pd(y + k + 12), a3);
+    }
+    for (; k + 4 <= n; k += 4) {
+        a0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k), _mm256_loadu_pd(y + k), a0);
+    }
+    __m256d acc = _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    double s = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; k < n; k++) {
+        s += x[k] * y[k];
+    }
+    return s;
+}
+#endif
+
+DotKernel selectDot() {
+#ifdef GEMM_HAVE_AVX2_KERNEL
+    if (haveAvx2()) {
+        return dotAvx2;
+    }
+#endif
+    return dotScalar;
+}
+
+typedef void (*TransposeKernel)(int m, int n, const double* A, int lda, double* B, int ldb);
+
+void transposeScalar(int m, int n, const double* A, int lda, double* B, int ldb) {
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            B[(size_t)j * ldb + i] = A[(size_t)i * lda + j];
+        }
+    }
+}
+
+#ifdef GEMM_HAVE_AVX2_KERNEL
+// 4 x 4 blocks transposed in registers: pairs of rows interleaved, then
+// the 128-bit halves exchanged. The ragged edges go element by element.
+__attribute__((target("avx2")))
+void transposeAvx2(int m, int n, const double* A, int lda, double* B, int ldb) {
+    int m4 = m / 4 * 4, n4 = n / 4 * 4;
+    for (int i = 0; i < m4; i += 4) {
+        const double* a = A + (size_t)i * lda;
+        for (int j = 0; j < n4; j += 4) {
+            __m256d r0 = _mm256_loadu_pd(a + j);
+            __m256d r1 = _mm256_loadu_pd(a + lda + j);
+            __m256d r2 = _mm256_loadu_pd(a + 2 * (size_t)lda + j);
+            __m256d r3 = _mm256_loadu_pd(a + 3 * (size_t)lda + j);
+            __m256d t0 = _mm256_unpacklo_pd(r0, r1);  // a00 a10 a02 a12
+            __m256d t1 = _mm256_unpackhi_pd(r0, r1);  // a01 a11 a03 a13
+            __m256d t2 = _mm256_unpacklo_pd(r2, r3);  // a20 a30 a22 a32
+            __m256d t3 = _mm256_unpackhi_pd(r2, r3);  // a21 a31 a23 a33
+            double* b = B + (size_t)j * ldb + i;
+            _mm256_storeu_pd(b, _mm256_permute2f128_pd(t0, t2, 0x20));
+            _mm256_storeu_pd(b + ldb, _mm256_permute2f128_pd(t1, t3, 0x20));
+            _mm256_storeu_pd(b + 2 * (size_t)ldb, _mm256_permute2f128_pd(t0, t2, 0x31));
+            _mm256_storeu_pd(b + 3 * (size_t)ldb, _mm256_permute2f128_pd(t1, t3, 0x31));
+        }
+    }
+    if (n4 < n) {
+        transposeScalar(m4, n - n4, A + n4, lda, B + (size_t)n4 * ldb, ldb);
+    }
+    if (m4 < m) {
+        transposeScalar(m - m4, n, A + (size_t)m4 * lda, lda, B + m4, ldb);
+    }
+}
+#endif
+
+TransposeKernel selectTranspose() {
+#ifdef GEMM_HAVE_AVX2_KERNEL
+    if (haveAvx2()) {
+        return transposeAvx2;
+    }
+#endif
+    return transposeScalar;
+}
+
+// Pack an mc x kc block of A (element (i, p) at A[i * rs + p * cs]) into
+// MR-row slivers, column by column, zero-padding the last sliver.
+template<typename T>
+void packA(int mc, int kc, const T* A, int rs, int cs, T* out) {
+    const int MR = Tile<T>::MR;
+    for (int i0 = 0; i0 < mc; i0 += MR) {
+        int mr = min(MR, mc - i0);
+        for (int p = 0; p < kc; p++) {
+            for (int i = 0; i < mr; i++) {
+                out[i] = A[(size_t)(i0 + i) * rs + (size_t)p * cs];
+            }
+            for (int i = mr; i < MR; i++) {
+                out[i] = 0;
+            }
+            out += MR;
+        }
+    }
+}
+
+// Pack a kc x nc panel of B (element (p, j) at B[p * rs + j * cs]) into
+// NR-column slivers, row by row, zero-padding the last sliver.
+template<typename T>
+void packB(int kc, int nc, const T* B, int rs, int cs, T* out) {
+    const int NR = Tile<T>::NR;
+    for (int j0 = 0; j0 < nc; j0 += NR) {
+        int nr = min(NR, nc - j0);
+        for (int p = 0; p < kc; p++) {
+            const T* bp = B + (size_t)p * rs + (size_t)j0 * cs;
+            for (int j = 0; j < nr; j++) {
+                out[j] = bp[(size_t)j * cs];
+            }
+            for (int j = nr; j < NR; j++) {
+                out[j] = 0;
+            }
+            out += NR;
+        }
+    }
+}
+
+// Plain i-k-j loop for products too small to amortize packing.
+template<typename T>
+void gemmSmall(int m, int n, int k, T alpha, const T* A, int rsA, int csA,
+               const T* B, int rsB, int csB, T beta, T* C, int ldc) {
+    for (int i = 0; i < m; i++) {
+        T* ci = C + (size_t)i * ldc;
+        for (int j = 0; j < n; j++) {
+            ci[j] = (beta == 0) ? 0 : beta * ci[j];
+        }
+        for (int p = 0; p < k; p++) {
+            T a = alpha * A[(size_t)i * rsA + (size_t)p * csA];
+            const T* bp = B + (size_t)p * rsB;
+            for (int j = 0; j < n; j++) {
+                ci[j] += a * bp[(size_t)j * csB];
+            }
+        }
+    }
+}
+
+// Shared driver; element (i, p) of op(A) is A[i * rsA + p * csA] and
+// element (p, j) of op(B) is B[p * rsB + j * csB].
+template<typename T>
+void gemmStrided(int m, int n, int k, T alpha, const T* A, int rsA, int csA,
+                 const T* B, int rsB, int csB, T beta, T* C, int ldc) {
+    const int MR = Tile<T>::MR, NR = Tile<T>::NR;
+    if (m <= 0 || n <= 0) {
+        return;
+    }
+    if (k <= 0 || alpha == 0) {
+        for (int i = 0; i < m; i++) {
+            T* ci = C + (size_t)i * ldc;
+            for (int j = 0; j < n; j++) {
+                ci[j] = (beta == 0) ? 0 : beta * ci[j];
+            }
+        }
+        return;
+    }
+    if ((long long)m * n * k <= smallProduct) {
+        gemmSmall(m, n, k, alpha, A, rsA, csA, B, rsB, csB, beta, C, ldc);
+        return;
+    }
+
+    static const MicroKernel<T> kernel = selectKernel<T>();
+    thread_local Buffer<T> packedB;
+    packedB.resize((size_t)KC * (NC + NR));
+    ThreadPool& pool = ThreadPool::instance();
+
+    for (int jc = 0; jc < n; jc += NC) {
+        int nc = min(NC, n - jc);
+        int slivers = (nc + NR - 1) / NR;
+        int blocksDown = (m + MC - 1) / MC;
+        int blocksAcross = (nc + TILE_N - 1) / TILE_N;
+
+        for (int pc = 0; pc < k; pc += KC) {
+            int kc = min(KC, k - pc);
+            // Later k-panels accumulate onto what the first one wrote
+            T betaPanel = (pc == 0) ? beta : 1;
+
+            const T* Bpanel = B + (size_t)pc * rsB + (size_t)jc * csB;
+            T* Bpacked = packedB.data();
+            pool.run((slivers + 63) / 64, [&](int t) {
+                int j0 = t * 64 * NR;
+                int j1 = min(nc, j0 + 64 * NR);
+                packB(kc, j1 - j0, Bpanel + (size_t)j0 * csB, rsB, csB, Bpacked + (size_t)j0 * kc);
+            });
+
+            // One task per MC-row block x TILE_N-column slice of C. Each task
+            // packs its own copy of the A block; that is cheap next to the
+            // 2*MC*KC*TILE_N flops it feeds.
+            pool.run(blocksDown * blocksAcross, [&](int t) {
+                int ic = (t / blocksAcross) * MC;
+                int jt = (t % blocksAcross) * TILE_N;
+                int mc = min(MC, m - ic);
+                int nt = min(TILE_N, nc - jt);
+
+                thread_local Buffer<T> packedA;
+                packedA.resize((size_t)MC * KC);
+                packA(mc, kc, A + (size_t)ic * rsA + (size_t)pc * csA, rsA, csA, packedA.data());
+
+                T edge[MR * NR];
+                for (int jr = jt; jr < jt + nt; jr += NR) {
+                    int nr = min(NR, nc - jr);
+                    const T* bp = Bpacked + (size_t)jr * kc;
+                    for (int ir = 0; ir < mc; ir += MR) {
+                        int mr = min(MR, mc - ir);
+                        const T* ap = packedA.data() + (size_t)ir * kc;
+                        T* c = C + (size_t)(ic + ir) * ldc + jc + jr;
+                        if (mr == MR && nr == NR) {
+                            kernel(kc, ap, bp, c, ldc, alpha, betaPanel);
+                        } else {
+                            // Partial tile: run the full kernel into scratch
+                            // and merge only the valid part.
+                            kernel(kc, ap, bp, edge, NR, alpha, 0);
+                            for (int i = 0; i < mr; i++) {
+                                T* ci = c + (size_t)i * ldc;
+                                for (int j = 0; j < nr; j++) {
+                                    ci[j] = (betaPanel == 0) ? edge[i * NR + j]
+                                                               : edge[i * NR + j] + betaPanel * ci[j];
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
+
+template<typename T>
+void gemmTransposed(bool transA, bool transB, int m, int n, int k, T alpha, const T* A, int lda,
+                    const T* B, int ldb, T beta, T* C, int ldc) {
+    gemmStrided(m, n, k, alpha,
+                A, transA ? 1 : lda, transA ? lda : 1,
+                B, transB ? 1 : ldb, transB ? ldb : 1,
+                beta, C, ldc);
+}
+
+}
+
+void gemm(int m, int n, int k, double alpha, const double* A, int lda,
+          const double* B, int ldb, double beta, double* C, int ldc) {
+    gemmStrided(m, n, k, alpha, A, lda, 1, B, ldb, 1, beta, C, ldc);
+}
+
+void gemm(bool transA, bool transB, int m, int n, int k, double alpha,
+          const double* A, int lda, const double* B, int ldb,
+          double beta, double* C, int ldc) {
+    gemmTransposed(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void gemm(int m, int n, int k, float alpha, const float* A, int lda,
+          const float* B, int ldb, float beta, float* C, int ldc) {
+    gemmStrided(m, n, k, alpha, A, lda, 1, B, ldb, 1, beta, C, ldc);
+}
+
+void gemm(bool transA, bool transB, int m, int n, int k, float alpha,
+          const float* A, int lda, const float* B, int ldb,
+          float beta, float* C, int ldc) {
+    gemmTransposed(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void gemm(int m, int n, int k, long double alpha, const long double* A, int lda,
+          const long double* B, int ldb, long double beta, long double* C, int ldc) {
+    gemmStrided(m, n, k, alpha, A, lda, 1, B, ldb, 1, beta, C, ldc);
+}
+
+void gemm(bool transA, bool transB, int m, int n, int k, long double alpha,
+          const long double* A, int lda, const long double* B, int ldb,
+          long double beta, long double* C, int ldc) {
+    gemmTransposed(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+double dotProduct(const double* x, const double* y, int n) {
+    static const DotKernel kernel = selectDot();
+    return kernel(x, y, n);
+}
+
+void transposeBlock(int m, int n, const double* A, int lda, double* B, int ldb) {
+    static const TransposeKernel kernel = selectTranspose();
+    kernel(m, n, A, lda, B, ldb);
+}
@@ -0,0 +1,45 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+// C = alpha * A * B + beta * C on row-major blocks. A is m x k, B is k x n and
+// C is m x n; lda, ldb and ldc are their row strides. C is never read when
+// beta == 0, so it may start out uninitialized.
+//
+// The product is computed BLIS-style: B is packed into KC x NC panels sized
+// for L3, A into MC x KC blocks sized for L2, and an MR x NR register tile
+// micro-kernel (AVX2/FMA when the CPU has it, portable C++ otherwise) runs
+// over the packed data. Row blocks x column slices of C are spread over the
+// shared ThreadPool.
+void gemm(int m, int n, int k, double alpha, const double* A, int lda,
+          const double* B, int ldb, double beta, double* C, int ldc);
+
+// Same, with op(A) = A^T when transA and op(B) = B^T when transB. op(A) is
+// m x k and op(B) is k x n; lda and ldb are the row strides of A and B as
+// stored. Transposition is folded into packing, so it costs nothing extra.
+void gemm(bool transA, bool transB, int m, int n, int k, double alpha,
+          const double* A, int lda, const double* B, int ldb,
+          double beta, double* C, int ldc);
+
+// The same in float, with its own AVX2 kernel (8 lanes to a register, so
+// twice the flops per instruction), and in long double, portable C++ only.
+void gemm(int m, int n, int k, float alpha, const float* A, int lda,
+          const float* B, int ldb, float beta, float* C, int ldc);
+void gemm(bool transA, bool transB, int m, int n, int k, float alpha,
+          const float* A, int lda, const float* B, int ldb,
+          float beta, float* C, int ldc);
+void gemm(int m, int n, int k, long double alpha, const long double* A, int lda,
+          const long double* B, int ldb, long double beta, long double* C, int ldc);
+void gemm(bool transA, bool transB, int m, int n, int k, long double alpha,
+          const long double* A, int lda, const long double* B, int ldb,
+          long double beta, long double* C, int ldc);
+
+// x . y for two contiguous vectors of length n, AVX2/FMA when the CPU has
+// it. The summation order depends only on n, never on the data or threads.
+double dotProduct(const double* x, const double* y, int n);
+
+// B = A^T for an m x n block of A: B(j, i) = A(i, j), with lda and ldb the
+// row strides. Runs 4 x 4 register transposes (AVX2 when the CPU has it),
+// so whole rows of B are written at a time; keep the block within cache.
+void transposeBlock(int m, int n, const double* A, int lda, double* B, int ldb);
+
+#endif
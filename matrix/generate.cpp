@@ -1,104 +1,322 @@
+// Test system generator.
+//
+// Build: g++ -std=c++17 -O2 -pthread generate.cpp matrix.cpp gemm.cpp threadpool.cpp lu.cpp cholesky.cpp sparse.cpp krylov.cpp textio.cpp telemetry.cpp status.cpp precision.cpp banded.cpp solver.cpp -o generate
+//
+// Run with no arguments for the interactive prompts, or e.g.
+//   generate --size 50000 --structure banded --bandwidth 8 --spd --solution --format binary --seed 7 --out sys
+//
+// Rows are produced a block at a time and written straight out, so memory
+// stays bounded whatever the size. Every entry comes from a counter-based
+// hash of (seed, i, j) rather than a sequential generator: the same seed
+// always gives the same file, and the rows of a block are built in parallel.
+#include "matrix.hpp"
+#include "threadpool.hpp"
 #include <iostream>
 #include <fstream>
-#include <iomanip>
-#include <cstdlib>  // For rand() and srand()
-#include <ctime>    // For time()
-#include <cmath>    // For abs()
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cmath>
+#include <algorithm>
 using namespace std;
 
-void generateDiagonallyDominantMatrix(int rows, int cols, const string& filename, bool symmetric) {
-    ofstream outFile(filename + ".txt");
-    if (!outFile) {
-        cout << "Error: Unable to open file for writing.\n";
-        return;
-    }
-    
-    // Write matrix dimensions
-    outFile << rows << " " << cols << endl;
-    
-    // Seed random number generator
-    srand(time(0));
-    
-    // Dynamically allocate memory for the matrix
-    double** matrix = new double*[rows];
-    for (int i = 0; i < rows; i++) {
-        matrix[i] = new double[cols];
-    }
-    
-    // Generate matrix values
-    for (int i = 0; i < rows; i++) {
-        double rowSum = 0.0;
-        
-        // Fill the non-diagonal elements first
-        for (int j = 0; j < cols; j++) {
-            if (i != j || i >= cols) { // Non-diagonal element or outside the square part
-                double randomValue = (rand() % 2000 - 1000) / 10.0; // Range: -100.0 to 100.0
-                
-                if (symmetric && i < cols && j < rows && i > j) {
-                    // For symmetric matrices, copy the value from the upper triangle
-                    // (only applies to the square part of the matrix)
-                    matrix[i][j] = matrix[j][i];
-                } else {
-                    matrix[i][j] = randomValue;
-                    if (symmetric && i < cols && j < rows && i < j) {
-                        matrix[j][i] = randomValue; // Mirror value for symmetry
+enum class Structure { Dense, Banded, Sparse };
+
+struct GeneratorOptions {
+    int rows = 0, cols = 0;
+    Structure structure = Structure::Dense;
+    bool symmetric = false;
+    bool spd = false;           // symmetric with a positive diagonal
+    int bandwidth = 1;          // banded: entries with |i - j| <= bandwidth
+    double density = 0.01;      // sparse: chance of an off-diagonal entry
+    uint64_t seed = 0;
+    bool binary = false;
+    bool solution = false;      // also write x* and b = A x*
+    string filename;
+};
+
+// Independent random streams drawn from the same (seed, i, j) counter
+enum Stream : uint64_t { Value = 1, Pattern, DiagonalExtra, DiagonalSign, Solution };
+
+inline uint64_t splitmix(uint64_t z) {
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+inline uint64_t randomBits(uint64_t seed, Stream stream, int i, int j) {
+    uint64_t key = ((uint64_t)(uint32_t)i << 32) | (uint32_t)j;
+    return splitmix(splitmix(seed + stream * 0xd1b54a32d192ed03ULL) ^ key);
+}
+
+inline double uniform(uint64_t bits) {
+    return (bits >> 11) * 0x1.0p-53;
+}
+
+// Off-diagonal entry (i, j); the symmetric structures hash the unordered pair
+double offDiagonal(const GeneratorOptions& o, int i, int j) {
+    int a = i, b = j;
+    if (o.symmetric && a > b) {
+        swap(a, b);
+    }
+    if (o.structure == Structure::Sparse && uniform(randomBits(o.seed, Pattern, a, b)) >= o.density) {
+        return 0.0;
+    }
+    return ((int)(randomBits(o.seed, Value, a, b) % 2000) - 1000) / 10.0;  // -100.0 to 99.9
+}
+
+double solutionEntry(const GeneratorOptions& o, int j) {
+    return ((int)(randomBits(o.seed, Solution, 0, j) % 2001) - 1000) / 100.0;  // -10.0 to 10.0
+}
+
+// Fills row i and returns (row i) . x* when x is given
+double generateRow(const GeneratorOptions& o, int i, double* row, const double* x) {
+    int j0 = 0, j1 = o.cols;
+    if (o.structure == Structure::Banded) {
+        fill(row, row + o.cols, 0.0);
+        j0 = max(0, i - o.bandwidth);
+        j1 = (int)min((long long)o.cols, (long long)i + o.bandwidth + 1);
+    }
+
+    double rowSum = 0.0;
+    for (int j = j0; j < j1; j++) {
+        row[j] = (j == i) ? 0.0 : offDiagonal(o, i, j);
+        rowSum += fabs(row[j]);
+    }
+
+    // Strictly larger than the rest of the row, by 1.0 to 100.9
+    if (i < o.cols) {
+        double diagonal = rowSum + (randomBits(o.seed, DiagonalExtra, i, i) % 1000) / 10.0 + 1.0;
+        if (!o.spd && (randomBits(o.seed, DiagonalSign, i, i) & 1)) {
+            diagonal = -diagonal;
+        }
+        row[i] = diagonal;
+    }
+
+    double bi = 0.0;
+    if (x) {
+        for (int j = j0; j < j1; j++) {
+            bi += row[j] * x[j];
+        }
+    }
+    return bi;
+}
+
+// Shortest text that reads back to exactly the same double
+void appendNumber(string& out, double v) {
+    char buf[32];
+    to_chars_result r = to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+bool writeVector(const vector<double>& v, const string& filename) {
+    ofstream out(filename + ".txt", ios::binary);
+    if (!out) {
+        cout << "Error: Unable to open " << filename << ".txt for writing.\n";
+        return false;
+    }
+    string text = to_string(v.size()) + "\n";
+    for (double val : v) {
+        appendNumber(text, val);
+        text += '\n';
+    }
+    out.write(text.data(), (streamsize)text.size());
+    return (bool)out;
+}
+
+bool generateMatrix(const GeneratorOptions& o) {
+    ofstream textOut;
+    unique_ptr<MatrixFileWriter> binaryOut;
+    string path = o.filename + (o.binary ? ".bin" : ".txt");
+    if (o.binary) {
+        binaryOut.reset(new MatrixFileWriter(o.filename, o.rows, o.cols));
+        if (!binaryOut->status()) {
+            cout << binaryOut->status().message() << ".\n";
+            return false;
+        }
+    } else {
+        textOut.open(path, ios::binary);
+        if (!textOut) {
+            cout << "Error: Unable to open file for writing.\n";
+            return false;
+        }
+        textOut << o.rows << " " << o.cols << "\n";
+    }
+
+    vector<double> x, b;
+    if (o.solution) {
+        x.resize(o.cols);
+        for (int j = 0; j < o.cols; j++) {
+            x[j] = solutionEntry(o, j);
+        }
+        b.resize(o.rows);
+    }
+
+    // About 32 MB of doubles per block, at most 256 rows
+    int blockRows = (int)max(1LL, min(256LL, (4LL << 20) / max(o.cols, 1)));
+    vector<double> block((size_t)blockRows * o.cols);
+    vector<string> lines(o.binary ? 0 : blockRows);
+
+    for (int i0 = 0; i0 < o.rows; i0 += blockRows) {
+        int count = min(blockRows, o.rows - i0);
+        ThreadPool::instance().run(count, [&](int r) {
+            double* row = block.data() + (size_t)r * o.cols;
+            double bi = generateRow(o, i0 + r, row, o.solution ? x.data() : nullptr);
+            if (o.solution) {
+                b[i0 + r] = bi;
+            }
+            if (!o.binary) {
+                string& line = lines[r];
+                line.clear();
+                for (int j = 0; j < o.cols; j++) {
+                    if (j > 0) {
+                        line += ' ';
                     }
+                    appendNumber(line, row[j]);
                 }
-                
-                rowSum += fabs(matrix[i][j]);
+                line += '\n';
             }
-        }
-        
-        // Make the diagonal element larger than the sum of other elements in the row
-        // (only applicable for the square part of the matrix)
-        if (i < cols) {
-            // Adding a small random amount to ensure strict diagonal dominance
-            double extraValue = (rand() % 1000) / 10.0 + 1.0; // Range: 1.0 to 101.0
-            double diagValue = rowSum + extraValue;
-            
-            // Randomly make some diagonal elements negative (preserves diagonal dominance)
-            if (rand() % 2 == 0) {
-                diagValue = -diagValue;
+        });
+
+        if (o.binary) {
+            Status written = binaryOut->writeRows(block.data(), count, o.cols);
+            if (!written) {
+                cout << written.message() << ".\n";
+                return false;
+            }
+        } else {
+            for (int r = 0; r < count; r++) {
+                textOut.write(lines[r].data(), (streamsize)lines[r].size());
+            }
+            if (!textOut) {
+                cout << "Error: Write to " << path << " failed.\n";
+                return false;
             }
-            
-            matrix[i][i] = diagValue;
         }
     }
-    
-    // Write the matrix to file
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            outFile << setw(12) << fixed << setprecision(2) << matrix[i][j] << " ";
+
+    if (binaryOut) {
+        Status closed = binaryOut->close();
+        if (!closed) {
+            cout << closed.message() << ".\n";
+            return false;
         }
-        outFile << endl;
     }
-    
-    // Free dynamically allocated memory
-    for (int i = 0; i < rows; i++) {
-        delete[] matrix[i];
+    cout << "Matrix saved to " << path << " (seed " << o.seed << ")" << endl;
+
+    if (o.solution) {
+        if (!writeVector(x, o.filename + "_x") || !writeVector(b, o.filename + "_b")) {
+            return false;
+        }
+        cout << "Solution x* saved to " << o.filename << "_x.txt, b = A x* to " << o.filename << "_b.txt" << endl;
     }
-    delete[] matrix;
-    
-    outFile.close();
-    cout << "Diagonally dominant matrix saved to " << filename << ".txt" << endl;
+    return true;
+}
+
+void usage() {
+    cout << "Usage: generate [--size N | --rows N --cols M] [--structure dense|banded|sparse]\n"
+            "                [--bandwidth K] [--density D] [--symmetric] [--spd] [--solution]\n"
+            "                [--seed S] [--format text|binary] --out NAME\n";
 }
 
-int main() {
+bool parseOptions(int argc, char* argv[], GeneratorOptions& o) {
+    bool seeded = false;
+    for (int k = 1; k < argc; k++) {
+        string arg = argv[k];
+        bool hasValue = k + 1 < argc;
+        string value = hasValue ? argv[k + 1] : "";
+        if (arg == "--symmetric") {
+            o.symmetric = true;
+        } else if (arg == "--spd") {
+            o.spd = o.symmetric = true;
+        } else if (arg == "--solution") {
+            o.solution = true;
+        } else if (!hasValue) {
+            cout << "Error: Missing value for " << arg << ".\n";
+            return false;
+        } else {
+            k++;
+            if (arg == "--size") {
+                o.rows = o.cols = atoi(value.c_str());
+            } else if (arg == "--rows") {
+                o.rows = atoi(value.c_str());
+            } else if (arg == "--cols") {
+                o.cols = atoi(value.c_str());
+            } else if (arg == "--bandwidth") {
+                o.bandwidth = atoi(value.c_str());
+                o.structure = Structure::Banded;
+            } else if (arg == "--density") {
+                o.density = atof(value.c_str());
+                o.structure = Structure::Sparse;
+            } else if (arg == "--seed") {
+                o.seed = strtoull(value.c_str(), nullptr, 10);
+                seeded = true;
+            } else if (arg == "--out") {
+                o.filename = value;
+            } else if (arg == "--format" && (value == "text" || value == "binary")) {
+                o.binary = (value == "binary");
+            } else if (arg == "--structure" && value == "dense") {
+                o.structure = Structure::Dense;
+            } else if (arg == "--structure" && value == "banded") {
+                o.structure = Structure::Banded;
+            } else if (arg == "--structure" && value == "sparse") {
+                o.structure = Structure::Sparse;
+            } else {
+                cout << "Error: Unknown option " << arg << " " << value << ".\n";
+                return false;
+            }
+        }
+    }
+    if (!seeded) {
+        o.seed = (uint64_t)time(0);
+    }
+
+    if (o.rows <= 0 || o.cols <= 0) {
+        cout << "Error: Matrix dimensions must be positive.\n";
+        return false;
+    }
+    if (o.symmetric && o.rows != o.cols) {
+        cout << "Error: Symmetric matrices must be square.\n";
+        return false;
+    }
+    if (o.bandwidth < 0 || o.density < 0.0 || o.density > 1.0) {
+        cout << "Error: Bandwidth must be non-negative and density within [0, 1].\n";
+        return false;
+    }
+    if (o.filename.empty()) {
+        cout << "Error: No output name given (--out).\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorOptions options;
+    if (argc > 1) {
+        if (!parseOptions(argc, argv, options)) {
+            usage();
+            return 1;
+        }
+        return generateMatrix(options) ? 0 : 1;
+    }
+
     int rows, cols;
     string filename;
     char squareChoice, symmetricChoice;
     bool isSquare, isSymmetric = false;
-    
+
     cout << "Do you want to generate a square matrix (NxN)? (y/n): ";
     cin >> squareChoice;
-    
+
     isSquare = (squareChoice == 'y' || squareChoice == 'Y');
-    
+
     if (isSquare) {
         cout << "Enter matrix size (N for NxN): ";
         cin >> rows;
         cols = rows;
-        
+
         cout << "Generate a symmetric matrix? (y/n): ";
         cin >> symmetricChoice;
         isSymmetric = (symmetricChoice == 'y' || symmetricChoice == 'Y');
@@ -108,16 +326,19 @@ int main() {
         cout << "Enter number of columns (M for NxM): ";
         cin >> cols;
     }
-    
+
     if (rows <= 0 || cols <= 0) {
         cout << "Error: Matrix dimensions must be positive.\n";
         return 1;
     }
-    
+
     cout << "Enter filename (without extension): ";
     cin >> filename;
-    
-    generateDiagonallyDominantMatrix(rows, cols, filename, isSymmetric);
-    
-    return 0;
+
+    options.rows = rows;
+    options.cols = cols;
+    options.symmetric = isSymmetric;
+    options.seed = (uint64_t)time(0);
+    options.filename = filename;
+    return generateMatrix(options) ? 0 : 1;
 }
@@ -0,0 +1,452 @@
+#include "krylov.hpp"
+#include "gemm.hpp"
+#include "threadpool.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Vector entries per thread task. Dot products are summed per tile and the
+// tile sums added in order, so results do not depend on the thread count.
+const int VEC_TILE = 4096;
+
+// Dense matrix rows per thread task in DenseOperator::apply
+const int DENSE_ROW_TILE = 16;
+
+double dot(const vector<double>& a, const vector<double>& b) {
+    int n = (int)a.size();
+    vector<double> partial((n + VEC_TILE - 1) / VEC_TILE, 0.0);
+    parallelTiles(n, 1, VEC_TILE, 1, [&](int i0, int i1, int, int) {
+        double s = 0.0;
+        for (int i = i0; i < i1; i++) {
+            s += a[i] * b[i];
+        }
+        partial[i0 / VEC_TILE] = s;
+    });
+    double s = 0.0;
+    for (double p : partial) {
+        s += p;
+    }
+    return s;
+}
+
+double norm(const vector<double>& a) {
+    return sqrt(dot(a, a));
+}
+
+// y += alpha * x
+void axpy(double alpha, const vector<double>& x, vector<double>& y) {
+    parallelTiles((int)x.size(), 1, VEC_TILE, 1, [&](int i0, int i1, int, int) {
+        for (int i = i0; i < i1; i++) {
+            y[i] += alpha * x[i];
+        }
+    });
+}
+
+void precondition(const Preconditioner* M, const vector<double>& r, vector<double>& z) {
+    if (M) {
+        M->apply(r, z);
+    } else {
+        z = r;
+    }
+}
+
+// Common argument checks; fills in a zero solution, already converged when
+// b = 0 and there is nothing to iterate on
+Status start(const LinearOperator& A, const vector<double>& b, IterativeResult& result, double& bnorm) {
+    result.iterations = 0;
+    result.converged = false;
+    if ((int)b.size() != A.size()) {
+        return Status(StatusCode::DimensionMismatch, "Vector b must have the same size as matrix rows");
+    }
+    result.x.assign(b.size(), 0.0);
+    bnorm = norm(b);
+    result.converged = (bnorm == 0.0);
+    return Status();
+}
+
+// Residual trajectory and iteration count of a finished solve
+void record(const char* residualName, const char* iterationsName, const IterativeResult& result) {
+    if (!telemetryEnabled) {
+        return;
+    }
+    for (size_t k = 0; k < result.residualHistory.size(); k++) {
+        telemetrySample(residualName, (long long)k + 1, result.residualHistory[k]);
+    }
+    telemetryCount(iterationsName, result.iterations);
+}
+
+}
+
+void DenseOperator::apply(const vector<double>& x, vector<double>& y) const {
+    int n = A.getRows();
+    int m = A.getCols();
+    y.resize(n);
+    parallelTiles(n, m, DENSE_ROW_TILE, m, [&](int i0, int i1, int, int) {
+        for (int i = i0; i < i1; i++) {
+            y[i] = dotProduct(&A(i, 0), x.data(), m);
+        }
+    });
+}
+
+JacobiPreconditioner::JacobiPreconditioner(const Matrix& A) : invDiag(min(A.getRows(), A.getCols())) {
+    for (int i = 0; i < (int)invDiag.size(); i++) {
+        double d = A(i, i);
+        invDiag[i] = (d != 0.0) ? 1.0 / d : 1.0;
+    }
+}
+
+JacobiPreconditioner::JacobiPreconditioner(const SparseMatrix& A) : invDiag(A.diagonal()) {
+    for (double& d : invDiag) {
+        d = (d != 0.0) ? 1.0 / d : 1.0;
+    }
+}
+
+void JacobiPreconditioner::apply(const vector<double>& r, vector<double>& z) const {
+    z.resize(r.size());
+    parallelTiles((int)r.size(), 1, VEC_TILE, 1, [&](int i0, int i1, int, int) {
+        for (int i = i0; i < i1; i++) {
+            z[i] = r[i] * invDiag[i];
+        }
+    });
+}
+
+ILU0Preconditioner::ILU0Preconditioner(const SparseMatrix& A)
+    : n(A.getRows()), rowPtr(A.rowPointers()), colIdx(A.columnIndices()),
+      values(A.nonZeroValues()), diagPos(n, -1), valid(false) {
+    if (A.getRows() != A.getCols()) {
+        failure = Status(StatusCode::NotSquare, "Matrix must be square for ILU(0)");
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+            if (colIdx[k] == i) {
+                diagPos[i] = k;
+            }
+        }
+        if (diagPos[i] < 0) {
+            failure = Status(StatusCode::ZeroDiagonal, "ILU(0) needs every diagonal entry stored");
+            return;
+        }
+    }
+
+    // IKJ elimination restricted to the pattern: for each l_ik, subtract
+    // l_ik * (row k of U) from the entries row i already has
+    vector<int> pos(n, -1);
+    for (int i = 0; i < n; i++) {
+        for (int k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+            pos[colIdx[k]] = k;
+        }
+        for (int k = rowPtr[i]; k < diagPos[i]; k++) {
+            int c = colIdx[k];
+            double pivot = values[diagPos[c]];
+            if (pivot == 0.0) {
+                failure = Status(StatusCode::Singular, "ILU(0) hit a zero pivot");
+                return;
+            }
+            double l = values[k] / pivot;
+            values[k] = l;
+            for (int p = diagPos[c] + 1; p < rowPtr[c + 1]; p++) {
+                int q = pos[colIdx[p]];
+                if (q >= 0) {
+                    values[q] -= l * values[p];
+                }
+            }
+        }
+        for (int k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+            pos[colIdx[k]] = -1;
+        }
+        if (values[diagPos[i]] == 0.0) {
+            failure = Status(StatusCode::Singular, "ILU(0) hit a zero pivot");
+            return;
+        }
+    }
+    valid = true;
+}
+
+void ILU0Preconditioner::apply(const vector<double>& r, vector<double>& z) const {
+    z = r;
+    if (!valid) {
+        return;
+    }
+    // L y = r, L unit lower triangular
+    for (int i = 0; i < n; i++) {
+        double s = z[i];
+        for (int k = rowPtr[i]; k < diagPos[i]; k++) {
+            s -= values[k] * z[colIdx[k]];
+        }
+        z[i] = s;
+    }
+    // U z = y
+    for (int i = n - 1; i >= 0; i--) {
+        double s = z[i];
+        for (int k = diagPos[i] + 1; k < rowPtr[i + 1]; k++) {
+            s -= values[k] * z[colIdx[k]];
+        }
+        z[i] = s / values[diagPos[i]];
+    }
+}
+
+// Preconditioned Conjugate Gradient
+Result<IterativeResult> conjugateGradient(const LinearOperator& A, const vector<double>& b,
+                                          const Preconditioner* M, int maxIterations, double tolerance) {
+    TELEMETRY_SCOPE("cg");
+    IterativeResult result;
+    double bnorm;
+    Status checked = start(A, b, result, bnorm);
+    if (!checked) {
+        return checked;
+    }
+    if (result.converged) {
+        return result;
+    }
+    vector<double>& x = result.x;
+
+    vector<double> r = b;
+    vector<double> z, q;
+    precondition(M, r, z);
+    vector<double> p = z;
+    double rz = dot(r, z);
+
+    for (int iter = 0; iter < maxIterations; iter++) {
+        A.apply(p, q);
+        double pq = dot(p, q);
+        if (pq == 0.0) {
+            break;
+        }
+        double alpha = rz / pq;
+        axpy(alpha, p, x);
+        axpy(-alpha, q, r);
+
+        double res = norm(r) / bnorm;
+        result.residualHistory.push_back(res);
+        result.iterations = iter + 1;
+        if (res <= tolerance) {
+            result.converged = true;
+            break;
+        }
+
+        precondition(M, r, z);
+        double rzNew = dot(r, z);
+        double beta = rzNew / rz;
+        rz = rzNew;
+        parallelTiles((int)p.size(), 1, VEC_TILE, 1, [&](int i0, int i1, int, int) {
+            for (int i = i0; i < i1; i++) {
+                p[i] = z[i] + beta * p[i];
+            }
+        });
+    }
+    record("cg.residual", "cg.iterations", result);
+    return result;
+}
+
+// BiCGSTAB (van der Vorst), right preconditioning so the residual that is
+// monitored is the true one
+Result<IterativeResult> biCGSTAB(const LinearOperator& A, const vector<double>& b,
+                                 const Preconditioner* M, int maxIterations, double tolerance) {
+    TELEMETRY_SCOPE("bicgstab");
+    IterativeResult result;
+    double bnorm;
+    Status checked = start(A, b, result, bnorm);
+    if (!checked) {
+        return checked;
+    }
+    if (result.converged) {
+        return result;
+    }
+    vector<double>& x = result.x;
+    int n = (int)b.size();
+
+    vector<double> r = b;
+    vector<double> rHat = r;
+    vector<double> p(n, 0.0), v(n, 0.0), s(n), t(n), pHat, sHat;
+    double rho = 1.0, alpha = 1.0, omega = 1.0;
+
+    // The recurred residual drifts away from b - A x when it grows large on
+    // the way down, so convergence is checked against the true residual and
+    // the iteration restarts from the current x when that check fails
+    auto confirm = [&](double& res) {
+        A.apply(x, r);
+        for (int i = 0; i < n; i++) {
+            r[i] = b[i] - r[i];
+        }
+        res = norm(r) / bnorm;
+        if (res <= tolerance) {
+            return true;
+        }
+        rHat = r;
+        rho = alpha = omega = 1.0;
+        fill(p.begin(), p.end(), 0.0);
+        fill(v.begin(), v.end(), 0.0);
+        return false;
+    };
+
+    for (int iter = 0; iter < maxIterations; iter++) {
+        double rhoNew = dot(rHat, r);
+        if (rhoNew == 0.0) {
+            break;  // breakdown: r is orthogonal to the shadow residual
+        }
+        double beta = (rhoNew / rho) * (alpha / omega);
+        rho = rhoNew;
+        parallelTiles(n, 1, VEC_TILE, 1, [&](int i0, int i1, int, int) {
+            for (int i = i0; i < i1; i++) {
+                p[i] = r[i] + beta * (p[i] - omega * v[i]);
+            }
+        });
+
+        precondition(M, p, pHat);
+        A.apply(pHat, v);
+        double rv = dot(rHat, v);
+        if (rv == 0.0) {
+            break;
+        }
+        alpha = rho / rv;
+        parallelTiles(n, 1, VEC_TILE, 1, [&](int i0, int i1, int, int) {
+            for (int i = i0; i < i1; i++) {
+                s[i] = r[i] - alpha * v[i];
+            }
+        });
+
+        result.iterations = iter + 1;
+        double res = norm(s) / bnorm;
+        if (res <= tolerance) {
+            axpy(alpha, pHat, x);
+            result.converged = confirm(res);
+            result.residualHistory.push_back(res);
+            if (result.converged) {
+                break;
+            }
+            continue;
+        }
+
+        precondition(M, s, sHat);
+        A.apply(sHat, t);
+        double tt = dot(t, t);
+        omega = (tt == 0.0) ? 0.0 : dot(t, s) / tt;
+        parallelTiles(n, 1, VEC_TILE, 1, [&](int i0, int i1, int, int) {
+            for (int i = i0; i < i1; i++) {
+                x[i] += alpha * pHat[i] + omega * sHat[i];
+                r[i] = s[i] - omega * t[i];
+            }
+        });
+
+        res = norm(r) / bnorm;
+        if (res <= tolerance) {
+            result.converged = confirm(res);
+        }
+        result.residualHistory.push_back(res);
+        if (result.converged || omega == 0.0) {
+            break;
+        }
+    }
+    record("bicgstab.residual", "bicgstab.iterations", result);
+    return result;
+}
+
+// Restarted GMRES with modified Gram-Schmidt and Givens rotations, right
+// preconditioned: solves A M^-1 u = b and returns x = M^-1 u.
+Result<IterativeResult> gmres(const LinearOperator& A, const vector<double>& b,
+                              const Preconditioner* M, int restart, int maxIterations, double tolerance) {
+    TELEMETRY_SCOPE("gmres");
+    IterativeResult result;
+    double bnorm;
+    Status checked = start(A, b, result, bnorm);
+    if (!checked) {
+        return checked;
+    }
+    if (result.converged) {
+        return result;
+    }
+    vector<double>& x = result.x;
+    int n = (int)b.size();
+    int m = max(1, min(restart, n));
+
+    vector<vector<double>> V(m + 1, vector<double>(n));
+    vector<vector<double>> H(m + 1, vector<double>(m, 0.0));  // Hessenberg, then R
+    vector<double> cs(m), sn(m), g(m + 1), y(m);
+    vector<double> r, w, z;
+
+    bool breakdown = false;
+    while (result.iterations < maxIterations && !result.converged && !breakdown) {
+        A.apply(x, r);
+        for (int i = 0; i < n; i++) {
+            r[i] = b[i] - r[i];
+        }
+        double beta = norm(r);
+        if (beta / bnorm <= tolerance) {
+            result.converged = true;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            V[0][i] = r[i] / beta;
+        }
+        fill(g.begin(), g.end(), 0.0);
+        g[0] = beta;
+
+        int k = 0;
+        while (k < m && result.iterations < maxIterations) {
+            precondition(M, V[k], z);
+            A.apply(z, w);
+            for (int i = 0; i <= k; i++) {
+                H[i][k] = dot(w, V[i]);
+                axpy(-H[i][k], V[i], w);
+            }
+            double hNext = norm(w);
+            H[k + 1][k] = hNext;
+            if (hNext != 0.0) {
+                for (int i = 0; i < n; i++) {
+                    V[k + 1][i] = w[i] / hNext;
+                }
+            }
+
+            // Fold the new column into the QR factorization of H
+            for (int i = 0; i < k; i++) {
+                double h = cs[i] * H[i][k] + sn[i] * H[i + 1][k];
+                H[i + 1][k] = -sn[i] * H[i][k] + cs[i] * H[i + 1][k];
+                H[i][k] = h;
+            }
+            double d = hypot(H[k][k], H[k + 1][k]);
+            if (d == 0.0) {
+                breakdown = true;  // A M^-1 is singular on this Krylov space
+                break;
+            }
+            cs[k] = H[k][k] / d;
+            sn[k] = H[k + 1][k] / d;
+            H[k][k] = d;
+            H[k + 1][k] = 0.0;
+            g[k + 1] = -sn[k] * g[k];
+            g[k] = cs[k] * g[k];
+
+            k++;
+            result.iterations++;
+            double res = fabs(g[k]) / bnorm;
+            result.residualHistory.push_back(res);
+            if (res <= tolerance) {
+                result.converged = true;
+                break;
+            }
+            if (hNext == 0.0) {
+                break;  // the Krylov space is invariant, so x is exact
+            }
+        }
+
+        // y = R^-1 g, then x += M^-1 (V y)
+        for (int i = k - 1; i >= 0; i--) {
+            double s = g[i];
+            for (int j = i + 1; j < k; j++) {
+                s -= H[i][j] * y[j];
+            }
+            y[i] = s / H[i][i];
+        }
+        vector<double> u(n, 0.0);
+        for (int j = 0; j < k; j++) {
+            axpy(y[j], V[j], u);
+        }
+        precondition(M, u, z);
+        axpy(1.0, z, x);
+    }
+    record("gmres.residual", "gmres.iterations", result);
+    return result;
+}
@@ -0,0 +1,94 @@
+#ifndef KRYLOV_HPP
+#define KRYLOV_HPP
+#include "matrix.hpp"
+#include "sparse.hpp"
+
+// Square operator y = A x. The Krylov solvers below only ever touch A
+// through apply(), so dense, sparse and matrix-free operators all work.
+class LinearOperator {
+public:
+    virtual ~LinearOperator() {}
+    virtual int size() const = 0;
+    virtual void apply(const vector<double>& x, vector<double>& y) const = 0;
+};
+
+class DenseOperator : public LinearOperator {
+private:
+    const Matrix& A;
+
+public:
+    explicit DenseOperator(const Matrix& m) : A(m) {}
+    int size() const override { return A.getRows(); }
+    void apply(const vector<double>& x, vector<double>& y) const override;
+};
+
+class SparseOperator : public LinearOperator {
+private:
+    const SparseMatrix& A;
+
+public:
+    explicit SparseOperator(const SparseMatrix& m) : A(m) {}
+    int size() const override { return A.getRows(); }
+    void apply(const vector<double>& x, vector<double>& y) const override { A.multiply(x, y); }
+};
+
+// z = M^-1 r for some M close to A that is cheap to invert
+class Preconditioner {
+public:
+    virtual ~Preconditioner() {}
+    virtual void apply(const vector<double>& r, vector<double>& z) const = 0;
+};
+
+// M = diag(A). Zero diagonal entries are left unscaled.
+class JacobiPreconditioner : public Preconditioner {
+private:
+    vector<double> invDiag;
+
+public:
+    explicit JacobiPreconditioner(const Matrix& A);
+    explicit JacobiPreconditioner(const SparseMatrix& A);
+    void apply(const vector<double>& r, vector<double>& z) const override;
+};
+
+// M = L U where L and U keep exactly the sparsity pattern of A (no
+// fill-in). A must have every diagonal entry stored; on a zero pivot the
+// factorization is abandoned, status() says why, and apply() falls back to
+// the identity.
+class ILU0Preconditioner : public Preconditioner {
+private:
+    int n;
+    vector<int> rowPtr;
+    vector<int> colIdx;
+    vector<double> values;  // L below the diagonal (unit diagonal implied), U on and above
+    vector<int> diagPos;
+    bool valid;
+    Status failure;
+
+public:
+    explicit ILU0Preconditioner(const SparseMatrix& A);
+    bool isValid() const { return valid; }
+    const Status& status() const { return failure; }
+    void apply(const vector<double>& r, vector<double>& z) const override;
+};
+
+// All three start from x = 0 and stop once ||b - A x|| <= tolerance * ||b||.
+// Passing a null preconditioner runs the unpreconditioned method. They fail
+// only on a size mismatch; running out of iterations gives converged == false.
+
+// Symmetric positive definite A; M must be SPD too
+Result<IterativeResult> conjugateGradient(const LinearOperator& A, const vector<double>& b,
+                                          const Preconditioner* M = nullptr,
+                                          int maxIterations = 1000, double tolerance = 1e-8);
+
+// General A, right-preconditioned
+Result<IterativeResult> biCGSTAB(const LinearOperator& A, const vector<double>& b,
+                                 const Preconditioner* M = nullptr,
+                                 int maxIterations = 1000, double tolerance = 1e-8);
+
+// General A, right-preconditioned, restarted every `restart` iterations.
+// Memory is restart + 1 vectors of length n.
+Result<IterativeResult> gmres(const LinearOperator& A, const vector<double>& b,
+                              const Preconditioner* M = nullptr, int restart = 30,
+                              int maxIterations = 1000, double tolerance = 1e-8);
+
+#endif
@@ -0,0 +1,406 @@
+#include "lu.hpp"
+#include "gemm.hpp"
+#include "threadpool.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Panel width. Wide enough that the trailing GEMM runs near full speed,
+// narrow enough that the unblocked panel stays a small share of the work.
+const int NB = 128;
+
+// Column slice of the U block row handled by one thread task.
+const int TRSM_TILE = 256;
+
+// Right-hand sides per thread task in the multi-RHS solve, and the row
+// block of the triangular factors solved directly before a GEMM update.
+const int RHS_BLOCK = 32;
+const int SOLVE_NB = 128;
+
+// Pivots smaller than this make the system numerically singular, matching
+// the threshold used by gaussianElimination.
+const double singularPivot = 1e-10;
+
+// Unblocked LU of the panel of columns [k0, k0 + kb) from row k0 down.
+// Pivot rows are swapped across the whole width, which also applies the
+// interchange to the factored columns on the left and the trailing matrix
+// on the right.
+template<typename T>
+void factorPanel(T* A, int ld, int n, int k0, int kb, int* pivots, int& swaps,
+                 TelemetryPhase& pivotSearch, TelemetryPhase& elimination) {
+    int kend = k0 + kb;
+    for (int j = k0; j < kend; j++) {
+        pivotSearch.begin();
+        int p = j;
+        T best = fabs(A[(size_t)j * ld + j]);
+        for (int i = j + 1; i < n; i++) {
+            T v = fabs(A[(size_t)i * ld + j]);
+            if (v > best) {
+                best = v;
+                p = i;
+            }
+        }
+        pivots[j] = p;
+        if (p != j) {
+            swap_ranges(A + (size_t)j * ld, A + (size_t)j * ld + n, A + (size_t)p * ld);
+            swaps++;
+        }
+        pivotSearch.end();
+
+        T d = A[(size_t)j * ld + j];
+        if (d == 0) {
+            continue;  // nothing to eliminate; the caller records singularity
+        }
+        elimination.begin();
+        T inv = 1 / d;
+        const T* pivotRow = A + (size_t)j * ld;
+        int below = n - j - 1;
+        parallelTiles(below, kend - j, 64, kend - j, [=](int i0, int i1, int, int) {
+            for (int i = j + 1 + i0; i < j + 1 + i1; i++) {
+                T* row = A + (size_t)i * ld;
+                T l = row[j] * inv;
+                row[j] = l;
+                for (int c = j + 1; c < kend; c++) {
+                    row[c] -= l * pivotRow[c];
+                }
+            }
+        });
+        elimination.end();
+    }
+}
+
+// PA = LU in place on the n x n matrix at A. Returns whether some pivot is
+// numerically zero.
+template<typename T>
+bool factorBlocked(T* A, int ld, int n, int* pivots, int& swaps) {
+    TELEMETRY_SCOPE("lu.factor");
+    TelemetryPhase pivotSearch("lu.pivot_search");
+    TelemetryPhase elimination("lu.panel_elimination");
+    TelemetryPhase trsm("lu.trsm");
+    TelemetryPhase update("lu.trailing_update");
+
+    for (int k0 = 0; k0 < n; k0 += NB) {
+        int kb = min(NB, n - k0);
+        int kend = k0 + kb;
+        factorPanel(A, ld, n, k0, kb, pivots, swaps, pivotSearch, elimination);
+
+        int right = n - kend;
+        if (right == 0) {
+            continue;
+        }
+
+        // U12 = L11^-1 * A12, row by row; independent across column slices
+        trsm.begin();
+        parallelTiles(kb, right, kb, TRSM_TILE, [=](int, int, int j0, int j1) {
+            for (int i = k0 + 1; i < kend; i++) {
+                T* rowI = A + (size_t)i * ld + kend;
+                for (int p = k0; p < i; p++) {
+                    T l = A[(size_t)i * ld + p];
+                    const T* rowP = A + (size_t)p * ld + kend;
+                    for (int j = j0; j < j1; j++) {
+                        rowI[j] -= l * rowP[j];
+                    }
+                }
+            }
+        });
+        trsm.end();
+
+        // A22 -= L21 * U12
+        update.begin();
+        gemm(right, right, kb, T(-1), A + (size_t)kend * ld + k0, ld,
+             A + (size_t)k0 * ld + kend, ld, T(1), A + (size_t)kend * ld + kend, ld);
+        update.end();
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (fabs(A[(size_t)i * ld + i]) < singularPivot) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Overwrites the nrhs columns of B (column r at B + r * ldb) with the
+// solutions for the factorization packed at A with pivots piv.
+template<typename T>
+void solveBlocked(const T* A, int ld, int n, const int* piv, T* B, int ldb, int nrhs) {
+    int blocks = (nrhs + RHS_BLOCK - 1) / RHS_BLOCK;
+    TELEMETRY_SCOPE("lu.solve_many");
+
+    // Seen from the right-hand sides, a block of columns is a row-major
+    // nr x n matrix X^T, so the updates below are X^T -= X^T * F^T for the
+    // triangular factor F.
+    ThreadPool::instance().run(blocks, [=](int t) {
+        int r0 = t * RHS_BLOCK;
+        int nr = min(RHS_BLOCK, nrhs - r0);
+        T* X = B + (size_t)r0 * ldb;
+
+        for (int r = 0; r < nr; r++) {
+            T* x = X + (size_t)r * ldb;
+            for (int i = 0; i < n; i++) {
+                if (piv[i] != i) {
+                    swap(x[i], x[piv[i]]);
+                }
+            }
+        }
+
+        // Ly = Pb, L unit lower triangular
+        for (int i0 = 0; i0 < n; i0 += SOLVE_NB) {
+            int ib = min(SOLVE_NB, n - i0);
+            for (int r = 0; r < nr; r++) {
+                T* x = X + (size_t)r * ldb;
+                for (int i = i0; i < i0 + ib; i++) {
+                    const T* row = A + (size_t)i * ld;
+                    T sum = x[i];
+                    for (int p = i0; p < i; p++) {
+                        sum -= row[p] * x[p];
+                    }
+                    x[i] = sum;
+                }
+            }
+            int below = n - i0 - ib;
+            if (below > 0) {
+                gemm(false, true, nr, below, ib, T(-1), X + i0, ldb,
+                     A + (size_t)(i0 + ib) * ld + i0, ld, T(1), X + i0 + ib, ldb);
+            }
+        }
+
+        // Ux = y
+        for (int i0 = (n - 1) / SOLVE_NB * SOLVE_NB; i0 >= 0; i0 -= SOLVE_NB) {
+            int ib = min(SOLVE_NB, n - i0);
+            for (int r = 0; r < nr; r++) {
+                T* x = X + (size_t)r * ldb;
+                for (int i = i0 + ib - 1; i >= i0; i--) {
+                    const T* row = A + (size_t)i * ld;
+                    T sum = x[i];
+                    for (int p = i + 1; p < i0 + ib; p++) {
+                        sum -= row[p] * x[p];
+                    }
+                    x[i] = sum / row[i];
+                }
+            }
+            if (i0 > 0) {
+                gemm(false, true, nr, i0, ib, T(-1), X + i0, ldb, A + i0, ld, T(1), X, ldb);
+            }
+        }
+    });
+}
+
+}
+
+LUFactorization::LUFactorization()
+    : swaps(0), singular(true), failure(StatusCode::InvalidArgument, "Nothing has been factored") {}
+
+LUFactorization::LUFactorization(const Matrix& A) : lu(A), swaps(0), singular(false) {
+    if (A.getRows() != A.getCols()) {
+        lu = Matrix();
+        singular = true;
+        failure = Status(StatusCode::NotSquare, "Matrix must be square for LU decomposition");
+        return;
+    }
+    factor();
+}
+
+void LUFactorization::factor() {
+    int n = lu.getRows();
+    pivots.assign(n, 0);
+    singular = factorBlocked(lu.raw(), lu.stride(), n, pivots.data(), swaps);
+    if (singular) {
+        failure = Status(StatusCode::Singular, "Matrix is singular or nearly singular");
+    }
+}
+
+Status LUFactorization::checkSolve(bool sizesMatch) const {
+    if (!failure) {
+        return failure;
+    }
+    if (!sizesMatch) {
+        return Status(StatusCode::DimensionMismatch, "Dimensions mismatch in LU solver");
+    }
+    return Status();
+}
+
+Matrix LUFactorization::lower() const {
+    int n = size();
+    Matrix L(n, n);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < i; j++) {
+            L(i, j) = lu(i, j);
+        }
+        L(i, i) = 1.0;
+    }
+    return L;
+}
+
+Matrix LUFactorization::upper() const {
+    int n = size();
+    Matrix U(n, n);
+    for (int i = 0; i < n; i++) {
+        for (int j = i; j < n; j++) {
+            U(i, j) = lu(i, j);
+        }
+    }
+    return U;
+}
+
+vector<double> LUFactorization::solve(const vector<double>& b) const {
+    return trySolve(b).value();
+}
+
+Result<vector<double>> LUFactorization::trySolve(const vector<double>& b) const {
+    int n = size();
+    Status checked = checkSolve((int)b.size() == n);
+    if (!checked) {
+        return checked;
+    }
+
+    vector<double> x = b;
+    for (int i = 0; i < n; i++) {
+        if (pivots[i] != i) {
+            swap(x[i], x[pivots[i]]);
+        }
+    }
+
+    // Ly = Pb, L unit lower triangular
+    TelemetryPhase forward("lu.forward_substitution");
+    TelemetryPhase backward("lu.back_substitution");
+    forward.begin();
+    for (int i = 0; i < n; i++) {
+        const double* row = &lu(i, 0);
+        double sum = x[i];
+        for (int j = 0; j < i; j++) {
+            sum -= row[j] * x[j];
+        }
+        x[i] = sum;
+    }
+    forward.end();
+
+    // Ux = y
+    backward.begin();
+    for (int i = n - 1; i >= 0; i--) {
+        const double* row = &lu(i, 0);
+        double sum = x[i];
+        for (int j = i + 1; j < n; j++) {
+            sum -= row[j] * x[j];
+        }
+        x[i] = sum / row[i];
+    }
+    backward.end();
+    return x;
+}
+
+Matrix LUFactorization::solveMany(const Matrix& B) const {
+    int n = size();
+    if (!checkSolve(B.getRows() == n)) {
+        return Matrix();
+    }
+
+    // Columns of B become contiguous right-hand sides and back again
+    int m = B.getCols();
+    vector<double> cols((size_t)n * m);
+    for (int i = 0; i < n; i++) {
+        for (int r = 0; r < m; r++) {
+            cols[(size_t)r * n + i] = B(i, r);
+        }
+    }
+    solveInPlace(cols.data(), n, m);
+    Matrix X(n, m);
+    for (int i = 0; i < n; i++) {
+        for (int r = 0; r < m; r++) {
+            X(i, r) = cols[(size_t)r * n + i];
+        }
+    }
+    return X;
+}
+
+vector<double> LUFactorization::solveMany(const vector<double>& B, int nrhs) const {
+    return trySolveMany(B, nrhs).value();
+}
+
+Result<vector<double>> LUFactorization::trySolveMany(const vector<double>& B, int nrhs) const {
+    int n = size();
+    Status checked = checkSolve(nrhs >= 0 && B.size() == (size_t)n * nrhs);
+    if (!checked) {
+        return checked;
+    }
+    vector<double> X = B;
+    solveInPlace(X.data(), n, nrhs);
+    return X;
+}
+
+void LUFactorization::solveInPlace(double* B, int ldb, int nrhs) const {
+    solveBlocked(lu.raw(), lu.stride(), size(), pivots.data(), B, ldb, nrhs);
+}
+
+double LUFactorization::determinant() const {
+    int n = size();
+    double det = (swaps % 2 == 0) ? 1.0 : -1.0;
+    for (int i = 0; i < n; i++) {
+        det *= lu(i, i);
+    }
+    return det;
+}
+
+Matrix LUFactorization::inverse() const {
+    int n = size();
+    Matrix I(n, n);
+    for (int i = 0; i < n; i++) {
+        I(i, i) = 1.0;
+    }
+    return solveMany(I);
+}
+
+template<typename T>
+BasicLUFactorization<T>::BasicLUFactorization()
+    : swaps(0), singular(true), failure(StatusCode::InvalidArgument, "Nothing has been factored") {}
+
+template<typename T>
+BasicLUFactorization<T>::BasicLUFactorization(const BasicMatrix<T>& A) : lu(A), swaps(0), singular(false) {
+    int n = A.getRows();
+    if (n != A.getCols()) {
+        lu = BasicMatrix<T>();
+        singular = true;
+        failure = Status(StatusCode::NotSquare, "Matrix must be square for LU decomposition");
+        return;
+    }
+    pivots.assign(n, 0);
+    singular = factorBlocked(lu.raw(), lu.stride(), n, pivots.data(), swaps);
+    if (singular) {
+        failure = Status(StatusCode::Singular, "Matrix is singular or nearly singular");
+    }
+}
+
+template<typename T>
+Result<vector<T>> BasicLUFactorization<T>::trySolve(const vector<T>& b) const {
+    if (!failure) {
+        return failure;
+    }
+    if ((int)b.size() != size()) {
+        return Result<vector<T>>(StatusCode::DimensionMismatch, "Dimensions mismatch in LU solver");
+    }
+    vector<T> x = b;
+    solveInPlace(x.data(), size(), 1);
+    return x;
+}
+
+template<typename T>
+void BasicLUFactorization<T>::solveInPlace(T* B, int ldb, int nrhs) const {
+    solveBlocked(lu.raw(), lu.stride(), size(), pivots.data(), B, ldb, nrhs);
+}
+
+template<typename T>
+T BasicLUFactorization<T>::determinant() const {
+    int n = size();
+    T det = (swaps % 2 == 0) ? 1 : -1;
+    for (int i = 0; i < n; i++) {
+        det *= lu(i, i);
+    }
+    return det;
+}
+
+template class BasicLUFactorization<float>;
+template class BasicLUFactorization<double>;
+template class BasicLUFactorization<long double>;
@@ -0,0 +1,91 @@
+#ifndef LU_HPP
+#define LU_HPP
+#include "matrix.hpp"
+#include "precision.hpp"
+
+// PA = LU with partial pivoting, computed once and reused for any number of
+// solves. L (unit diagonal, not stored) and U share one packed n x n buffer;
+// pivots[i] is the row that was swapped with row i at step i.
+//
+// The factorization is blocked and right-looking: each NB-wide panel is
+// factored with an unblocked kernel, the block row of U is finished with a
+// triangular solve, and the trailing matrix gets one rank-NB GEMM update,
+// which is where nearly all the flops go.
+class LUFactorization {
+private:
+    Matrix lu;
+    vector<int> pivots;
+    int swaps;
+    bool singular;
+    Status failure;  // why there is no usable factorization
+
+    void factor();
+    Status checkSolve(bool sizesMatch) const;
+
+public:
+    LUFactorization();
+    explicit LUFactorization(const Matrix& A);
+
+    int size() const { return lu.getRows(); }
+    bool isSingular() const { return singular; }
+    const Status& status() const { return failure; }
+    const Matrix& packed() const { return lu; }
+    const vector<int>& pivotVector() const { return pivots; }
+
+    Matrix lower() const;
+    Matrix upper() const;
+
+    // Solve Ax = b, or AX = B for every column of B at once. These return
+    // an empty result on a singular or mismatched system; the try forms
+    // say which.
+    vector<double> solve(const vector<double>& b) const;
+    Result<vector<double>> trySolve(const vector<double>& b) const;
+    Matrix solveMany(const Matrix& B) const;
+
+    // AX = B for nrhs right-hand sides stored column-major: column r is
+    // the n values starting at B[r * n]. Returns X in the same layout.
+    vector<double> solveMany(const vector<double>& B, int nrhs) const;
+    Result<vector<double>> trySolveMany(const vector<double>& B, int nrhs) const;
+
+    // Same, overwriting B (column r at B + r * ldb) with X. Columns are
+    // processed in blocks, one thread task per block; within a block the
+    // triangular solves are blocked so the off-diagonal work is GEMM.
+    void solveInPlace(double* B, int ldb, int nrhs) const;
+
+    double determinant() const;
+    Matrix inverse() const;
+};
+
+// The same factorization in another precision, sharing the kernels above:
+// float for the mixed-precision solver, long double for headroom. Defined
+// for float, double and long double.
+template<typename T>
+class BasicLUFactorization {
+private:
+    BasicMatrix<T> lu;
+    vector<int> pivots;
+    int swaps;
+    bool singular;
+    Status failure;
+
+public:
+    BasicLUFactorization();
+    explicit BasicLUFactorization(const BasicMatrix<T>& A);
+
+    int size() const { return lu.getRows(); }
+    bool isSingular() const { return singular; }
+    const Status& status() const { return failure; }
+    const BasicMatrix<T>& packed() const { return lu; }
+    const vector<int>& pivotVector() const { return pivots; }
+
+    Result<vector<T>> trySolve(const vector<T>& b) const;
+    // See LUFactorization::solveInPlace
+    void solveInPlace(T* B, int ldb, int nrhs) const;
+    T determinant() const;
+};
+
+extern template class BasicLUFactorization<float>;
+extern template class BasicLUFactorization<double>;
+extern template class BasicLUFactorization<long double>;
+
+#endif
@@ -1,16 +1,39 @@
 #include <iostream>
 #include "matrix.hpp"
+#include "lu.hpp"
+#include "cholesky.hpp"
+#include "textio.hpp"
+#include "cli.hpp"
+#include "solver.hpp"
 #include <vector>
 #include <iomanip>
 #include <fstream>
 using namespace std;
 
-// Read matrix from file
+// The library reports failures instead of printing them; the menu prints
+void printError(const Status& status) {
+    cout << status.message() << "!" << endl;
+}
+
+// Read matrix from file: the binary filename.bin (mapped, no parsing) when
+// it exists, otherwise the text filename.txt
 Matrix getMatrixFromFile(const string& matrixName) {
     string filename;
     cout << "Enter filename (without extension) for " << matrixName << ": ";
     cin >> filename;
-    return Matrix::readFromFile(filename);
+    Result<Matrix> loaded =
+        ifstream(filename + ".bin") ? Matrix::tryMapBinary(filename) : Matrix::tryReadFromFile(filename);
+    if (!loaded) {
+        printError(loaded.status());
+    }
+    return move(loaded).value();
+}
+
+void writeMatrixToFile(const Matrix& M, const string& filename) {
+    Status written = M.writeToFile(filename);
+    if (!written) {
+        printError(written);
+    }
 }
 
 // Read vector from file
@@ -19,19 +42,16 @@ vector<double> getVectorFromFile(const string& vectorName) {
     cout << "Enter filename (without extension) for " << vectorName << ": ";
     cin >> filename;
     
-    ifstream inFile(filename + ".txt");
-    if (!inFile) {
-        cout << "Error opening file for " << vectorName << "!" << endl;
+    vector<double> v;
+    TextParseError error;
+    if (!parseVectorText(filename + ".txt", v, error)) {
+        if (!error.opened) {
+            cout << "Error opening file for " << vectorName << "!" << endl;
+        } else {
+            cout << "Error reading " << describe(filename + ".txt", error) << "!" << endl;
+        }
         return vector<double>();
     }
-
-    int size;
-    inFile >> size;
-
-    vector<double> v(size);
-    for (int i = 0; i < size; ++i)
-        inFile >> v[i];
-
     return v;
 }
 
@@ -58,7 +78,12 @@ void printVector(const vector<double>& v, const string& name) {
     cout << endl;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Any arguments select the scriptable driver in cli.cpp
+    if (argc > 1) {
+        return runCli(argc, argv);
+    }
+
     string choice;
     cout << "Read matrices and vectors from file (f) or input manually (m)? ";
     cin >> choice;
@@ -107,11 +132,11 @@ int main() {
         if (A.getRows() == B.getRows() && A.getCols() == B.getCols()) {
             Matrix C = A + B;
             cout << "\nA + B:\n" << C;
-            C.writeToFile("output_addition");
+            writeMatrixToFile(C, "output_addition");
 
             Matrix D = A - B;
             cout << "\nA - B:\n" << D;
-            D.writeToFile("output_subtraction");
+            writeMatrixToFile(D, "output_subtraction");
         } else {
             cout << "\nAddition and subtraction not possible (dimension mismatch).\n";
         }
@@ -119,7 +144,7 @@ int main() {
         if (A.getCols() == B.getRows()) {
             Matrix E = A * B;
             cout << "\nA * B:\n" << E;
-            E.writeToFile("output_multiplication");
+            writeMatrixToFile(E, "output_multiplication");
         } else {
             cout << "\nMultiplication not possible (A.cols != B.rows).\n";
         }
@@ -129,7 +154,7 @@ int main() {
 
         Matrix AT = A.transpose();
         cout << "\nTranspose of A:\n" << AT;
-        AT.writeToFile("output_transpose");
+        writeMatrixToFile(AT, "output_transpose");
     }
 
     else if (mainChoice == 2) {
@@ -169,21 +194,49 @@ int main() {
         cout << "1. Gaussian Elimination\n";
         cout << "2. Gauss-Jacobi Iteration\n";
         cout << "3. Gauss-Seidel Iteration\n";
-        cout << "Enter method (1-3): ";
+        cout << "4. Conjugate Gradient (symmetric positive definite)\n";
+        cout << "5. BiCGSTAB\n";
+        cout << "6. GMRES(30)\n";
+        cout << "7. SOR (successive over-relaxation)\n";
+        cout << "8. Mixed precision (float LU, refined in double)\n";
+        cout << "9. Automatic (chosen from the structure of A)\n";
+        cout << "10. SSOR (symmetric SOR)\n";
+        cout << "Enter method (1-10): ";
         int solverChoice;
         cin >> solverChoice;
 
         switch (solverChoice) {
             case 1: {
-                vector<double> x = A.gaussianElimination(b);
-                if (!x.empty()) {
-                    printVector(x, "Solution by Gaussian Elimination");
+                Result<vector<double>> x = A.tryGaussianElimination(b);
+                if (x) {
+                    printVector(*x, "Solution by Gaussian Elimination");
+                } else {
+                    printError(x.status());
+                }
+                break;
+            }
+            case 9: {
+                SolveOptions options;
+                options.log = [](const string& line) { cout << line << "\n"; };
+                Result<SolveReport> report = solve(A, b, options);
+                if (report) {
+                    printVector(report->x, string("Solution by ") + solveMethodName(report->method()));
+                } else {
+                    printError(report.status());
                 }
                 break;
             }
             case 2:
-            case 3: {
-                cout << "Matrix is " << (A.isDiagonallyDominant() ? "" : "not ") << "diagonally dominant.\n";
+            case 3:
+            case 4:
+            case 5:
+            case 6:
+            case 7:
+            case 8:
+            case 10: {
+                if (solverChoice <= 3) {
+                    cout << "Matrix is " << (A.isDiagonallyDominant() ? "" : "not ") << "diagonally dominant.\n";
+                }
                 int maxIter;
                 double tol;
                 cout << "Enter max iterations: ";
@@ -191,12 +244,36 @@ int main() {
                 cout << "Enter tolerance: ";
                 cin >> tol;
 
-                vector<double> x = (solverChoice == 2) ?
-                    A.gaussJacobi(b, maxIter, tol) :
-                    A.gaussSeidel(b, maxIter, tol);
+                Result<IterativeResult> result = IterativeResult();
+                string method;
+                switch (solverChoice) {
+                    case 2: result = A.tryGaussJacobi(b, maxIter, tol); method = "Gauss-Jacobi"; break;
+                    case 3: result = A.tryGaussSeidel(b, maxIter, tol); method = "Gauss-Seidel"; break;
+                    case 4: result = A.tryConjugateGradient(b, maxIter, tol); method = "Conjugate Gradient"; break;
+                    case 5: result = A.tryBiCGSTAB(b, maxIter, tol); method = "BiCGSTAB"; break;
+                    case 6: result = A.tryGmres(b, 30, maxIter, tol); method = "GMRES"; break;
+                    case 8: result = A.tryMixedPrecisionSolve(b, maxIter, tol); method = "Mixed precision"; break;
+                    default: {
+                        double omega;
+                        cout << "Enter relaxation factor (0 < w < 2): ";
+                        cin >> omega;
+                        bool symmetric = solverChoice == 10;
+                        result = symmetric ? A.trySsor(b, omega, maxIter, tol) : A.trySor(b, omega, maxIter, tol);
+                        method = symmetric ? "SSOR" : "SOR";
+                        break;
+                    }
+                }
 
-                if (!x.empty()) {
-                    string method = (solverChoice == 2) ? "Gauss-Jacobi" : "Gauss-Seidel";
+                if (!result) {
+                    printError(result.status());
+                } else {
+                    if (result->converged) {
+                        cout << method << " converged after " << result->iterations << " iterations." << endl;
+                    } else {
+                        cout << method << " did not converge within " << result->iterations
+                             << " iterations." << endl;
+                    }
+                    const vector<double>& x = result->x;
                     printVector(x, "Solution by " + method);
 
                     cout << "\nVerification (A*x):\n";
@@ -236,23 +313,34 @@ int main() {
         cout << "1. Doolittle\n";
         cout << "2. Crout\n";
         cout << "3. Cholesky (for symmetric matrices)\n";
-        cout << "Enter method (1-3): ";
+        cout << "4. Blocked LU with partial pivoting (PA = LU)\n";
+        cout << "Enter method (1-4): ";
         int luChoice;
         cin >> luChoice;
 
         switch (luChoice) {
             case 1: {
-                auto [L, U] = A.luDecompositionDoolittle();
+                Result<pair<Matrix, Matrix>> LU = A.tryLuDecompositionDoolittle();
+                if (!LU) {
+                    printError(LU.status());
+                    break;
+                }
+                auto& [L, U] = *LU;
                 cout << "\nDoolittle Decomposition:\nL:\n" << L << "U:\n" << U;
-                L.writeToFile("output_doolittle_L");
-                U.writeToFile("output_doolittle_U");
+                writeMatrixToFile(L, "output_doolittle_L");
+                writeMatrixToFile(U, "output_doolittle_U");
                 break;
             }
             case 2: {
-                auto [L, U] = A.luDecompositionCrout();
+                Result<pair<Matrix, Matrix>> LU = A.tryLuDecompositionCrout();
+                if (!LU) {
+                    printError(LU.status());
+                    break;
+                }
+                auto& [L, U] = *LU;
                 cout << "\nCrout Decomposition:\nL:\n" << L << "U:\n" << U;
-                L.writeToFile("output_crout_L");
-                U.writeToFile("output_crout_U");
+                writeMatrixToFile(L, "output_crout_L");
+                writeMatrixToFile(U, "output_crout_U");
                 break;
             }
             case 3: {
@@ -260,10 +348,32 @@ int main() {
                     cout << "Matrix is not symmetric. Cholesky not applicable.\n";
                     break;
                 }
-                Matrix L = A.choleskyDecomposition();
+                // Symmetry was just checked above
+                Result<CholeskyFactorization> chol = A.tryCholeskyFactorize(false);
+                if (!chol) {
+                    printError(chol.status());
+                    break;
+                }
+                Matrix L = chol->lower();
                 Matrix LT = L.transpose();
                 cout << "\nCholesky Decomposition:\nL:\n" << L << "L^T:\n" << LT;
-                L.writeToFile("output_cholesky_L");
+                writeMatrixToFile(L, "output_cholesky_L");
+                break;
+            }
+            case 4: {
+                LUFactorization lu = A.luFactorize();
+                Matrix L = lu.lower();
+                Matrix U = lu.upper();
+                cout << "\nPivoted LU Decomposition:\nL:\n" << L << "U:\n" << U;
+                cout << "Row interchanges:";
+                for (int i = 0; i < lu.size(); i++)
+                    cout << " " << lu.pivotVector()[i];
+                cout << "\nDeterminant: " << lu.determinant() << endl;
+                if (lu.isSingular()) {
+                    cout << "Note: " << lu.status().message() << "." << endl;
+                }
+                writeMatrixToFile(L, "output_plu_L");
+                writeMatrixToFile(U, "output_plu_U");
                 break;
             }
             default:
@@ -1,162 +1,606 @@
 #include "matrix.hpp"
+#include "gemm.hpp"
+#include "lu.hpp"
+#include "cholesky.hpp"
+#include "sparse.hpp"
+#include "krylov.hpp"
+#include "precision.hpp"
+#include "banded.hpp"
+#include "textio.hpp"
+#include "threadpool.hpp"
+#include "telemetry.hpp"
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+namespace {
+
+// Transpose tiles handed to the thread pool are square so both the rows read
+// and the rows written stay in cache.
+const int transposeTile = 64;
+
+// Rows per thread task in properties()
+const int analysisTile = 64;
+
+// Rows per thread task in the dense Jacobi sweep
+const int jacobiRowTile = 16;
+
+// Iterative sweeps are cheaper on CSR once fewer than this share of the
+// entries are nonzero; the index array and gathers cost the rest.
+const double sparseSweepDensity = 0.25;
+
+// Banded LU does about n * kl * (kl + ku) flops against n^3 / 3, but
+// without GEMM's speed per flop; it wins once the band takes up less than
+// this share of a row.
+const double bandedSolveWidth = 0.125;
+
+// Blocks at least this big are worth keeping around: below it malloc already
+// reuses memory, above it glibc maps and unmaps pages on every allocation.
+const size_t cachedBlockBytes = 1 << 16;
+
+// Kept trivially destructible so it stays usable while other thread_local
+// buffers are being torn down; BlockCacheFlush hands the blocks back.
+struct BlockCache {
+    static const int slots = 4;
+    void* ptr[slots];
+    size_t size[slots];
+    bool closed;
+};
+
+thread_local BlockCache blockCache;
+
+struct BlockCacheFlush {
+    ~BlockCacheFlush() {
+        for (int k = 0; k < BlockCache::slots; k++) {
+            if (blockCache.ptr[k]) {
+                ::operator delete(blockCache.ptr[k], align_val_t(64));
+                blockCache.ptr[k] = nullptr;
+            }
+        }
+        blockCache.closed = true;
+    }
+};
+
+thread_local BlockCacheFlush blockCacheFlush;
+
+}
+
+void* alignedAllocate(size_t bytes) {
+    if (bytes >= cachedBlockBytes) {
+        BlockCache& cache = blockCache;
+        for (int k = 0; k < BlockCache::slots; k++) {
+            if (cache.ptr[k] && cache.size[k] == bytes) {
+                void* p = cache.ptr[k];
+                cache.ptr[k] = nullptr;
+                telemetryCount("alloc.cached_bytes", (double)bytes);
+                return p;
+            }
+        }
+    }
+    telemetryCount("alloc.bytes", (double)bytes);
+    return ::operator new(bytes, align_val_t(64));
+}
+
+void alignedRelease(void* p, size_t bytes) noexcept {
+    if (bytes >= cachedBlockBytes && !blockCache.closed) {
+        BlockCache& cache = blockCache;
+        (void)&blockCacheFlush;  // make sure the flush runs at thread exit
+        int slot = 0;
+        for (int k = 0; k < BlockCache::slots; k++) {
+            if (!cache.ptr[k]) {
+                slot = k;
+                break;
+            }
+        }
+        // All slots taken: evict the first one
+        if (cache.ptr[slot]) {
+            ::operator delete(cache.ptr[slot], align_val_t(64));
+        }
+        cache.ptr[slot] = p;
+        cache.size[slot] = bytes;
+        return;
+    }
+    ::operator delete(p, align_val_t(64));
+}
+
+// Round the row length up to a whole number of cache lines. Rows a multiple
+// of 4 KiB apart map onto the same cache sets, so those get one extra line
+// of padding.
+int paddedStride(int cols, size_t elementSize) {
+    const int lane = (int)(64 / elementSize);
+    int s = (cols + lane - 1) / lane * lane;
+    size_t bytes = (size_t)s * elementSize;
+    if (bytes >= 4096 && bytes % 4096 == 0) {
+        s += lane;
+    }
+    return s;
+}
+
 Matrix::Matrix() {
     rows = 0;
     cols = 0;
+    ld = 0;
+    base = nullptr;
 }
 
 Matrix::Matrix(int r, int c) {
     rows = r;
     cols = c;
-    data = vector<vector<double>>(r, vector<double>(c, 0));
+    ld = paddedStride(c, sizeof(double));
+    data.assign((size_t)r * ld, 0.0);
+    base = data.data();
+}
+
+Matrix::Matrix(int r, int c, Uninitialized) {
+    rows = r;
+    cols = c;
+    ld = paddedStride(c, sizeof(double));
+    data.resize((size_t)r * ld);
+    base = data.data();
+}
+
+Matrix::Matrix(int r, int c, int stride, double* mapped, shared_ptr<void> owner) {
+    rows = r;
+    cols = c;
+    ld = stride;
+    base = mapped;
+    mapping = move(owner);
 }
 
 Matrix::Matrix(const Matrix& other) {
     rows = other.rows;
     cols = other.cols;
-    data = other.data;
+    ld = other.ld;
+    data.assign(other.base, other.base + (size_t)other.rows * other.ld);
+    base = data.data();
+    analysis = atomic_load(&other.analysis);
 }
 
-int Matrix::getRows() const {
-    return rows;
+Matrix::Matrix(Matrix&& other) noexcept {
+    rows = other.rows;
+    cols = other.cols;
+    ld = other.ld;
+    data = move(other.data);
+    base = other.base;
+    mapping = move(other.mapping);
+    analysis = move(other.analysis);
+    other.rows = other.cols = other.ld = 0;
+    other.base = nullptr;
 }
 
-int Matrix::getCols() const {
-    return cols;
+Matrix& Matrix::operator=(const Matrix& other) {
+    if (this != &other) {
+        Matrix copy(other);
+        *this = move(copy);
+    }
+    return *this;
 }
 
-double Matrix::get(int i, int j) const {
-    if (i >= 0 && i < rows && j >= 0 && j < cols) {
-        return data[i][j];
+Matrix& Matrix::operator=(Matrix&& other) noexcept {
+    if (this != &other) {
+        rows = other.rows;
+        cols = other.cols;
+        ld = other.ld;
+        data = move(other.data);
+        base = other.base;
+        mapping = move(other.mapping);
+        analysis = move(other.analysis);
+        other.rows = other.cols = other.ld = 0;
+        other.base = nullptr;
     }
-    cout << "Index out of bounds!" << endl;
-    return 0;
+    return *this;
 }
 
-void Matrix::set(int i, int j, double val) {
-    if (i >= 0 && i < rows && j >= 0 && j < cols) {
-        data[i][j] = val;
-    } else {
-        cout << "Index out of bounds!" << endl;
-    }
+int Matrix::getRows() const {
+    return rows;
 }
 
-void Matrix::print() {
+int Matrix::getCols() const {
+    return cols;
+}
+
+void Matrix::print() const {
     cout << *this;
 }
 
-void Matrix::writeToFile(string filename) {
+Status Matrix::writeToFile(string filename) const {
     ofstream outFile(filename + ".txt");
     if (!outFile) {
-        cout << "Error opening file!" << endl;
-        return;
+        return Status(StatusCode::IoError, "Error opening " + filename + ".txt");
     }
     outFile << rows << " " << cols << endl;
     outFile << *this;
+    if (!outFile) {
+        return Status(StatusCode::IoError, "Error writing " + filename + ".txt");
+    }
+    return Status();
 }
 
 Matrix Matrix::readFromFile(string filename) {
-    ifstream inFile(filename + ".txt");
-    if (!inFile) {
-        cout << "Error opening file!" << endl;
-        return Matrix();
-    }
-    int r, c;
-    inFile >> r >> c;
-    Matrix mat(r, c);
-    for(int i = 0; i < r; i++) {
-        for(int j = 0; j < c; j++) {
-            inFile >> mat.data[i][j];
+    return tryReadFromFile(filename).value();
+}
+
+Result<Matrix> Matrix::tryReadFromFile(string filename) {
+    Matrix mat;
+    TextParseError error;
+    if (!parseMatrixText(filename + ".txt", mat, error)) {
+        if (!error.opened) {
+            return Result<Matrix>(StatusCode::IoError, "Error opening " + filename + ".txt");
         }
+        return Result<Matrix>(StatusCode::FormatError, "Error reading " + describe(filename + ".txt", error));
     }
     return mat;
 }
 
-Matrix Matrix::operator+(Matrix& other) {
-    if (rows != other.rows || cols != other.cols) {
-        cout << "Error: Matrices must be of the same dimensions!" << endl;
-        return Matrix();
+namespace {
+
+const char matrixMagic[8] = {'N', 'C', 'M', 'A', 'T', 'R', 'I', 'X'};
+
+// Rows hashed per checksum block; the checksum is defined in terms of these
+// blocks, so the value is the same whatever the thread count
+const int checksumRows = 64;
+
+uint64_t mix(uint64_t h, uint64_t w) {
+    h ^= w;
+    h *= 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+// Hash of one block of up to checksumRows rows. Values go round-robin into
+// four lanes so the multiply chains overlap.
+struct ChecksumBlock {
+    uint64_t h[4] = {1, 2, 3, 4};
+
+    void addRow(const double* values, int cols) {
+        const uint64_t* row = reinterpret_cast<const uint64_t*>(values);
+        int j = 0;
+        for (; j + 4 <= cols; j += 4) {
+            h[0] = mix(h[0], row[j]);
+            h[1] = mix(h[1], row[j + 1]);
+            h[2] = mix(h[2], row[j + 2]);
+            h[3] = mix(h[3], row[j + 3]);
+        }
+        for (; j < cols; j++) {
+            h[j & 3] = mix(h[j & 3], row[j]);
+        }
     }
-    Matrix result(rows, cols);
-    for(int i = 0; i < rows; i++) {
-        for(int j = 0; j < cols; j++) {
-            result.data[i][j] = data[i][j] + other.data[i][j];
+    uint64_t finish() const { return mix(mix(mix(h[0], h[1]), h[2]), h[3]); }
+};
+
+uint64_t checksumSeed(int rows, int cols) {
+    return mix(0, ((uint64_t)rows << 32) | (uint32_t)cols);
+}
+
+// Hash of the rows x cols values (bit patterns), row padding excluded
+uint64_t matrixChecksum(const double* a, int rows, int cols, int ld) {
+    int blocks = (rows + checksumRows - 1) / checksumRows;
+    vector<uint64_t> blockHash(blocks);
+    parallelTiles(rows, cols, checksumRows, max(cols, 1), [&](int i0, int i1, int, int) {
+        ChecksumBlock block;
+        for (int i = i0; i < i1; i++) {
+            block.addRow(a + (size_t)i * ld, cols);
         }
+        blockHash[i0 / checksumRows] = block.finish();
+    });
+    uint64_t checksum = checksumSeed(rows, cols);
+    for (uint64_t b : blockHash) {
+        checksum = mix(checksum, b);
     }
-    return result;
+    return checksum;
+}
+
+MatrixFileHeader makeHeader(int rows, int cols, int stride) {
+    MatrixFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, matrixMagic, sizeof(matrixMagic));
+    h.version = MatrixFileHeader::currentVersion;
+    h.dtype = 1;
+    h.layout = 0;
+    h.byteOffset = sizeof(MatrixFileHeader);
+    h.rows = rows;
+    h.cols = cols;
+    h.stride = stride;
+    return h;
 }
 
-Matrix Matrix::operator-(Matrix& other) {
-    if (rows != other.rows || cols != other.cols) {
-        cout << "Error: Matrices must be of the same dimensions!" << endl;
-        return Matrix();
+Status checkHeader(const MatrixFileHeader& h, uint64_t fileBytes) {
+    if (memcmp(h.magic, matrixMagic, sizeof(matrixMagic)) != 0) {
+        return Status(StatusCode::FormatError, "Not a binary matrix file");
     }
-    Matrix result(rows, cols);
-    for(int i = 0; i < rows; i++) {
-        for(int j = 0; j < cols; j++) {
-            result.data[i][j] = data[i][j] - other.data[i][j];
-        }
+    if (h.version != MatrixFileHeader::currentVersion || h.dtype != 1 || h.layout != 0) {
+        return Status(StatusCode::FormatError, "Unsupported matrix file version or format");
     }
-    return result;
+    if (h.rows < 0 || h.cols < 0 || h.rows > INT32_MAX || h.cols > INT32_MAX ||
+        h.stride < h.cols || h.stride > INT32_MAX ||
+        h.byteOffset < sizeof(MatrixFileHeader) || h.byteOffset % 64 != 0) {
+        return Status(StatusCode::FormatError, "Corrupt matrix file header");
+    }
+    // Divided rather than multiplied out, which could wrap past 2^64 and
+    // let a crafted header through
+    if (h.byteOffset > fileBytes ||
+        (h.rows != 0 && (uint64_t)h.stride > (fileBytes - h.byteOffset) / sizeof(double) / h.rows)) {
+        return Status(StatusCode::FormatError, "Matrix file is truncated");
+    }
+    return Status();
+}
+
 }
 
-Matrix Matrix::operator*(Matrix& other) {
-    if (cols != other.rows) {
-        cout << "Matrix dimensions do not match for multiplication!" << endl;
-        return Matrix();
+Status Matrix::saveBinary(string filename) const {
+    TELEMETRY_SCOPE("io.saveBinary");
+    ofstream outFile(filename + ".bin", ios::binary);
+    if (!outFile) {
+        return Status(StatusCode::IoError, "Error opening " + filename + ".bin");
     }
-    Matrix result(rows, other.cols);
-    for(int i = 0; i < rows; i++) {
-        for(int j = 0; j < other.cols; j++) {
-            for(int k = 0; k < cols; k++) {
-                result.data[i][j] += data[i][k] * other.data[k][j];
+    MatrixFileHeader h = makeHeader(rows, cols, ld);
+    h.checksum = matrixChecksum(base, rows, cols, ld);
+    outFile.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    // Padding may hold anything in memory; the file gets zeros there
+    const int chunkRows = 256;
+    vector<double> chunk;
+    for (int i0 = 0; i0 < rows; i0 += chunkRows) {
+        int nr = min(chunkRows, rows - i0);
+        const double* src = base + (size_t)i0 * ld;
+        if (ld > cols) {
+            chunk.assign(src, src + (size_t)nr * ld);
+            for (int i = 0; i < nr; i++) {
+                fill(chunk.begin() + (size_t)i * ld + cols, chunk.begin() + (size_t)(i + 1) * ld, 0.0);
             }
+            src = chunk.data();
         }
+        outFile.write(reinterpret_cast<const char*>(src), (streamsize)((size_t)nr * ld * sizeof(double)));
     }
-    return result;
+    if (!outFile) {
+        return Status(StatusCode::IoError, "Error writing " + filename + ".bin");
+    }
+    telemetryCount("io.bytes_written", sizeof(h) + (double)rows * ld * sizeof(double));
+    return Status();
+}
+
+MatrixFileWriter::MatrixFileWriter(const string& filename, int r, int c)
+    : out(filename + ".bin", ios::binary), rows(r), cols(c), ld(paddedStride(c, sizeof(double))),
+      written(0), checksum(checksumSeed(r, c)), padded(ld, 0.0) {
+    if (!out) {
+        failure = Status(StatusCode::IoError, "Error opening " + filename + ".bin");
+        return;
+    }
+    // Provisional header; close() fills in the checksum
+    MatrixFileHeader h = makeHeader(rows, cols, ld);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
 }
 
-Matrix Matrix::transpose() {
-    Matrix result(cols, rows);
-    for(int i = 0; i < rows; i++) {
-        for(int j = 0; j < cols; j++) {
-            result.data[j][i] = data[i][j];
+MatrixFileWriter::~MatrixFileWriter() {
+    if (out.is_open()) {
+        close();
+    }
+}
+
+Status MatrixFileWriter::writeRows(const double* src, int count, int srcStride) {
+    if (!failure) {
+        return failure;
+    }
+    if (written + count > rows) {
+        failure = Status(StatusCode::InvalidArgument, "More rows written than the matrix file holds");
+        return failure;
+    }
+    for (int r = 0; r < count; r++) {
+        const double* row = src + (size_t)r * srcStride;
+        ChecksumBlock block;
+        if (written % checksumRows != 0) {
+            copy(lanes, lanes + 4, block.h);
+        }
+        block.addRow(row, cols);
+        copy(block.h, block.h + 4, lanes);
+        written++;
+        if (written % checksumRows == 0 || written == rows) {
+            checksum = mix(checksum, block.finish());
         }
+        copy(row, row + cols, padded.begin());
+        out.write(reinterpret_cast<const char*>(padded.data()), (streamsize)(ld * sizeof(double)));
     }
-    return result;
+    telemetryCount("io.bytes_written", (double)count * ld * sizeof(double));
+    if (!out) {
+        failure = Status(StatusCode::IoError, "Error writing matrix file");
+    }
+    return failure;
 }
 
-Matrix Matrix::identityMatrix(int size) {
-    Matrix identity(size, size);
-    for(int i = 0; i < size; i++) {
-        identity.data[i][i] = 1;
+Status MatrixFileWriter::close() {
+    MatrixFileHeader h = makeHeader(rows, cols, ld);
+    h.checksum = checksum;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    if (failure && !out) {
+        failure = Status(StatusCode::IoError, "Error writing matrix file");
     }
-    return identity;
+    if (failure && written != rows) {
+        failure = Status(StatusCode::InvalidArgument, "Matrix file closed after " + to_string(written) + " of " +
+                                                          to_string(rows) + " rows");
+    }
+    out.close();
+    return failure;
+}
+
+Matrix Matrix::loadBinary(string filename) {
+    return tryLoadBinary(filename).value();
+}
+
+Result<Matrix> Matrix::tryLoadBinary(string filename) {
+    TELEMETRY_SCOPE("io.loadBinary");
+    ifstream inFile(filename + ".bin", ios::binary | ios::ate);
+    if (!inFile) {
+        return Result<Matrix>(StatusCode::IoError, "Error opening " + filename + ".bin");
+    }
+    uint64_t fileBytes = (uint64_t)inFile.tellg();
+    inFile.seekg(0);
+    MatrixFileHeader h;
+    if (fileBytes < sizeof(h) || !inFile.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+        return Result<Matrix>(StatusCode::FormatError, "Not a binary matrix file");
+    }
+    Status header = checkHeader(h, fileBytes);
+    if (!header) {
+        return header;
+    }
+
+    Matrix mat((int)h.rows, (int)h.cols, Uninitialized());
+    inFile.seekg(h.byteOffset);
+    if (h.stride == mat.ld) {
+        inFile.read(reinterpret_cast<char*>(mat.base), (streamsize)((size_t)h.rows * h.stride * sizeof(double)));
+    } else {
+        // Written with other padding: read row by row into ours
+        vector<double> row(h.stride);
+        for (int i = 0; i < mat.rows && inFile; i++) {
+            inFile.read(reinterpret_cast<char*>(row.data()), (streamsize)(h.stride * sizeof(double)));
+            copy(row.begin(), row.begin() + mat.cols, &mat(i, 0));
+        }
+    }
+    if (!inFile) {
+        return Result<Matrix>(StatusCode::IoError, "Error reading " + filename + ".bin");
+    }
+    if (matrixChecksum(mat.base, mat.rows, mat.cols, mat.ld) != h.checksum) {
+        return Result<Matrix>(StatusCode::ChecksumMismatch, "Matrix file checksum mismatch");
+    }
+    telemetryCount("io.bytes_read", (double)fileBytes);
+    return mat;
+}
+
+Matrix Matrix::mapBinary(string filename, bool verifyChecksum) {
+    return tryMapBinary(filename, verifyChecksum).value();
+}
+
+Result<Matrix> Matrix::tryMapBinary(string filename, bool verifyChecksum) {
+    TELEMETRY_SCOPE("io.mapBinary");
+#if defined(__unix__) || defined(__APPLE__)
+    string path = filename + ".bin";
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return Result<Matrix>(StatusCode::IoError, "Error opening " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(MatrixFileHeader)) {
+        close(fd);
+        return Result<Matrix>(StatusCode::FormatError, "Not a binary matrix file");
+    }
+    size_t bytes = (size_t)st.st_size;
+    // Private, writable mapping: pages are shared with the page cache until
+    // written, then copied by the kernel, so the file is never modified
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return Result<Matrix>(StatusCode::IoError, "Error mapping " + path);
+    }
+    shared_ptr<void> owner(p, [bytes](void* q) { munmap(q, bytes); });
+
+    const MatrixFileHeader& h = *static_cast<const MatrixFileHeader*>(p);
+    Status header = checkHeader(h, bytes);
+    if (!header) {
+        return header;
+    }
+    double* values = reinterpret_cast<double*>(static_cast<char*>(p) + h.byteOffset);
+    if (verifyChecksum && matrixChecksum(values, (int)h.rows, (int)h.cols, (int)h.stride) != h.checksum) {
+        return Result<Matrix>(StatusCode::ChecksumMismatch, "Matrix file checksum mismatch");
+    }
+    // Only a verified mapping has actually read the pages
+    telemetryCount("io.bytes_mapped", (double)bytes);
+    return Matrix((int)h.rows, (int)h.cols, (int)h.stride, values, move(owner));
+#else
+    (void)verifyChecksum;
+    return tryLoadBinary(filename);
+#endif
+}
+
+// Everything lazy that multiplies ends up here. With beta == 0 the old
+// contents are never read, so *this may be uninitialized.
+void Matrix::productUpdate(const Matrix& A, bool transA, const Matrix& B, bool transB, double alpha, double beta) {
+    if (rows == 0 || cols == 0) {
+        return;
+    }
+    int k = transA ? A.rows : A.cols;
+    TELEMETRY_SCOPE("multiply");
+    telemetryCount("multiply.flops", 2.0 * rows * cols * k);
+    if (transA || transB) {
+        gemm(transA, transB, rows, cols, k, alpha, A.raw(), A.ld, B.raw(), B.ld, beta, raw(), ld);
+    } else {
+        gemm(rows, cols, k, alpha, A.raw(), A.ld, B.raw(), B.ld, beta, raw(), ld);
+    }
+}
+
+void Matrix::multiplyAdd(const Matrix& A, const Matrix& B, double alpha) {
+    if (A.cols != B.rows || A.rows != rows || B.cols != cols) {
+        return;
+    }
+    productUpdate(A, false, B, false, alpha, 1.0);
+}
+
+// Each tile of the source goes through transposeBlock into the mirrored
+// tile of *this. The source cannot be *this: operator= takes care of that.
+void Matrix::assignElements(const TransposeExpr& t) {
+    invalidate();
+    const Matrix& src = t.matrix();
+    double* out = base;
+    int stride = ld;
+    parallelTiles(src.rows, src.cols, transposeTile, transposeTile, [&](int i0, int i1, int j0, int j1) {
+        transposeBlock(i1 - i0, j1 - j0, &src(i0, j0), src.ld, out + (size_t)j0 * stride + i0, stride);
+    });
 }
 
-bool Matrix::isSymmetric() {
+// Tiles (I, J) and (J, I) are swapped through a buffer by whichever task
+// owns the one on or above the diagonal; the task below it does nothing.
+void Matrix::transposeInPlace() {
     if (rows != cols) {
-        return false;
+        *this = Matrix(transpose());
+        return;
     }
-    for(int i = 0; i < rows; i++) {
-        for(int j = 0; j < i; j++) {
-            if (fabs(data[i][j] - data[j][i]) > 1e-10) {
-                return false;
-            }
+    invalidate();
+    double* a = base;
+    int stride = ld;
+    parallelTiles(rows, cols, transposeTile, transposeTile, [&](int i0, int i1, int j0, int j1) {
+        if (i0 > j0) {
+            return;
         }
+        double buffer[transposeTile * transposeTile];
+        int m = i1 - i0, n = j1 - j0;
+        double* upper = a + (size_t)i0 * stride + j0;
+        double* lower = a + (size_t)j0 * stride + i0;
+        // buffer = upper^T (n x m), upper = lower^T, lower = buffer
+        transposeBlock(m, n, upper, stride, buffer, transposeTile);
+        if (i0 != j0) {
+            transposeBlock(n, m, lower, stride, upper, stride);
+        }
+        for (int r = 0; r < n; r++) {
+            copy(buffer + r * transposeTile, buffer + r * transposeTile + m, lower + (size_t)r * stride);
+        }
+    });
+}
+
+Matrix Matrix::identityMatrix(int size) {
+    Matrix identity(size, size);
+    for(int i = 0; i < size; i++) {
+        identity(i, i) = 1;
     }
-    return true;
+    return identity;
+}
+
+bool Matrix::isSymmetric() const {
+    return properties().symmetric;
 }
 
 ostream& operator<<(ostream& os, const Matrix& mat) {
     for(int i = 0; i < mat.rows; i++) {
         for(int j = 0; j < mat.cols; j++) {
-            os << mat.data[i][j] << " ";
+            os << mat(i, j) << " ";
         }
         os << endl;
     }
@@ -166,205 +610,195 @@ ostream& operator<<(ostream& os, const Matrix& mat) {
 istream& operator>>(istream& is, Matrix& mat) {
     for(int i = 0; i < mat.rows; i++) {
         for(int j = 0; j < mat.cols; j++) {
-            is >> mat.data[i][j];
+            is >> mat(i, j);
         }
     }
     return is;
 }
 
-vector<double> Matrix::gaussianElimination(vector<double>& b) {
+// Gaussian elimination with partial pivoting is exactly the pivoted LU
+// factorization followed by two triangular solves.
+vector<double> Matrix::gaussianElimination(const vector<double>& b) const {
+    return tryGaussianElimination(b).value();
+}
+
+vector<double> Matrix::gaussianElimination(const vector<double>& B, int nrhs) const {
+    return tryGaussianElimination(B, nrhs).value();
+}
+
+Result<vector<double>> Matrix::tryGaussianElimination(const vector<double>& b) const {
     if (rows != cols) {
-        cout << "Matrix must be square for Gaussian elimination!" << endl;
-        return vector<double>();
-    }
-    
-    if (rows != b.size()) {
-        cout << "Vector b must have the same size as matrix rows!" << endl;
-        return vector<double>();
-    }
-    
-    int n = rows;
-    
-    // Create augmented matrix
-    vector<vector<double>> augmented = data;
-    for(int i = 0; i < n; i++) {
-        augmented[i].push_back(b[i]);
+        return Result<vector<double>>(StatusCode::NotSquare, "Matrix must be square for Gaussian elimination");
     }
 
-    // Forward elimination with partial pivoting
-    for(int i = 0; i < n; i++) {
-        // Find pivot (largest absolute value in current column)
-        int maxRow = i;
-        for(int k = i + 1; k < n; k++) {
-            if (fabs(augmented[k][i]) > fabs(augmented[maxRow][i])) {
-                maxRow = k;
-            }
-        }
+    if (rows != (int)b.size()) {
+        return Result<vector<double>>(StatusCode::DimensionMismatch,
+                                      "Vector b must have the same size as matrix rows");
+    }
 
-        // Swap rows
-        if (maxRow != i) {
-            swap(augmented[i], augmented[maxRow]);
+    TELEMETRY_SCOPE("gaussianElimination");
+    int lower, upper;
+    if (isBandedEnough(lower, upper)) {
+        if (lower <= 1 && upper <= 1) {
+            return TridiagonalMatrix::fromDense(*this).trySolve(b);
         }
+        return BandedLUFactorization(BandedMatrix::fromDense(*this, lower, upper)).trySolve(b);
+    }
+    return LUFactorization(*this).trySolve(b);
+}
 
-        // Check for singular matrix
-        if (fabs(augmented[i][i]) < 1e-10) {
-            cout << "Matrix is singular or nearly singular!" << endl;
-            return vector<double>();
-        }
+Result<vector<double>> Matrix::tryGaussianElimination(const vector<double>& B, int nrhs) const {
+    if (rows != cols) {
+        return Result<vector<double>>(StatusCode::NotSquare, "Matrix must be square for Gaussian elimination");
+    }
 
-        // Eliminate below
-        for(int k = i + 1; k < n; k++) {
-            double factor = augmented[k][i] / augmented[i][i];
-            for(int j = i; j <= n; j++) {
-                augmented[k][j] -= factor * augmented[i][j];
-            }
-        }
+    if (nrhs < 0 || B.size() != (size_t)rows * nrhs) {
+        return Result<vector<double>>(StatusCode::DimensionMismatch,
+                                      "Right-hand side block must hold nrhs columns of matrix size");
     }
 
-    // Back substitution
-    vector<double> x(n);
-    for(int i = n - 1; i >= 0; i--) {
-        x[i] = augmented[i][n];
-        for(int j = i + 1; j < n; j++) {
-            x[i] -= augmented[i][j] * x[j];
-        }
-        x[i] /= augmented[i][i];
+    TELEMETRY_SCOPE("gaussianElimination");
+    int lower, upper;
+    if (isBandedEnough(lower, upper)) {
+        return BandedLUFactorization(BandedMatrix::fromDense(*this, lower, upper)).trySolveMany(B, nrhs);
     }
+    return LUFactorization(*this).trySolveMany(B, nrhs);
+}
 
-    return x;
+pair<Matrix, Matrix> Matrix::luDecompositionDoolittle() const {
+    return tryLuDecompositionDoolittle().value();
+}
+
+pair<Matrix, Matrix> Matrix::luDecompositionCrout() const {
+    return tryLuDecompositionCrout().value();
 }
 
 // DooLittle LU Decomposition
-pair<Matrix, Matrix> Matrix::luDecompositionDoolittle() 
+Result<pair<Matrix, Matrix>> Matrix::tryLuDecompositionDoolittle() const
 {
     if (rows != cols) {
-        cout << "Matrix must be square for LU decomposition!" << endl;
-        return {Matrix(), Matrix()};
+        return Result<pair<Matrix, Matrix>>(StatusCode::NotSquare, "Matrix must be square for LU decomposition");
     }
     
     int n = rows;
     Matrix L(n, n);
     Matrix U(n, n);
+    // Row pointers taken once: operator() on a non-const matrix drops the
+    // cached properties() on every call, which the inner loops cannot afford
+    double* l = L.raw();
+    double* u = U.raw();
+    size_t ldl = L.ld, ldu = U.ld;
     
     for(int i = 0; i < n; i++) {
-        L.data[i][i] = 1.0;
+        l[i * ldl + i] = 1.0;
     }
     for(int j = 0; j < n; j++) {
         // Upper triangular matrix U
         for(int i = 0; i <= j; i++) 
         {
+            const double* li = l + i * ldl;
             double sum = 0.0;
             for(int k = 0; k < i; k++) 
             {
-                sum += L.data[i][k] * U.data[k][j];
+                sum += li[k] * u[k * ldu + j];
             }
-            U.data[i][j] = data[i][j] - sum;
+            u[i * ldu + j] = (*this)(i, j) - sum;
+        }
+        
+        double pivot = u[j * ldu + j];
+        // Without pivoting a zero here cannot be divided through
+        if (fabs(pivot) < 1e-10) {
+            return Result<pair<Matrix, Matrix>>(StatusCode::Singular, "Zero pivot in LU decomposition");
         }
         
         // Lower triangular matrix L
         for(int i = j + 1; i < n; i++)
          {
+            double* li = l + i * ldl;
             double sum = 0.0;
             for(int k = 0; k < j; k++) 
             {
-                sum += L.data[i][k] * U.data[k][j];
+                sum += li[k] * u[k * ldu + j];
             }
             
-            L.data[i][j] = (data[i][j] - sum) / U.data[j][j];
+            li[j] = ((*this)(i, j) - sum) / pivot;
         }
     }
     
-    return {L, U};
+    return make_pair(L, U);
 }
 
 // Crout LU Decomposition
-pair<Matrix, Matrix> Matrix::luDecompositionCrout() {
+Result<pair<Matrix, Matrix>> Matrix::tryLuDecompositionCrout() const {
     if (rows != cols) {
-        cout << "Matrix must be square for LU decomposition!" << endl;
-        return {Matrix(), Matrix()};
+        return Result<pair<Matrix, Matrix>>(StatusCode::NotSquare, "Matrix must be square for LU decomposition");
     }
     
     int n = rows;
     Matrix L(n, n);
     Matrix U(n, n);
+    // Row pointers taken once, as in Doolittle
+    double* l = L.raw();
+    double* u = U.raw();
+    size_t ldl = L.ld, ldu = U.ld;
     
     for(int i = 0; i < n; i++) {
-        U.data[i][i] = 1.0;
+        u[i * ldu + i] = 1.0;
     }
     
     for(int j = 0; j < n; j++) {
         // Lower triangular matrix L
         for(int i = j; i < n; i++) {
+            const double* li = l + i * ldl;
             double sum = 0.0;
             for(int k = 0; k < j; k++) {
-                sum += L.data[i][k] * U.data[k][j];
+                sum += li[k] * u[k * ldu + j];
             }
-            L.data[i][j] = data[i][j] - sum;
+            l[i * ldl + j] = (*this)(i, j) - sum;
+        }
+        
+        double pivot = l[j * ldl + j];
+        if (fabs(pivot) < 1e-10) {
+            return Result<pair<Matrix, Matrix>>(StatusCode::Singular, "Zero pivot in LU decomposition");
         }
         
         // Upper triangular matrix U
+        const double* lj = l + j * ldl;
+        double* uj = u + j * ldu;
         for(int i = j + 1; i < n; i++) {
             double sum = 0.0;
             for(int k = 0; k < j; k++) {
-                sum += L.data[j][k] * U.data[k][i];
+                sum += lj[k] * u[k * ldu + i];
             }
             
-            U.data[j][i] = (data[j][i] - sum) / L.data[j][j];
+            uj[i] = ((*this)(j, i) - sum) / pivot;
         }
     }
     
-    return {L, U};
+    return make_pair(L, U);
 }
 
-// Cholesky Decomposition
-Matrix Matrix::choleskyDecomposition() {
-    if (rows != cols) {
-        cout << "Matrix must be square for Cholesky decomposition!" << endl;
-        return Matrix();
-    }
-    
-    if (!isSymmetric()) {
-        cout << "Matrix must be symmetric for Cholesky decomposition!" << endl;
-        return Matrix();
-    }
-    
-    int n = rows;
-    Matrix L(n, n);
-    
-    for(int i = 0; i < n; i++) {
-        for(int j = 0; j <= i; j++) {
-            double sum = 0;
-            
-            if (j == i) { 
-                for(int k = 0; k < j; k++) {
-                    sum += L.data[j][k] * L.data[j][k];
-                }
-                
-                double value = data[j][j] - sum;
-                if (value <= 0) {
-                    cout << "Matrix is not positive definite!" << endl;
-                    return Matrix();
-                }
-                
-                L.data[j][j] = sqrt(value);
-            } else { 
-                for(int k = 0; k < j; k++) {
-                    sum += L.data[i][k] * L.data[j][k];
-                }
-                
-                L.data[i][j] = (data[i][j] - sum) / L.data[j][j];
-            }
-        }
+// Cholesky Decomposition, returned as a dense lower triangular matrix
+Matrix Matrix::choleskyDecomposition(bool checkSymmetry) const {
+    return choleskyFactorize(checkSymmetry).lower();
+}
+
+CholeskyFactorization Matrix::choleskyFactorize(bool checkSymmetry) const {
+    return CholeskyFactorization(*this, checkSymmetry);
+}
+
+Result<CholeskyFactorization> Matrix::tryCholeskyFactorize(bool checkSymmetry) const {
+    CholeskyFactorization factor(*this, checkSymmetry);
+    if (!factor.status()) {
+        return factor.status();
     }
-    
-    return L;
+    return factor;
 }
 
 // Solve a system Ax = b using precomputed LU decomposition
-vector<double> Matrix::solveLU(vector<double>& b, Matrix& L, Matrix& U) {
+vector<double> Matrix::solveLU(const vector<double>& b, const Matrix& L, const Matrix& U) const {
     int n = rows;
     if (n != b.size() || L.getRows() != n || U.getRows() != n) {
-        cout << "Dimensions mismatch in LU solver!" << endl;
         return vector<double>();
     }
     
@@ -372,257 +806,725 @@ vector<double> Matrix::solveLU(vector<double>& b, Matrix& L, Matrix& U) {
     for(int i = 0; i < n; i++) {
         y[i] = b[i];
         for(int j = 0; j < i; j++) {
-            y[i] -= L.data[i][j] * y[j];
+            y[i] -= L(i, j) * y[j];
         }
-        y[i] /= L.data[i][i];
+        y[i] /= L(i, i);
     }
     
     vector<double> x(n, 0);
     for(int i = n - 1; i >= 0; i--) {
         x[i] = y[i];
         for(int j = i + 1; j < n; j++) {
-            x[i] -= U.data[i][j] * x[j];
+            x[i] -= U(i, j) * x[j];
         }
-        x[i] /= U.data[i][i];
+        x[i] /= U(i, i);
     }
     
     return x;
 }
 
-// Calculate determinant using the LU decomposition
-double Matrix::determinant() {
-    if (rows != cols) {
-        cout << "Matrix must be square to calculate determinant!" << endl;
-        return 0;
+// Solve a system Ax = b reusing a pivoted LU factorization of this matrix
+vector<double> Matrix::solveLU(const vector<double>& b, const LUFactorization& lu) const {
+    if (lu.size() != rows || rows != cols) {
+        return vector<double>();
     }
-    
-    auto [L, U] = luDecompositionDoolittle();
-    
-    if (L.getRows() == 0 || U.getRows() == 0) {
+    return lu.solve(b);
+}
+
+vector<double> Matrix::solveLU(const vector<double>& B, int nrhs, const LUFactorization& lu) const {
+    if (lu.size() != rows || rows != cols) {
+        return vector<double>();
+    }
+    return lu.solveMany(B, nrhs);
+}
+
+LUFactorization Matrix::luFactorize() const {
+    return LUFactorization(*this);
+}
+
+Result<LUFactorization> Matrix::tryLuFactorize() const {
+    LUFactorization lu(*this);
+    if (!lu.status()) {
+        return lu.status();
+    }
+    return lu;
+}
+
+// Calculate determinant using the pivoted LU factorization; 0 when not square
+double Matrix::determinant() const {
+    if (rows != cols) {
         return 0;
     }
-    
-    double det = 1.0;
-    for(int i = 0; i < rows; i++) {
-        det *= U.data[i][i];
+
+    int lower, upper;
+    if (isBandedEnough(lower, upper)) {
+        return BandedLUFactorization(BandedMatrix::fromDense(*this, lower, upper)).determinant();
     }
-    
-    return det;
+    return LUFactorization(*this).determinant();
 }
 
-bool Matrix::isDiagonallyDominant() {
+bool Matrix::isSparseEnough() const {
+    return properties().nonZeros < sparseSweepDensity * rows * (double)cols;
+}
+
+void Matrix::bandwidth(int& lower, int& upper) const {
+    MatrixProperties p = properties();
+    lower = p.lowerBandwidth;
+    upper = p.upperBandwidth;
+}
+
+bool Matrix::isBandedEnough(int& lower, int& upper) const {
     if (rows != cols) {
         return false;
     }
-    
-    for(int i = 0; i < rows; i++) {
-        double diagonalValue = fabs(data[i][i]);
-        double rowSum = 0.0;
-        
-        for(int j = 0; j < cols; j++) 
-        {
-            if(i!=j) 
-            {
-                rowSum += fabs(data[i][j]);
+    bandwidth(lower, upper);
+    return lower + upper + 1 <= bandedSolveWidth * rows;
+}
+
+bool Matrix::isDiagonallyDominant() const {
+    return properties().diagonallyDominant;
+}
+
+// Two threads finding no analysis may both make one; they agree, and the
+// later store wins
+MatrixProperties Matrix::properties() const {
+    shared_ptr<const MatrixProperties> cached = atomic_load(&analysis);
+    if (!cached) {
+        cached = make_shared<const MatrixProperties>(analyze());
+        atomic_store(&analysis, cached);
+    }
+    return *cached;
+}
+
+// Each task takes a block of rows and reports on it alone; the blocks are
+// combined in order, so the sums do not depend on the thread count. The
+// block's entries below the diagonal are compared with their mirror images
+// a column at a time: a short stretch of row j against column j of the
+// block, which stays in cache.
+MatrixProperties Matrix::analyze() const {
+    TELEMETRY_SCOPE("analyze");
+    struct Block {
+        long long nonZeros = 0;
+        double maxRowSum = 0.0, sumSquares = 0.0;
+        int lower = 0, upper = 0;
+        bool dominant = true, positive = true;
+    };
+    bool square = rows == cols;
+    int blocks = (rows + analysisTile - 1) / analysisTile;
+    vector<Block> stats(max(blocks, 0));
+    atomic<bool> asymmetric(!square);
+
+    parallelTiles(rows, max(cols, 1), analysisTile, max(cols, 1), [&](int i0, int i1, int, int) {
+        Block& s = stats[i0 / analysisTile];
+        for (int i = i0; i < i1; i++) {
+            const double* row = &(*this)(i, 0);
+            int first = -1, last = -1;
+            double offDiagonal = 0.0, squares = 0.0;
+            for (int j = 0; j < cols; j++) {
+                double v = row[j];
+                if (v != 0.0) {
+                    s.nonZeros++;
+                    first = first < 0 ? j : first;
+                    last = j;
+                }
+                if (j != i) {
+                    offDiagonal += fabs(v);
+                }
+                squares += v * v;
+            }
+            double diagonal = i < cols ? row[i] : 0.0;
+            s.maxRowSum = max(s.maxRowSum, offDiagonal + fabs(diagonal));
+            s.sumSquares += squares;
+            if (first >= 0) {
+                s.lower = max(s.lower, i - first);
+                s.upper = max(s.upper, last - i);
             }
+            s.dominant = s.dominant && fabs(diagonal) > offDiagonal;
+            s.positive = s.positive && diagonal > 0;
         }
-        
-        if (diagonalValue <= rowSum) 
-        {
-            return false;
+
+        for (int j = 0; j < i1 && !asymmetric; j++) {
+            const double* mirrored = &(*this)(j, 0);
+            for (int i = max(i0, j + 1); i < i1; i++) {
+                if (fabs((*this)(i, j) - mirrored[i]) > 1e-10) {
+                    asymmetric = true;
+                }
+            }
         }
+    });
+
+    MatrixProperties p;
+    p.symmetric = !asymmetric;
+    p.diagonallyDominant = square;
+    p.positiveDiagonal = square;
+    double sumSquares = 0.0;
+    for (const Block& s : stats) {
+        p.nonZeros += s.nonZeros;
+        p.normInf = max(p.normInf, s.maxRowSum);
+        sumSquares += s.sumSquares;
+        p.lowerBandwidth = max(p.lowerBandwidth, s.lower);
+        p.upperBandwidth = max(p.upperBandwidth, s.upper);
+        p.diagonallyDominant = p.diagonallyDominant && s.dominant;
+        p.positiveDiagonal = p.positiveDiagonal && s.positive;
     }
-    
-    return true;
+    p.normFrobenius = sqrt(sumSquares);
+    return p;
 }
 
-bool Matrix::makeDiagonallyDominant(){
-    if(rows != cols){
-        cout << "Matrix must be square to attempt making it diagonally dominant!" << endl;
-        return false;
+namespace {
+
+// Row order for diagonal dominance, as a matching of rows to diagonal
+// positions. forEachEntry(k, fn) calls fn(j, a_kj) for the nonzeros of
+// row k, so the cost is O(nnz) plus the augmenting searches of phase 2.
+//
+// Row k is strictly dominant at position j only if 2 |a_kj| exceeds its
+// absolute row sum, which at most its largest entry can do: phase 1 is
+// each such row claiming that column, the larger margin winning a clash.
+// Phase 2 matches the other rows to the free columns over nonzero
+// entries, greedily by magnitude and then by breadth-first augmenting
+// paths that leave phase 1's rows in place; only if that cannot cover
+// every row may they move. Rows still unplaced (A is structurally
+// singular) take the columns left over.
+template<typename Rows>
+bool dominantRowOrder(int n, const Rows& forEachEntry, vector<int>& order) {
+    vector<double> rowSum(n, 0.0), largest(n, 0.0);
+    vector<int> largestCol(n, -1);
+    for (int k = 0; k < n; k++) {
+        forEachEntry(k, [&](int j, double v) {
+            double a = fabs(v);
+            rowSum[k] += a;
+            if (a > largest[k]) {
+                largest[k] = a;
+                largestCol[k] = j;
+            }
+        });
     }
- 
-    for(int i = 0; i < rows; i++){
-        int bestRow = i;
-        double bestValue = fabs(data[i][i]);
-        double rowSum = 0.0;
 
-        for(int j = 0; j < cols; j++){
-            if(i != j){
-                rowSum += fabs(data[i][j]);
+    vector<int> rowAt(n, -1), colOf(n, -1);
+    vector<double> margin(n, 0.0);
+    auto dominantAt = [&](int k, int j) { return j == largestCol[k] && 2.0 * largest[k] > rowSum[k]; };
+    for (int k = 0; k < n; k++) {
+        int j = largestCol[k];
+        if (j < 0 || !dominantAt(k, j)) {
+            continue;
+        }
+        double m = 2.0 * largest[k] - rowSum[k];
+        if (rowAt[j] < 0 || m > margin[j]) {
+            if (rowAt[j] >= 0) {
+                colOf[rowAt[j]] = -1;
             }
+            rowAt[j] = k;
+            colOf[k] = j;
+            margin[j] = m;
         }
+    }
+    vector<char> locked(n, 0);
+    for (int j = 0; j < n; j++) {
+        locked[j] = rowAt[j] >= 0;
+    }
 
-        if(bestValue <= rowSum) {
-            for(int k = i + 1; k < rows; k++) {
-                double potentialDiag = fabs(data[k][i]);
-                double potentialSum = 0.0;
+    // Greedy start: each remaining row takes its largest free entry
+    vector<int> freeRows;
+    for (int k = 0; k < n; k++) {
+        if (colOf[k] >= 0) {
+            continue;
+        }
+        int bestCol = -1;
+        double best = 0.0;
+        forEachEntry(k, [&](int j, double v) {
+            if (rowAt[j] < 0 && fabs(v) > best) {
+                best = fabs(v);
+                bestCol = j;
+            }
+        });
+        if (bestCol >= 0) {
+            rowAt[bestCol] = k;
+            colOf[k] = bestCol;
+        } else {
+            freeRows.push_back(k);
+        }
+    }
 
-                for(int j = 0; j < cols; j++) {
-                    if (j != i) {
-                        potentialSum += fabs(data[k][j]);
-                    }
+    // Breadth-first search from row r for a free column, through matched
+    // columns (not locked ones when keepLocked); the path found is flipped.
+    // seen[] holds the search that last reached each column.
+    vector<int> seen(n, -1), parentRow(n), queue;
+    int searches = 0;
+    auto augment = [&](int r, bool keepLocked) {
+        int stamp = searches++;
+        queue.assign(1, r);
+        for (size_t q = 0; q < queue.size(); q++) {
+            int u = queue[q];
+            int found = -1;
+            forEachEntry(u, [&](int j, double) {
+                if (found >= 0 || seen[j] == stamp || (keepLocked && locked[j])) {
+                    return;
                 }
-
-                if(potentialDiag > potentialSum) {
-                    bestRow = k;
-                    break;
+                seen[j] = stamp;
+                parentRow[j] = u;
+                if (rowAt[j] < 0) {
+                    found = j;
+                } else {
+                    queue.push_back(rowAt[j]);
                 }
+            });
+            for (int j = found; j >= 0;) {
+                int v = parentRow[j];
+                int previous = colOf[v];
+                colOf[v] = j;
+                rowAt[j] = v;
+                j = previous;
             }
-
-            if (bestRow != i) {
-                swap(data[i], data[bestRow]);
-            } else {
-                cout << "Cannot make matrix diagonally dominant at row " << i << endl;
-                return false;
+            if (found >= 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    for (bool keepLocked : {true, false}) {
+        vector<int> unmatched;
+        for (int k : freeRows) {
+            if (!augment(k, keepLocked)) {
+                unmatched.push_back(k);
             }
         }
+        freeRows.swap(unmatched);
+    }
+
+    for (int j = 0, f = 0; j < n; j++) {
+        if (rowAt[j] < 0) {
+            rowAt[j] = freeRows[f++];
+        }
+    }
+    order = move(rowAt);
+    for (int j = 0; j < n; j++) {
+        if (!dominantAt(order[j], j)) {
+            return false;
+        }
     }
     return true;
 }
 
+// The same over CSR, for matrices the sweeps run sparse anyway
+bool sparseDominantRowOrder(const SparseMatrix& A, vector<int>& order) {
+    const vector<int>& rowPtr = A.rowPointers();
+    const vector<int>& colIdx = A.columnIndices();
+    const vector<double>& values = A.nonZeroValues();
+    return dominantRowOrder(A.getRows(), [&](int k, auto&& fn) {
+        for (int p = rowPtr[k]; p < rowPtr[k + 1]; p++) {
+            fn(colIdx[p], values[p]);
+        }
+    }, order);
+}
+
+// The system Jacobi and Seidel iterate: row i is row order[i] of A, which
+// stays where it is, and rhs[i] = b[order[i]]. The order is A's own when A
+// is dominant. When the sweeps run sparse, S gets the reordered CSR copy.
+void stationaryOrder(const Matrix& A, const vector<double>& b, bool sparse, vector<int>& order,
+                     vector<double>& rhs, SparseMatrix& S) {
+    int n = A.getRows();
+    order.resize(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    bool dominant = A.isDiagonallyDominant();
+    if (sparse) {
+        S = SparseMatrix::fromDense(A);
+        if (!dominant) {
+            sparseDominantRowOrder(S, order);
+            S = S.permuteRows(order);
+        }
+    } else if (!dominant) {
+        A.diagonallyDominantOrder(order);
+    }
+    rhs.resize(n);
+    for (int i = 0; i < n; i++) {
+        rhs[i] = b[order[i]];
+    }
+}
+
+// Dense relaxation sweeps x_i += omega * (rhs_i - A_i x) / a_ii over row
+// order[i] of A, in place; with symmetric set each forward sweep is
+// followed by a backward one (SSOR). The diagonal goes into the dot product
+// with the rest of the row, so each update is one SIMD pass. A dense row
+// reads every unknown, so there is no coloring to run rows in parallel.
+IterativeResult denseRelax(const Matrix& A, const vector<int>& order, const vector<double>& rhs, double omega,
+                           bool symmetric, int maxIterations, double tolerance, Convergence criterion,
+                           const char* sample) {
+    int n = A.getRows();
+    IterativeResult result;
+    vector<double>& x = result.x;
+    x.assign(n, 0.0);
+    double bNorm = 0.0;
+    for (int i = 0; i < n; i++) {
+        bNorm += rhs[i] * rhs[i];
+    }
+    bNorm = sqrt(bNorm);
+
+    double change = 0.0;
+    auto update = [&](int i) {
+        const double* row = &A(order[i], 0);
+        double delta = omega * (rhs[i] - dotProduct(row, x.data(), n)) / row[i];
+        x[i] += delta;
+        change = max(change, fabs(delta));
+    };
+
+    for (int iter = 0; iter < maxIterations; iter++) {
+        change = 0.0;
+        for (int i = 0; i < n; i++) {
+            update(i);
+        }
+        if (symmetric) {
+            for (int i = n - 1; i >= 0; i--) {
+                update(i);
+            }
+        }
+
+        double error = change;
+        if (criterion == Convergence::RelativeResidual) {
+            double s = 0.0;
+            for (int i = 0; i < n; i++) {
+                double r = rhs[i] - dotProduct(&A(order[i], 0), x.data(), n);
+                s += r * r;
+            }
+            error = (bNorm > 0.0) ? sqrt(s) / bNorm : sqrt(s);
+        }
+
+        telemetrySample(sample, iter + 1, error);
+        result.residualHistory.push_back(error);
+        result.iterations = iter + 1;
+        if (error < tolerance) {
+            result.converged = true;
+            break;
+        }
+    }
+    return result;
+}
+
+}
+
+bool Matrix::diagonallyDominantOrder(vector<int>& order) const {
+    order.clear();
+    if (rows != cols) {
+        return false;
+    }
+    TELEMETRY_SCOPE("diagonallyDominantOrder");
+    if (isSparseEnough()) {
+        return sparseDominantRowOrder(SparseMatrix::fromDense(*this), order);
+    }
+    return dominantRowOrder(rows, [&](int k, auto&& fn) {
+        const double* row = &(*this)(k, 0);
+        for (int j = 0; j < cols; j++) {
+            if (row[j] != 0.0) {
+                fn(j, row[j]);
+            }
+        }
+    }, order);
+}
+
+// Rows are put in place by following the cycles of the order, one swap
+// per row moved
+bool Matrix::makeDiagonallyDominant() {
+    vector<int> order;
+    bool dominant = diagonallyDominantOrder(order);
+    vector<char> placed(order.size(), 0);
+    for (int s = 0; s < (int)order.size(); s++) {
+        if (placed[s]) {
+            continue;
+        }
+        placed[s] = 1;
+        for (int j = s; order[j] != s; j = order[j]) {
+            swap_ranges(&(*this)(j, 0), &(*this)(j, 0) + cols, &(*this)(order[j], 0));
+            placed[order[j]] = 1;
+        }
+    }
+    return dominant;
+}
+
+
+vector<double> Matrix::gaussJacobi(vector<double>& b, int maxIterations, double tolerance) const
+{
+    return tryGaussJacobi(b, maxIterations, tolerance).value().x;
+}
+
+vector<double> Matrix::gaussSeidel(vector<double>& b, int maxIterations, double tolerance,
+                                   Convergence criterion) const
+{
+    return tryGaussSeidel(b, maxIterations, tolerance, criterion).value().x;
+}
+
+vector<double> Matrix::sor(const vector<double>& b, double omega, int maxIterations, double tolerance,
+                           Convergence criterion) const
+{
+    return trySor(b, omega, maxIterations, tolerance, criterion).value().x;
+}
 
-// Gauss-Jacobi
-vector<double> Matrix::gaussJacobi(vector<double>& b, int maxIterations, double tolerance) 
+vector<double> Matrix::ssor(const vector<double>& b, double omega, int maxIterations, double tolerance,
+                            Convergence criterion) const
+{
+    return trySsor(b, omega, maxIterations, tolerance, criterion).value().x;
+}
+
+// Gauss-Jacobi. A matrix that is not diagonally dominant is iterated in
+// the row order that makes it so, or that comes closest; it may then not
+// converge.
+Result<IterativeResult> Matrix::tryGaussJacobi(const vector<double>& b, int maxIterations, double tolerance) const
 {
     if (rows != cols) 
     {
-        cout << "Matrix must be square for Gauss-Jacobi method!" << endl;
-        return vector<double>();
+        return Result<IterativeResult>(StatusCode::NotSquare, "Matrix must be square for Gauss-Jacobi method");
     }
     
     if (rows != (int)b.size()) 
     {
-        cout << "Vector b must have the same size as matrix rows!" << endl;
-        return vector<double>();
+        return Result<IterativeResult>(StatusCode::DimensionMismatch,
+                                       "Vector b must have the same size as matrix rows");
     }
     
+    TELEMETRY_SCOPE("gaussJacobi");
     int n = rows;
-    vector<double> x(n, 0.0); 
+    IterativeResult result;
+    vector<double>& x = result.x;
+    x.assign(n, 0.0); 
     vector<double> x_new(n, 0.0);
     
-    if (!isDiagonallyDominant()) 
+    bool sparse = isSparseEnough();
+    vector<int> order;
+    vector<double> rhs;
+    SparseMatrix S;
+    stationaryOrder(*this, b, sparse, order, rhs, S);
+    
+    if (sparse) 
     {
-    	if(!makeDiagonallyDominant()){
-        	cout << "Warning: Matrix is not diagonally dominant, Gauss-Jacobi may not converge!" << endl;
-    	}
+        return S.gaussJacobi(rhs, maxIterations, tolerance);
     }
     
     for (int i = 0; i < n; i++) 
     {
-        if(fabs(data[i][i]) < 1e-10) 
+        if(fabs((*this)(order[i], i)) < 1e-10) 
         {
-            cout << "Error: Zero diagonal element detected. Cannot use Gauss-Jacobi method!" << endl;
-            return vector<double>();
+            return Result<IterativeResult>(StatusCode::ZeroDiagonal,
+                                           "Zero diagonal element detected. Cannot use Gauss-Jacobi method");
         }
     }
     
-    // Approximation
+    // Approximation: x_new = x + (b - A x) / a_ii, which needs no j != i
+    // test, so each row is one SIMD dot product. Row blocks run in parallel,
+    // each summing its own share of the error during the sweep; the buffers
+    // are swapped afterwards instead of copied.
+    vector<double> invDiag(n);
+    for(int i = 0; i < n; i++) 
+    {
+        invDiag[i] = 1.0 / (*this)(order[i], i);
+    }
+    vector<double> partial((n + jacobiRowTile - 1) / jacobiRowTile);
+    
     for(int iter = 0; iter < maxIterations; iter++) 
     {
-        for(int i = 0; i < n; i++) 
+        const double* xp = x.data();
+        double* xn = x_new.data();
+        parallelTiles(n, n, jacobiRowTile, n, [&](int i0, int i1, int, int) 
         {
-            double sum = 0.0;
-            for(int j = 0; j < n; j++) 
+            double err = 0.0;
+            for(int i = i0; i < i1; i++) 
             {
-                if(j!=i) 
-                {
-                    sum += data[i][j] * x[j];
-                }
+                double r = rhs[i] - dotProduct(&(*this)(order[i], 0), xp, n);
+                xn[i] = xp[i] + r * invDiag[i];
+                err += fabs(xn[i] - xp[i]);
             }
-            x_new[i] = (b[i] - sum) / data[i][i];
-        }
+            partial[i0 / jacobiRowTile] = err;
+        });
+        x.swap(x_new);
         
-        // Check convergence
+        // Tile sums added in a fixed order, whatever the thread count
         double error = 0.0;
-        for (int i = 0; i < n; i++) 
+        for(double e : partial) 
         {
-            error += fabs(x_new[i] - x[i]);
+            error += e;
         }
         
-        x = x_new;
-        
+        telemetrySample("gaussJacobi.error", iter + 1, error);
+        result.residualHistory.push_back(error);
+        result.iterations = iter + 1;
         if (error < tolerance) 
         {
-            cout << "Gauss-Jacobi converged after " << iter + 1 << " iterations." << endl;
-            return x;
+            result.converged = true;
+            break;
         }
     }
     
-    cout << "Gauss-Jacobi did not converge within " << maxIterations << " iterations." << endl;
-    return x;
+    return result;
 }
 
-// Gauss-Seidel 
-vector<double> Matrix::gaussSeidel(vector<double>& b, int maxIterations, double tolerance) {
+// Gauss-Seidel, reordering for diagonal dominance as Gauss-Jacobi does.
+// Sparse input runs the multicolor sweep, whose rows of one color update in
+// parallel.
+Result<IterativeResult> Matrix::tryGaussSeidel(const vector<double>& b, int maxIterations, double tolerance,
+                                               Convergence criterion) const {
     if(rows != cols) 
     {
-        cout << "Matrix must be square for Gauss-Seidel method!" << endl;
-        return vector<double>();
+        return Result<IterativeResult>(StatusCode::NotSquare, "Matrix must be square for Gauss-Seidel method");
     }
     
     if(rows != (int)b.size()) 
     {
-        cout << "Vector b must have the same size as matrix rows!" << endl;
-        return vector<double>();
+        return Result<IterativeResult>(StatusCode::DimensionMismatch,
+                                       "Vector b must have the same size as matrix rows");
     }
     
+    TELEMETRY_SCOPE("gaussSeidel");
     int n = rows;
-    vector<double> x(n, 0.0);    
-    vector<double> x_prev(n, 0.0); 
+    bool sparse = isSparseEnough();
+    vector<int> order;
+    vector<double> rhs;
+    SparseMatrix S;
+    stationaryOrder(*this, b, sparse, order, rhs, S);
     
-    if (!isDiagonallyDominant()) 
+    if (sparse) 
     {
-        if(!makeDiagonallyDominant()){
-        	cout << "Warning: Matrix is not diagonally dominant, Gauss-Jacobi may not converge!" << endl;
-    	}
+        return S.multicolorGaussSeidel(rhs, maxIterations, tolerance, criterion);
     }
     
     for(int i = 0; i < n; i++) 
     {
-        if (fabs(data[i][i]) < 1e-10) 
+        if (fabs((*this)(order[i], i)) < 1e-10) 
         {
-            cout << "Error: Zero diagonal element detected. Cannot use Gauss-Seidel method!" << endl;
-            return vector<double>();
+            return Result<IterativeResult>(StatusCode::ZeroDiagonal,
+                                           "Zero diagonal element detected. Cannot use Gauss-Seidel method");
         }
     }
     
-    //Approximation
-    for(int iter = 0; iter < maxIterations; iter++) 
+    return denseRelax(*this, order, rhs, 1.0, false, maxIterations, tolerance, criterion, "gaussSeidel.error");
+}
+
+// Successive over-relaxation
+Result<IterativeResult> Matrix::trySor(const vector<double>& b, double omega, int maxIterations, double tolerance,
+                                       Convergence criterion) const
+{
+    return relax(b, omega, false, maxIterations, tolerance, criterion);
+}
+
+// Symmetric SOR: a forward sweep and then a backward one per iteration
+Result<IterativeResult> Matrix::trySsor(const vector<double>& b, double omega, int maxIterations, double tolerance,
+                                        Convergence criterion) const
+{
+    return relax(b, omega, true, maxIterations, tolerance, criterion);
+}
+
+Result<IterativeResult> Matrix::relax(const vector<double>& b, double omega, bool symmetric, int maxIterations,
+                                      double tolerance, Convergence criterion) const
+{
+    const char* method = symmetric ? "SSOR" : "SOR";
+    if(rows != cols) 
     {
-        x_prev = x;
-        
-        for(int i = 0; i < n; i++){
-            double sum1 = 0.0;
-            double sum2 = 0.0;
-            
-            for(int j = 0; j < i; j++) 
-            {
-                sum1 += data[i][j] * x[j]; 
-            }
-            
-            for(int j = i + 1; j < n; j++) 
-            {
-                sum2 += data[i][j] * x_prev[j];
-            }
-            
-            x[i] = (b[i] - sum1 - sum2) / data[i][i];
-        }
-        
-        // Check Convergence
-        double error = 0.0;
-        for(int i = 0; i < n; i++) 
-        {
-            error += fabs(x[i] - x_prev[i]);
-        }
-        
-        if(error < tolerance) 
+        return Result<IterativeResult>(StatusCode::NotSquare, string("Matrix must be square for ") + method +
+                                                              " method");
+    }
+    
+    if(rows != (int)b.size()) 
+    {
+        return Result<IterativeResult>(StatusCode::DimensionMismatch,
+                                       "Vector b must have the same size as matrix rows");
+    }
+    
+    if(omega <= 0.0 || omega >= 2.0) 
+    {
+        return Result<IterativeResult>(StatusCode::InvalidArgument, "Relaxation factor must lie in (0, 2)");
+    }
+    
+    for(int i = 0; i < rows; i++) 
+    {
+        if (fabs((*this)(i, i)) < 1e-10) 
         {
-            cout << "Gauss-Seidel converged after " << iter + 1 << " iterations." << endl;
-            return x;
+            return Result<IterativeResult>(StatusCode::ZeroDiagonal, string("Zero diagonal element detected. ") +
+                                                                     "Cannot use " + method + " method");
         }
     }
     
-    cout << "Gauss-Seidel did not converge within " << maxIterations << " iterations." << endl;
-    return x;
+    if (isSparseEnough()) 
+    {
+        SparseMatrix S = SparseMatrix::fromDense(*this);
+        return symmetric ? S.ssor(b, omega, maxIterations, tolerance, criterion)
+                         : S.sor(b, omega, maxIterations, tolerance, criterion);
+    }
+    
+    TELEMETRY_SCOPE("sor");
+    vector<int> order(rows);
+    for(int i = 0; i < rows; i++) 
+    {
+        order[i] = i;
+    }
+    return denseRelax(*this, order, b, omega, symmetric, maxIterations, tolerance, criterion,
+                      symmetric ? "ssor.error" : "sor.error");
+}
+
+namespace {
+
+// Common front end of the Krylov wrappers below: checks the system and runs
+// the solver on a dense or CSR operator with a Jacobi preconditioner
+Result<IterativeResult> runKrylov(const Matrix& A, bool sparse, const vector<double>& b, const string& method,
+                                  const function<Result<IterativeResult>(const LinearOperator&,
+                                                                         const Preconditioner&)>& solver) {
+    if (A.getRows() != A.getCols()) {
+        return Result<IterativeResult>(StatusCode::NotSquare, "Matrix must be square for " + method + " method");
+    }
+    if (A.getRows() != (int)b.size()) {
+        return Result<IterativeResult>(StatusCode::DimensionMismatch,
+                                       "Vector b must have the same size as matrix rows");
+    }
+    if (sparse) {
+        SparseMatrix S = SparseMatrix::fromDense(A);
+        return solver(SparseOperator(S), JacobiPreconditioner(S));
+    }
+    return solver(DenseOperator(A), JacobiPreconditioner(A));
+}
+
+}
+
+vector<double> Matrix::conjugateGradient(const vector<double>& b, int maxIterations, double tolerance) const {
+    return tryConjugateGradient(b, maxIterations, tolerance).value().x;
+}
+
+vector<double> Matrix::biCGSTAB(const vector<double>& b, int maxIterations, double tolerance) const {
+    return tryBiCGSTAB(b, maxIterations, tolerance).value().x;
+}
+
+vector<double> Matrix::gmres(const vector<double>& b, int restart, int maxIterations, double tolerance) const {
+    return tryGmres(b, restart, maxIterations, tolerance).value().x;
+}
+
+// Conjugate Gradient; A should be symmetric positive definite, which is
+// not checked
+Result<IterativeResult> Matrix::tryConjugateGradient(const vector<double>& b, int maxIterations,
+                                                     double tolerance) const {
+    return runKrylov(*this, isSparseEnough(), b, "Conjugate Gradient",
+                     [&](const LinearOperator& A, const Preconditioner& M) {
+                         return ::conjugateGradient(A, b, &M, maxIterations, tolerance);
+                     });
+}
+
+// BiCGSTAB
+Result<IterativeResult> Matrix::tryBiCGSTAB(const vector<double>& b, int maxIterations, double tolerance) const {
+    return runKrylov(*this, isSparseEnough(), b, "BiCGSTAB",
+                     [&](const LinearOperator& A, const Preconditioner& M) {
+                         return ::biCGSTAB(A, b, &M, maxIterations, tolerance);
+                     });
+}
+
+// GMRES(restart)
+Result<IterativeResult> Matrix::tryGmres(const vector<double>& b, int restart, int maxIterations,
+                                         double tolerance) const {
+    return runKrylov(*this, isSparseEnough(), b, "GMRES",
+                     [&](const LinearOperator& A, const Preconditioner& M) {
+                         return ::gmres(A, b, &M, restart, maxIterations, tolerance);
+                     });
+}
+
+vector<double> Matrix::mixedPrecisionSolve(const vector<double>& b, int maxIterations, double tolerance) const {
+    return tryMixedPrecisionSolve(b, maxIterations, tolerance).value().x;
+}
+
+Result<IterativeResult> Matrix::tryMixedPrecisionSolve(const vector<double>& b, int maxIterations,
+                                                       double tolerance) const {
+    return ::mixedPrecisionSolve(*this, b, maxIterations, tolerance);
 }
@@ -1,64 +1,428 @@
 #ifndef MATRIX_HPP
 #define MATRIX_HPP
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <memory>
+#include <cassert>
+#include "status.hpp"
 
 using namespace std;
 
+// 64-byte aligned raw blocks. Large blocks are recycled through a small
+// per-thread cache so same-shaped temporaries don't fault in fresh pages.
+void* alignedAllocate(size_t bytes);
+void alignedRelease(void* p, size_t bytes) noexcept;
+
+// Leading dimension, in elements, for rows of cols elements of elementSize
+// bytes each; Matrix and BasicMatrix<T> both pad their rows by it
+int paddedStride(int cols, size_t elementSize);
+
+// Allocator handing out cache-line aligned blocks, so every Matrix buffer
+// (and, thanks to the padded leading dimension, every row) starts on a
+// 64-byte boundary.
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    static_assert(Alignment <= 64, "alignedAllocate only guarantees 64-byte alignment");
+
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept {}
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(alignedAllocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        alignedRelease(p, n * sizeof(T));
+    }
+
+    // Default- rather than value-initialize, so resize() leaves the memory
+    // alone for buffers a kernel is about to overwrite anyway.
+    template<typename U>
+    void construct(U* p) { ::new(static_cast<void*>(p)) U; }
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+// Non-owning view over `size` elements spaced `step` apart. A row of a
+// Matrix is a view with step 1, a column one with step == leading dimension.
+template<typename T>
+class StridedView {
+private:
+    T* ptr;
+    int len;
+    int step;
+
+public:
+    StridedView(T* p, int n, int s) : ptr(p), len(n), step(s) {}
+
+    int size() const { return len; }
+    int stride() const { return step; }
+    T* data() const { return ptr; }
+    T& operator[](int k) const { return ptr[(size_t)k * step]; }
+};
+
+using RowView = StridedView<double>;
+using ConstRowView = StridedView<const double>;
+using ColView = StridedView<double>;
+using ConstColView = StridedView<const double>;
+
+class LUFactorization;
+class CholeskyFactorization;
+
+// Header of the binary matrix file. Integers are little-endian; the data
+// starts at byteOffset, a multiple of 64, so a mapped file is as aligned
+// as a Matrix buffer.
+struct MatrixFileHeader {
+    char magic[8];           // "NCMATRIX"
+    uint32_t version;        // MatrixFileHeader::currentVersion
+    uint32_t dtype;          // 1 = IEEE double
+    uint32_t layout;         // 0 = row-major, rows `stride` doubles apart
+    uint32_t byteOffset;     // start of the data
+    int64_t rows;
+    int64_t cols;
+    int64_t stride;
+    uint64_t checksum;       // of the rows x cols values, padding excluded
+    uint8_t reserved[8];
+
+    static const uint32_t currentVersion = 1;
+};
+static_assert(sizeof(MatrixFileHeader) == 64, "header must stay 64 bytes");
+
+// Stopping tests for the relaxation solvers: the largest change of any
+// entry of x in one iteration, or ||b - A x||_2 / ||b||_2.
+enum class Convergence { MaxChange, RelativeResidual };
+
+struct IterativeResult {
+    vector<double> x;
+    int iterations = 0;
+    bool converged = false;
+    // The quantity tested against the tolerance after each iteration:
+    // ||b - A x_k|| / ||b|| for the Krylov methods, the chosen Convergence
+    // measure for the relaxation methods
+    vector<double> residualHistory;
+};
+
+// What one pass over a matrix finds out about it; see Matrix::properties
+struct MatrixProperties {
+    bool symmetric = false;           // |a_ij - a_ji| <= 1e-10; square only
+    bool diagonallyDominant = false;  // strictly, by rows; square only
+    bool positiveDiagonal = false;    // every a_ii > 0; square only
+    int lowerBandwidth = 0;           // see Matrix::bandwidth
+    int upperBandwidth = 0;
+    long long nonZeros = 0;
+    double normInf = 0.0;             // largest absolute row sum
+    double normFrobenius = 0.0;       // an upper bound on the 2-norm
+};
+
+class MatrixFileWriter;
+
+// Expression nodes, see expression.hpp
+template<typename E> class MatrixExpr;
+template<typename R> class ProductExpr;
+struct NoTerm;
+class TransposeExpr;
+
 class Matrix {
+    friend class MatrixFileWriter;
+
 private:
     int rows, cols;
-    vector<vector<double>> data;
+    int ld;  // leading dimension: distance in doubles between row starts
+    vector<double, AlignedAllocator<double>> data;
+    // Element storage: data.data(), or a file mapping that `mapping` keeps
+    // alive. Mapped pages are private, so writes never reach the file.
+    double* base;
+    shared_ptr<void> mapping;
+    // Cached properties(); shared by copies, dropped by anything that may
+    // write an entry
+    mutable shared_ptr<const MatrixProperties> analysis;
+
+    void invalidate() {
+        if (analysis) {
+            analysis.reset();
+        }
+    }
+    MatrixProperties analyze() const;
+    // trySor and trySsor
+    Result<IterativeResult> relax(const vector<double>& b, double omega, bool symmetric, int maxIterations,
+                                  double tolerance, Convergence criterion) const;
+
+
+    // Shape-only construction for results every element of which is about to
+    // be written; the contents (padding included) start out unspecified.
+    struct Uninitialized {};
+    Matrix(int r, int c, Uninitialized);
+    Matrix(int r, int c, int stride, double* mapped, shared_ptr<void> owner);
+
+    // Evaluation of expressions in parallel tiles, wide so each row segment
+    // streams
+    static constexpr int elementwiseTileRows = 64;
+    static constexpr int elementwiseTileCols = 1024;
+    template<typename E>
+    void assignElements(const E& e);
+    void assignElements(const TransposeExpr& t);  // blocked, see transposeBlock
+    template<typename R>
+    void assignProduct(const ProductExpr<R>& p);
+    bool assignTerm(const NoTerm&);
+    template<typename E>
+    bool assignTerm(const MatrixExpr<E>& e);
+    void addTermTo(const NoTerm&);
+    template<typename E>
+    void addTermTo(const MatrixExpr<E>& e);
+    // *this = alpha * op(A) * op(B) + beta * *this, one GEMM; op transposes
+    // when asked
+    void productUpdate(const Matrix& A, bool transA, const Matrix& B, bool transB, double alpha, double beta);
 
 public:
     // Constructors
     Matrix();
     Matrix(int r, int c);
     Matrix(const Matrix& other);
+    Matrix(Matrix&& other) noexcept;
+    Matrix& operator=(const Matrix& other);
+    Matrix& operator=(Matrix&& other) noexcept;
     ~Matrix() {}
 
+    // Evaluate an expression (expression.hpp) straight into the result
+    template<typename E>
+    Matrix(const MatrixExpr<E>& e);
+    template<typename R>
+    Matrix(const ProductExpr<R>& p);
+    template<typename E>
+    Matrix& operator=(const MatrixExpr<E>& e);
+    template<typename R>
+    Matrix& operator=(const ProductExpr<R>& p);
+
     // Getters
     int getRows() const;
     int getCols() const;
-    double get(int i, int j) const;
-    void set(int i, int j, double val);
-
-    // Operations
-    Matrix operator+(Matrix& other);
-    Matrix operator-(Matrix& other);
-    Matrix operator*(Matrix& other);
-    Matrix transpose();
-    Matrix identityMatrix(int size);
-    bool isSymmetric();
-    double determinant();
-    bool isDiagonallyDominant();
+    int stride() const { return ld; }
+    // Bounds are checked by assert, so only in debug builds
+    double get(int i, int j) const {
+        assert(i >= 0 && i < rows && j >= 0 && j < cols);
+        return (*this)(i, j);
+    }
+    void set(int i, int j, double val) {
+        assert(i >= 0 && i < rows && j >= 0 && j < cols);
+        (*this)(i, j) = val;
+    }
+
+    // Unchecked element access and raw storage for kernels. The non-const
+    // forms count as writes and drop the cached properties(); a pointer or
+    // view kept from before the analysis and written through afterwards
+    // leaves it stale.
+    double& operator()(int i, int j) {
+        invalidate();
+        return base[(size_t)i * ld + j];
+    }
+    const double& operator()(int i, int j) const { return base[(size_t)i * ld + j]; }
+    double* raw() {
+        invalidate();
+        return base;
+    }
+    const double* raw() const { return base; }
+    bool isMapped() const { return mapping != nullptr; }
+
+    // Row / column views
+    RowView row(int i) { return RowView(raw() + (size_t)i * ld, cols, 1); }
+    ConstRowView row(int i) const { return ConstRowView(raw() + (size_t)i * ld, cols, 1); }
+    ColView col(int j) { return ColView(raw() + j, rows, ld); }
+    ConstColView col(int j) const { return ConstColView(raw() + j, rows, ld); }
+
+    // Symmetry, dominance, bandwidth, nonzeros and norms from one parallel
+    // pass, made on first use and kept until the matrix is written to, so
+    // the queries below and the solvers that check them pay for it once.
+    // Concurrent calls on the same matrix are safe.
+    MatrixProperties properties() const;
+    // The storage switches the solvers make from those properties: CSR for
+    // the sweeps, band storage for the direct solves (square only)
+    bool isSparseEnough() const;
+    bool isBandedEnough(int& lower, int& upper) const;
+
+    // Operations. +, -, * and scaling are lazy (expression.hpp); a shape
+    // mismatch gives an empty Matrix, or leaves it alone for the compound
+    // assignments.
+    Matrix& operator+=(const Matrix& other);
+    Matrix& operator-=(const Matrix& other);
+    Matrix& operator*=(double s);
+    template<typename E>
+    Matrix& operator+=(const MatrixExpr<E>& e);
+    template<typename E>
+    Matrix& operator-=(const MatrixExpr<E>& e);
+    template<typename R>
+    Matrix& operator+=(const ProductExpr<R>& p);  // one GEMM accumulating onto *this
+    template<typename R>
+    Matrix& operator-=(const ProductExpr<R>& p);
+    void multiplyAdd(const Matrix& A, const Matrix& B, double alpha = 1.0);  // *this += alpha*A*B
+    // Lazy: Matrix(A.transpose()) copies in cache-sized blocks, while
+    // A.transpose() * B hands the transpose to GEMM and never forms it
+    TransposeExpr transpose() const;
+    void transposeInPlace();  // square matrices without a second buffer
+    static Matrix identityMatrix(int size);
+    bool isSymmetric() const;
+    // Smallest lower and upper with a_ij == 0 whenever j < i - lower or
+    // j > i + upper
+    void bandwidth(int& lower, int& upper) const;
+    double determinant() const;
+    bool isDiagonallyDominant() const;
+    // Row order for the stationary methods: row i of the reordered system
+    // is row order[i] of A, and b[order[i]] its right-hand side. Rows go
+    // where they are strictly dominant; the rest are matched to nonzero
+    // diagonal entries where that is possible. Returns whether the order
+    // makes A strictly diagonally dominant. Row sums are taken once, and
+    // on sparse input the whole search is close to O(nnz).
+    bool diagonallyDominantOrder(vector<int>& order) const;
+    // Moves the rows of A itself into that order; b must follow by hand
 	bool makeDiagonallyDominant();
-    
-    void print();
-    void writeToFile(string filename);
+
+    void print() const;
+    Status writeToFile(string filename) const;
     static Matrix readFromFile(string filename);
-    
-    // Linear system solvers
-    vector<double> gaussianElimination(vector<double>& b);
-    
+    static Result<Matrix> tryReadFromFile(string filename);
+
+    // Binary format, filename + ".bin": a 64-byte MatrixFileHeader, then
+    // rows x stride doubles laid out exactly as in memory. loadBinary reads
+    // into a fresh buffer and verifies the checksum; mapBinary maps the file
+    // copy-on-write with no copy at all, verifying only when asked, since
+    // that reads every page. Copies of a mapped matrix are ordinary ones.
+    Status saveBinary(string filename) const;
+    static Matrix loadBinary(string filename);
+    static Matrix mapBinary(string filename, bool verifyChecksum = false);
+    static Result<Matrix> tryLoadBinary(string filename);
+    static Result<Matrix> tryMapBinary(string filename, bool verifyChecksum = false);
+
+    // The solvers and factorizations below never print. Each has a checked
+    // try... form returning a Result (status.hpp) that says why it failed;
+    // the plain form returns an empty result instead, as it always has.
+
+    // Linear system solvers. A square matrix whose nonzeros sit in a narrow
+    // band is solved as a BandedMatrix (banded.hpp) in O(n * bw^2).
+    vector<double> gaussianElimination(const vector<double>& b) const;
+    // AX = B for nrhs right-hand sides stored column-major (column r is
+    // B[r*n .. r*n + n)); factors once and solves all columns together.
+    vector<double> gaussianElimination(const vector<double>& B, int nrhs) const;
+
+    Result<vector<double>> tryGaussianElimination(const vector<double>& b) const;
+    Result<vector<double>> tryGaussianElimination(const vector<double>& B, int nrhs) const;
+
     // LU Decomposition
-    pair<Matrix, Matrix> luDecompositionDoolittle();
-    pair<Matrix, Matrix> luDecompositionCrout();
-    Matrix choleskyDecomposition();
-    
+    pair<Matrix, Matrix> luDecompositionDoolittle() const;
+    pair<Matrix, Matrix> luDecompositionCrout() const;
+    Result<pair<Matrix, Matrix>> tryLuDecompositionDoolittle() const;
+    Result<pair<Matrix, Matrix>> tryLuDecompositionCrout() const;
+    LUFactorization luFactorize() const;  // blocked, partial pivoting
+    // Fails with Singular when a pivot is numerically zero, where the
+    // plain form returns a factorization flagged isSingular()
+    Result<LUFactorization> tryLuFactorize() const;
+    // Pass checkSymmetry = false to skip the symmetry scan for a matrix
+    // already known to be symmetric positive definite.
+    Matrix choleskyDecomposition(bool checkSymmetry = true) const;
+    CholeskyFactorization choleskyFactorize(bool checkSymmetry = true) const;  // packed, blocked
+    Result<CholeskyFactorization> tryCholeskyFactorize(bool checkSymmetry = true) const;
+
     // Solve using LU
-    vector<double> solveLU(vector<double>& b, Matrix& L, Matrix& U);
-    
+    vector<double> solveLU(const vector<double>& b, const Matrix& L, const Matrix& U) const;
+    vector<double> solveLU(const vector<double>& b, const LUFactorization& lu) const;
+    vector<double> solveLU(const vector<double>& B, int nrhs, const LUFactorization& lu) const;
+
     // Gauss ELimination
-	vector<double> gaussJacobi(vector<double>& b, int maxIterations = 100, double tolerance = 1e-6);
-	vector<double> gaussSeidel(vector<double>& b, int maxIterations = 100, double tolerance = 1e-6);
+    // Jacobi and Seidel read the rows of A in diagonallyDominantOrder() when
+    // A is not dominant as it stands; neither A nor b is changed
+	vector<double> gaussJacobi(vector<double>& b, int maxIterations = 100, double tolerance = 1e-6) const;
+	vector<double> gaussSeidel(vector<double>& b, int maxIterations = 100, double tolerance = 1e-6,
+	                           Convergence criterion = Convergence::MaxChange) const;
+    // Successive over-relaxation, 0 < omega < 2, and its symmetric form,
+    // which follows each forward sweep with a backward one. Seidel, SOR and
+    // SSOR run multicolor-parallel on CSR when A is sparse enough; there
+    // MaxChange is the largest change of an entry, as it is for them dense.
+    vector<double> sor(const vector<double>& b, double omega, int maxIterations = 100, double tolerance = 1e-6,
+                       Convergence criterion = Convergence::MaxChange) const;
+    vector<double> ssor(const vector<double>& b, double omega, int maxIterations = 100, double tolerance = 1e-6,
+                        Convergence criterion = Convergence::MaxChange) const;
+    // Not converging within maxIterations is not a failure: the Result
+    // holds the last iterate with converged == false
+    Result<IterativeResult> tryGaussJacobi(const vector<double>& b, int maxIterations = 100,
+                                           double tolerance = 1e-6) const;
+    Result<IterativeResult> tryGaussSeidel(const vector<double>& b, int maxIterations = 100,
+                                           double tolerance = 1e-6,
+                                           Convergence criterion = Convergence::MaxChange) const;
+    Result<IterativeResult> trySor(const vector<double>& b, double omega, int maxIterations = 100,
+                                   double tolerance = 1e-6, Convergence criterion = Convergence::MaxChange) const;
+    Result<IterativeResult> trySsor(const vector<double>& b, double omega, int maxIterations = 100,
+                                    double tolerance = 1e-6, Convergence criterion = Convergence::MaxChange) const;
+
+    // Krylov solvers, Jacobi preconditioned. krylov.hpp has the versions
+    // that take any operator and preconditioner and report residual history.
+    vector<double> conjugateGradient(const vector<double>& b, int maxIterations = 1000, double tolerance = 1e-8) const;
+    vector<double> biCGSTAB(const vector<double>& b, int maxIterations = 1000, double tolerance = 1e-8) const;
+    vector<double> gmres(const vector<double>& b, int restart = 30, int maxIterations = 1000, double tolerance = 1e-8) const;
+    Result<IterativeResult> tryConjugateGradient(const vector<double>& b, int maxIterations = 1000,
+                                                 double tolerance = 1e-8) const;
+    Result<IterativeResult> tryBiCGSTAB(const vector<double>& b, int maxIterations = 1000, double tolerance = 1e-8) const;
+    Result<IterativeResult> tryGmres(const vector<double>& b, int restart = 30, int maxIterations = 1000,
+                                     double tolerance = 1e-8) const;
 
-    // 
+    // LU in float refined to double accuracy, see precision.hpp. Not
+    // converging means A is too ill-conditioned for it.
+    vector<double> mixedPrecisionSolve(const vector<double>& b, int maxIterations = 30,
+                                       double tolerance = 1e-14) const;
+    Result<IterativeResult> tryMixedPrecisionSolve(const vector<double>& b, int maxIterations = 30,
+                                                   double tolerance = 1e-14) const;
+
+    //
 
     // Friend operators for I/O - changed to const references
     friend ostream& operator<<(ostream& os, const Matrix& mat);
     friend istream& operator>>(istream& is, Matrix& mat);
 };
+
+// Writes a binary matrix file (see Matrix::saveBinary) a block of rows at a
+// time, so a matrix larger than memory can be produced. The checksum is
+// accumulated as rows arrive and patched into the header by close().
+class MatrixFileWriter {
+private:
+    ofstream out;
+    int rows, cols, ld;
+    int written;
+    uint64_t checksum;
+    uint64_t lanes[4];      // checksum state of the current block of rows
+    vector<double> padded;  // one row, zero padded to the stride
+    Status failure;
+
+public:
+    MatrixFileWriter(const string& filename, int rows, int cols);
+    ~MatrixFileWriter();
+    MatrixFileWriter(const MatrixFileWriter&) = delete;
+    MatrixFileWriter& operator=(const MatrixFileWriter&) = delete;
+
+    bool isOpen() const { return out.is_open(); }
+    int rowsWritten() const { return written; }
+
+    // The first failure so far: opening, a write, or too many rows
+    const Status& status() const { return failure; }
+
+    // Appends `count` rows, row r at src + r * srcStride
+    Status writeRows(const double* src, int count, int srcStride);
+    // Also fails when fewer rows than promised were written
+    Status close();
+};
+
+#include "expression.hpp"
 #endif
@@ -0,0 +1,115 @@
+#include "precision.hpp"
+#include "lu.hpp"
+#include "krylov.hpp"
+#include "gemm.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+double norm(const vector<double>& v) {
+    return sqrt(dotProduct(v.data(), v.data(), (int)v.size()));
+}
+
+}
+
+template<typename T>
+BasicMatrix<T>::BasicMatrix() : rows(0), cols(0), ld(0) {}
+
+template<typename T>
+BasicMatrix<T>::BasicMatrix(int r, int c) : rows(r), cols(c), ld(paddedStride(c, sizeof(T))) {
+    data.assign((size_t)r * ld, T(0));
+}
+
+template<typename T>
+BasicMatrix<T>::BasicMatrix(const Matrix& m) : BasicMatrix(m.getRows(), m.getCols()) {
+    for (int i = 0; i < rows; i++) {
+        const double* src = &m(i, 0);
+        T* dst = raw() + (size_t)i * ld;
+        for (int j = 0; j < cols; j++) {
+            dst[j] = (T)src[j];
+        }
+    }
+}
+
+template<typename T>
+Matrix BasicMatrix<T>::toMatrix() const {
+    Matrix m(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        const T* src = raw() + (size_t)i * ld;
+        double* dst = &m(i, 0);
+        for (int j = 0; j < cols; j++) {
+            dst[j] = (double)src[j];
+        }
+    }
+    return m;
+}
+
+template class BasicMatrix<float>;
+template class BasicMatrix<double>;
+template class BasicMatrix<long double>;
+
+Result<IterativeResult> mixedPrecisionSolve(const Matrix& A, const vector<double>& b, int maxIterations,
+                                            double tolerance) {
+    int n = A.getRows();
+    if (A.getCols() != n) {
+        return Result<IterativeResult>(StatusCode::NotSquare, "Matrix must be square for mixed-precision solve");
+    }
+    if ((int)b.size() != n) {
+        return Result<IterativeResult>(StatusCode::DimensionMismatch, "Dimensions mismatch in mixed-precision solve");
+    }
+
+    TELEMETRY_SCOPE("mixed.solve");
+    BasicLUFactorization<float> lu;
+    {
+        TELEMETRY_SCOPE("mixed.factor");
+        lu = BasicLUFactorization<float>(MatrixF(A));
+    }
+    if (!lu.status()) {
+        return lu.status();
+    }
+
+    IterativeResult result;
+    result.x.assign(n, 0.0);
+    double bNorm = norm(b);
+    if (bNorm == 0.0) {
+        result.converged = true;
+        return result;
+    }
+
+    // x starts at 0, so the first correction is the plain float solve
+    DenseOperator op(A);
+    vector<double> r = b, Ax(n);
+    vector<float> d(n);
+    double previous = numeric_limits<double>::infinity();
+    for (int k = 0; k < maxIterations; k++) {
+        for (int i = 0; i < n; i++) {
+            d[i] = (float)r[i];
+        }
+        lu.solveInPlace(d.data(), n, 1);
+        for (int i = 0; i < n; i++) {
+            result.x[i] += d[i];
+        }
+
+        op.apply(result.x, Ax);
+        for (int i = 0; i < n; i++) {
+            r[i] = b[i] - Ax[i];
+        }
+        double relative = norm(r) / bNorm;
+        result.residualHistory.push_back(relative);
+        result.iterations = k + 1;
+        if (relative <= tolerance) {
+            result.converged = true;
+            break;
+        }
+        if (!isfinite(relative) || relative > 0.5 * previous) {
+            break;
+        }
+        previous = relative;
+    }
+    telemetryCount("mixed.iterations", result.iterations);
+    return result;
+}
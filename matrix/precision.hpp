@@ -0,0 +1,51 @@
+#ifndef PRECISION_HPP
+#define PRECISION_HPP
+#include "matrix.hpp"
+
+// Dense matrix of float, double or long double, laid out like a Matrix:
+// row-major, 64-byte aligned, rows padded to whole cache lines. Matrix
+// itself stays double and keeps all the solvers; this is the storage for
+// factoring in another precision (BasicLUFactorization in lu.hpp) and for
+// carrying the result back.
+template<typename T>
+class BasicMatrix {
+private:
+    int rows, cols;
+    int ld;  // leading dimension: distance in elements between row starts
+    vector<T, AlignedAllocator<T>> data;
+
+public:
+    BasicMatrix();
+    BasicMatrix(int r, int c);
+    // Entry by entry, rounded or widened to T
+    explicit BasicMatrix(const Matrix& m);
+    Matrix toMatrix() const;
+
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    int stride() const { return ld; }
+    T& operator()(int i, int j) { return data[(size_t)i * ld + j]; }
+    const T& operator()(int i, int j) const { return data[(size_t)i * ld + j]; }
+    T* raw() { return data.data(); }
+    const T* raw() const { return data.data(); }
+};
+
+typedef BasicMatrix<float> MatrixF;
+typedef BasicMatrix<double> MatrixD;
+typedef BasicMatrix<long double> MatrixLD;
+
+extern template class BasicMatrix<float>;
+extern template class BasicMatrix<double>;
+extern template class BasicMatrix<long double>;
+
+// Mixed-precision solve of Ax = b: A is factored in float, at twice the
+// GEMM rate and half the memory traffic of double, then x is refined with
+// residuals b - Ax computed in double and corrections solved with the float
+// factors, until ||b - Ax|| / ||b|| <= tolerance. The history records that
+// ratio after each correction. Refinement stops early, not converged, once
+// a correction no longer halves the residual: A is too ill-conditioned for
+// float (roughly cond(A) > 1e6) and a double factorization is needed.
+Result<IterativeResult> mixedPrecisionSolve(const Matrix& A, const vector<double>& b, int maxIterations = 30,
+                                            double tolerance = 1e-14);
+
+#endif
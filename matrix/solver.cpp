@@ -0,0 +1,230 @@
+#include "solver.hpp"
+#include "lu.hpp"
+#include "cholesky.hpp"
+#include "banded.hpp"
+#include "krylov.hpp"
+#include "telemetry.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+namespace {
+
+// A direct solution whose normwise backward error
+// ||b - A x||_inf / (||A||_inf ||x||_inf + ||b||_inf) is larger than this
+// went through a pivot the factorization should have refused
+const double directBackwardError = 1e-8;
+
+// Room between the residual an iterative backend tracks and the true one
+// recomputed from A
+const double residualSlack = 10.0;
+
+struct Candidate {
+    SolveMethod method;
+    string reason;
+};
+
+bool isIterative(SolveMethod method) {
+    return method == SolveMethod::ConjugateGradient || method == SolveMethod::GaussSeidel;
+}
+
+string number(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3g", v);
+    return buf;
+}
+
+// The backends to try, best first; LU closes every list
+vector<Candidate> plan(const Matrix& A, const MatrixProperties& p, const SolveOptions& options) {
+    int n = A.getRows();
+    bool spdLike = p.symmetric && p.positiveDiagonal;
+    bool iterative = options.allowIterative && n >= options.iterativeMinSize;
+    // Why a matrix an iterative backend suits goes to a direct one instead
+    string noIterative = !options.allowIterative ? "iterative backends disabled"
+                                                 : "n = " + to_string(n) + " < iterativeMinSize";
+    vector<Candidate> candidates;
+
+    int lower, upper;
+    if (A.isBandedEnough(lower, upper)) {
+        string band = "banded, " + to_string(lower) + " below and " + to_string(upper) + " above the diagonal";
+        if (lower <= 1 && upper <= 1) {
+            candidates.push_back({SolveMethod::Tridiagonal, "tridiagonal"});
+        } else if (spdLike && lower == upper) {
+            candidates.push_back({SolveMethod::BandedCholesky, band + ", symmetric with a positive diagonal"});
+        }
+        candidates.push_back({SolveMethod::BandedLU, band});
+    } else if (spdLike) {
+        string spd = "symmetric with a positive diagonal";
+        if (!iterative) {
+            candidates.push_back({SolveMethod::Cholesky, spd + ", but " + noIterative});
+        } else if (!A.isSparseEnough()) {
+            candidates.push_back({SolveMethod::Cholesky, spd + ", too dense for conjugate gradient"});
+        } else {
+            candidates.push_back({SolveMethod::ConjugateGradient, spd + ", sparse, n = " + to_string(n)});
+            candidates.push_back({SolveMethod::Cholesky, spd});
+        }
+    } else if (p.diagonallyDominant) {
+        if (!iterative) {
+            candidates.push_back({SolveMethod::LU, "strictly diagonally dominant, but " + noIterative});
+            return candidates;
+        }
+        candidates.push_back({SolveMethod::GaussSeidel, "strictly diagonally dominant, n = " + to_string(n)});
+    }
+    candidates.push_back({SolveMethod::LU, candidates.empty() ? "no structure to exploit" : "general fallback"});
+    return candidates;
+}
+
+// Direct backends come back as a converged IterativeResult with no iterations
+Result<IterativeResult> direct(Result<vector<double>> x) {
+    if (!x) {
+        return Result<IterativeResult>(x.status());
+    }
+    IterativeResult r;
+    r.x = move(x).value();
+    r.converged = true;
+    return r;
+}
+
+Result<IterativeResult> run(SolveMethod method, const Matrix& A, const vector<double>& b, const BandedMatrix& band,
+                            const SolveOptions& options) {
+    switch (method) {
+        case SolveMethod::Tridiagonal:
+            return direct(TridiagonalMatrix::fromDense(A).trySolve(b));
+        case SolveMethod::BandedCholesky: {
+            BandedCholeskyFactorization chol(band, false);
+            return direct(chol.trySolve(b));
+        }
+        case SolveMethod::BandedLU:
+            return direct(BandedLUFactorization(band).trySolve(b));
+        case SolveMethod::ConjugateGradient:
+            return A.tryConjugateGradient(b, options.maxIterations, options.tolerance);
+        case SolveMethod::Cholesky: {
+            // properties() has already found A symmetric
+            Result<CholeskyFactorization> chol = A.tryCholeskyFactorize(false);
+            if (!chol) {
+                return Result<IterativeResult>(chol.status());
+            }
+            return direct(chol->trySolve(b));
+        }
+        case SolveMethod::GaussSeidel:
+            return A.trySor(b, 1.0, options.maxIterations, options.tolerance, Convergence::RelativeResidual);
+        case SolveMethod::LU:
+        default:
+            return direct(LUFactorization(A).trySolve(b));
+    }
+}
+
+// Fills in the attempt's residual and says whether x is good enough to keep
+Status check(SolveAttempt& attempt, const IterativeResult& r, const Matrix& A, const vector<double>& b,
+             const MatrixProperties& p, const SolveOptions& options) {
+    vector<double> Ax;
+    DenseOperator(A).apply(r.x, Ax);
+    double rr = 0.0, bb = 0.0, rInf = 0.0, bInf = 0.0, xInf = 0.0;
+    for (size_t i = 0; i < b.size(); i++) {
+        double d = b[i] - Ax[i];
+        rr += d * d;
+        bb += b[i] * b[i];
+        rInf = max(rInf, fabs(d));
+        bInf = max(bInf, fabs(b[i]));
+        xInf = max(xInf, fabs(r.x[i]));
+    }
+    attempt.relativeResidual = bb > 0.0 ? sqrt(rr / bb) : sqrt(rr);
+
+    if (!isfinite(attempt.relativeResidual)) {
+        return Status(StatusCode::Singular, "Solution is not finite");
+    }
+    if (isIterative(attempt.method)) {
+        if (!r.converged) {
+            return Status(StatusCode::NotConverged, "No convergence within " + to_string(r.iterations) +
+                                                    " iterations, residual " + number(attempt.relativeResidual));
+        }
+        if (attempt.relativeResidual > residualSlack * options.tolerance) {
+            return Status(StatusCode::NotConverged, "Converged, but the true residual is " +
+                                                    number(attempt.relativeResidual));
+        }
+        return Status();
+    }
+    double scale = p.normInf * xInf + bInf;
+    if (scale > 0.0 && rInf / scale > directBackwardError) {
+        return Status(StatusCode::Singular, "Backward error " + number(rInf / scale) + " after an unstable pivot");
+    }
+    return Status();
+}
+
+}
+
+const char* solveMethodName(SolveMethod method) {
+    switch (method) {
+        case SolveMethod::Tridiagonal: return "tridiagonal";
+        case SolveMethod::BandedCholesky: return "banded Cholesky";
+        case SolveMethod::BandedLU: return "banded LU";
+        case SolveMethod::ConjugateGradient: return "conjugate gradient";
+        case SolveMethod::Cholesky: return "Cholesky";
+        case SolveMethod::GaussSeidel: return "Gauss-Seidel";
+        case SolveMethod::LU: return "LU";
+    }
+    return "unknown";
+}
+
+Result<SolveReport> solve(const Matrix& A, const vector<double>& b, const SolveOptions& options) {
+    if (A.getRows() != A.getCols()) {
+        return Result<SolveReport>(StatusCode::NotSquare, "Matrix must be square to solve Ax = b");
+    }
+    if (A.getRows() != (int)b.size()) {
+        return Result<SolveReport>(StatusCode::DimensionMismatch, "Vector b must have the same size as matrix rows");
+    }
+
+    TELEMETRY_SCOPE("solve");
+    auto log = [&](const string& line) {
+        if (options.log) {
+            options.log(line);
+        }
+    };
+
+    SolveReport report;
+    report.properties = A.properties();
+    vector<Candidate> candidates = plan(A, report.properties, options);
+
+    // Band storage, made once for whichever banded backend comes first
+    BandedMatrix band;
+
+    string history;
+    for (size_t c = 0; c < candidates.size(); c++) {
+        SolveAttempt attempt;
+        attempt.method = candidates[c].method;
+        attempt.reason = candidates[c].reason;
+        log(string(c == 0 ? "chose " : "falling back to ") + solveMethodName(attempt.method) + ": " + attempt.reason);
+
+        auto start = chrono::steady_clock::now();
+        bool banded = attempt.method == SolveMethod::BandedCholesky || attempt.method == SolveMethod::BandedLU;
+        if (banded && band.size() != A.getRows()) {
+            band = BandedMatrix::fromDense(A, report.properties.lowerBandwidth, report.properties.upperBandwidth);
+        }
+        Result<IterativeResult> r = run(attempt.method, A, b, band, options);
+        attempt.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        attempt.iterations = r->iterations;
+        attempt.status = r ? check(attempt, *r, A, b, report.properties, options) : r.status();
+
+        if (attempt.status) {
+            log(string(solveMethodName(attempt.method)) + " solved it in " + number(attempt.seconds) + " s" +
+                (isIterative(attempt.method) ? ", " + to_string(attempt.iterations) + " iterations" : "") +
+                ", relative residual " + number(attempt.relativeResidual));
+            report.x = move(r->x);
+            report.attempts.push_back(move(attempt));
+            return report;
+        }
+
+        telemetryCount("solve.fallbacks", 1);
+        log(string(solveMethodName(attempt.method)) + " gave up: " + attempt.status.message());
+        history += string(history.empty() ? "" : "; ") + solveMethodName(attempt.method) + ": " +
+                   attempt.status.message();
+        StatusCode code = attempt.status.code();
+        report.attempts.push_back(move(attempt));
+        if (c + 1 == candidates.size()) {
+            return Result<SolveReport>(code, "No solver succeeded (" + history + ")");
+        }
+    }
+    return Result<SolveReport>(StatusCode::InvalidArgument, "No solver to try");
+}
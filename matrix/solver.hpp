@@ -0,0 +1,61 @@
+#ifndef SOLVER_HPP
+#define SOLVER_HPP
+#include "matrix.hpp"
+#include <functional>
+
+// One front door for Ax = b that picks the backend from A's properties()
+// instead of leaving it to the caller:
+//
+//   banded (see Matrix::isBandedEnough)  tridiagonal solve, banded Cholesky
+//                                        when symmetric with a positive
+//                                        diagonal, banded LU otherwise
+//   symmetric, positive diagonal         conjugate gradient when sparse and
+//                                        large, Cholesky otherwise
+//   strictly diagonally dominant, large  Gauss-Seidel, which then converges
+//   anything else                        LU with partial pivoting
+//
+// A backend that breaks down (a zero pivot, a matrix that turns out not to
+// be positive definite, an iteration that does not converge or a solution
+// whose residual is off) hands over to the next one down the list, ending
+// at pivoted LU. Every attempt is recorded, and logged as it happens when
+// SolveOptions::log is set.
+enum class SolveMethod { Tridiagonal, BandedCholesky, BandedLU, ConjugateGradient, Cholesky, GaussSeidel, LU };
+
+const char* solveMethodName(SolveMethod method);
+
+struct SolveOptions {
+    // Relative residual ||b - A x||_2 / ||b||_2 the iterative backends stop at
+    double tolerance = 1e-10;
+    int maxIterations = 1000;
+    // false keeps to the direct backends
+    bool allowIterative = true;
+    // Smaller systems always go to a direct backend
+    int iterativeMinSize = 1000;
+    // Called with one line per decision: what was chosen and why, and why
+    // an attempt was given up
+    function<void(const string&)> log;
+};
+
+struct SolveAttempt {
+    SolveMethod method;
+    string reason;            // why it was tried
+    Status status;            // why it was given up; Ok for the one that solved
+    int iterations = 0;       // iterative backends only
+    double relativeResidual = 0.0;
+    double seconds = 0.0;
+};
+
+struct SolveReport {
+    vector<double> x;
+    vector<SolveAttempt> attempts;  // in order; the last one solved the system
+    MatrixProperties properties;
+
+    SolveMethod method() const { return attempts.back().method; }
+};
+
+// Fails with NotSquare or DimensionMismatch before trying anything, and
+// with the status of the last backend, its message listing every attempt,
+// when none of them solves the system
+Result<SolveReport> solve(const Matrix& A, const vector<double>& b, const SolveOptions& options = SolveOptions());
+
+#endif
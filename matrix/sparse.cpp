@@ -0,0 +1,496 @@
+#include "sparse.hpp"
+#include "threadpool.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SPARSE_HAVE_AVX2_KERNEL 1
+#endif
+
+using namespace std;
+
+namespace {
+
+// Rows per thread task in SpMV and the Jacobi sweep
+const int ROW_TILE = 4096;
+
+typedef double (*RowDot)(const int* idx, const double* val, int len, const double* x);
+
+double rowDotScalar(const int* idx, const double* val, int len, const double* x) {
+    double s0 = 0.0, s1 = 0.0;
+    int k = 0;
+    for (; k + 2 <= len; k += 2) {
+        s0 += val[k] * x[idx[k]];
+        s1 += val[k + 1] * x[idx[k + 1]];
+    }
+    if (k < len) {
+        s0 += val[k] * x[idx[k]];
+    }
+    return s0 + s1;
+}
+
+#ifdef SPARSE_HAVE_AVX2_KERNEL
+__attribute__((target("avx2,fma")))
+double rowDotAvx2(const int* idx, const double* val, int len, const double* x) {
+    __m256d acc = _mm256_setzero_pd();
+    __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    int k = 0;
+    for (; k + 4 <= len; k += 4) {
+        __m128i cols = _mm_loadu_si128(reinterpret_cast<const __m128i*>(idx + k));
+        __m256d xv = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x, cols, all, 8);
+        acc = _mm256_fmadd_pd(_mm256_loadu_pd(val + k), xv, acc);
+    }
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    double s = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; k < len; k++) {
+        s += val[k] * x[idx[k]];
+    }
+    return s;
+}
+#endif
+
+RowDot selectRowDot() {
+#ifdef SPARSE_HAVE_AVX2_KERNEL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return rowDotAvx2;
+    }
+#endif
+    return rowDotScalar;
+}
+
+const RowDot rowDot = selectRowDot();
+
+// Splits [0, n) into ROW_TILE row ranges and runs fn(tile, i0, i1) on the pool
+void forRowTiles(int n, const function<void(int, int, int)>& fn) {
+    parallelTiles(n, 1, ROW_TILE, 1, [&](int i0, int i1, int, int) {
+        fn(i0 / ROW_TILE, i0, i1);
+    });
+}
+
+}
+
+SparseMatrix::SparseMatrix() : rows(0), cols(0), rowPtr(1, 0) {}
+
+SparseMatrix::SparseMatrix(int r, int c) : rows(r), cols(c), rowPtr(r + 1, 0) {}
+
+SparseMatrix SparseMatrix::fromTriplets(int r, int c, vector<Triplet> triplets) {
+    SparseMatrix m(r, c);
+    for (const Triplet& t : triplets) {
+        if (t.row < 0 || t.row >= r || t.col < 0 || t.col >= c) {
+            return SparseMatrix();
+        }
+    }
+    sort(triplets.begin(), triplets.end(), [](const Triplet& a, const Triplet& b) {
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+
+    m.colIdx.reserve(triplets.size());
+    m.values.reserve(triplets.size());
+    for (size_t k = 0; k < triplets.size(); k++) {
+        const Triplet& t = triplets[k];
+        if (k > 0 && t.row == triplets[k - 1].row && t.col == triplets[k - 1].col) {
+            m.values.back() += t.value;
+            continue;
+        }
+        m.colIdx.push_back(t.col);
+        m.values.push_back(t.value);
+        m.rowPtr[t.row + 1]++;
+    }
+    for (int i = 0; i < r; i++) {
+        m.rowPtr[i + 1] += m.rowPtr[i];
+    }
+    return m;
+}
+
+SparseMatrix SparseMatrix::fromDense(const Matrix& A, double dropTolerance) {
+    SparseMatrix m(A.getRows(), A.getCols());
+    for (int i = 0; i < A.getRows(); i++) {
+        const double* row = &A(i, 0);
+        for (int j = 0; j < A.getCols(); j++) {
+            if (fabs(row[j]) > dropTolerance) {
+                m.colIdx.push_back(j);
+                m.values.push_back(row[j]);
+            }
+        }
+        m.rowPtr[i + 1] = (int)m.values.size();
+    }
+    return m;
+}
+
+double SparseMatrix::get(int i, int j) const {
+    assert(i >= 0 && i < rows && j >= 0 && j < cols);
+    auto first = colIdx.begin() + rowPtr[i];
+    auto last = colIdx.begin() + rowPtr[i + 1];
+    auto it = lower_bound(first, last, j);
+    if (it != last && *it == j) {
+        return values[it - colIdx.begin()];
+    }
+    return 0.0;
+}
+
+vector<double> SparseMatrix::diagonal() const {
+    int n = min(rows, cols);
+    vector<double> d(n, 0.0);
+    for (int i = 0; i < n; i++) {
+        d[i] = get(i, i);
+    }
+    return d;
+}
+
+SparseMatrix SparseMatrix::transpose() const {
+    SparseMatrix t(cols, rows);
+    t.colIdx.resize(values.size());
+    t.values.resize(values.size());
+    for (int c : colIdx) {
+        t.rowPtr[c + 1]++;
+    }
+    for (int j = 0; j < cols; j++) {
+        t.rowPtr[j + 1] += t.rowPtr[j];
+    }
+    // Walking rows in order keeps each transposed row sorted
+    vector<int> next(t.rowPtr.begin(), t.rowPtr.end() - 1);
+    for (int i = 0; i < rows; i++) {
+        for (int k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+            int dst = next[colIdx[k]]++;
+            t.colIdx[dst] = i;
+            t.values[dst] = values[k];
+        }
+    }
+    return t;
+}
+
+SparseMatrix SparseMatrix::permuteRows(const vector<int>& order) const {
+    SparseMatrix p(rows, cols);
+    p.colIdx.reserve(colIdx.size());
+    p.values.reserve(values.size());
+    for (int i = 0; i < rows; i++) {
+        int r = order[i];
+        p.colIdx.insert(p.colIdx.end(), colIdx.begin() + rowPtr[r], colIdx.begin() + rowPtr[r + 1]);
+        p.values.insert(p.values.end(), values.begin() + rowPtr[r], values.begin() + rowPtr[r + 1]);
+        p.rowPtr[i + 1] = (int)p.values.size();
+    }
+    return p;
+}
+
+Matrix SparseMatrix::toDense() const {
+    Matrix A(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        for (int k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+            A(i, colIdx[k]) = values[k];
+        }
+    }
+    return A;
+}
+
+void SparseMatrix::multiply(const vector<double>& x, vector<double>& y) const {
+    y.resize(rows);
+    const int* idx = colIdx.data();
+    const double* val = values.data();
+    const int* ptr = rowPtr.data();
+    const double* xp = x.data();
+    double* yp = y.data();
+    forRowTiles(rows, [=](int, int i0, int i1) {
+        for (int i = i0; i < i1; i++) {
+            yp[i] = rowDot(idx + ptr[i], val + ptr[i], ptr[i + 1] - ptr[i], xp);
+        }
+    });
+}
+
+vector<double> SparseMatrix::operator*(const vector<double>& x) const {
+    if ((int)x.size() != cols) {
+        return vector<double>();
+    }
+    vector<double> y(rows);
+    multiply(x, y);
+    return y;
+}
+
+bool SparseMatrix::isDiagonallyDominant() const {
+    if (rows != cols) {
+        return false;
+    }
+    for (int i = 0; i < rows; i++) {
+        double diagonalValue = 0.0;
+        double rowSum = 0.0;
+        for (int k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+            if (colIdx[k] == i) {
+                diagonalValue = fabs(values[k]);
+            } else {
+                rowSum += fabs(values[k]);
+            }
+        }
+        if (diagonalValue <= rowSum) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Gauss-Jacobi
+Result<IterativeResult> SparseMatrix::gaussJacobi(const vector<double>& b, int maxIterations,
+                                                  double tolerance) const {
+    TELEMETRY_SCOPE("sparse.gaussJacobi");
+    if (rows != cols) {
+        return Result<IterativeResult>(StatusCode::NotSquare, "Matrix must be square for Gauss-Jacobi method");
+    }
+    if (rows != (int)b.size()) {
+        return Result<IterativeResult>(StatusCode::DimensionMismatch,
+                                       "Vector b must have the same size as matrix rows");
+    }
+
+    int n = rows;
+    vector<double> invDiag = diagonal();
+    for (int i = 0; i < n; i++) {
+        if (fabs(invDiag[i]) < 1e-10) {
+            return Result<IterativeResult>(StatusCode::ZeroDiagonal,
+                                           "Zero diagonal element detected. Cannot use Gauss-Jacobi method");
+        }
+        invDiag[i] = 1.0 / invDiag[i];
+    }
+
+    IterativeResult result;
+    vector<double>& x = result.x;
+    x.assign(n, 0.0);
+    vector<double> xNew(n, 0.0);
+    vector<double> partial((n + ROW_TILE - 1) / ROW_TILE);
+    const int* idx = colIdx.data();
+    const double* val = values.data();
+    const int* ptr = rowPtr.data();
+
+    for (int iter = 0; iter < maxIterations; iter++) {
+        const double* xp = x.data();
+        double* xn = xNew.data();
+        // Row dot includes the diagonal term, so add it back rather than
+        // branching on j != i inside the dot product
+        forRowTiles(n, [&](int tile, int i0, int i1) {
+            double err = 0.0;
+            for (int i = i0; i < i1; i++) {
+                double r = b[i] - rowDot(idx + ptr[i], val + ptr[i], ptr[i + 1] - ptr[i], xp);
+                xn[i] = xp[i] + r * invDiag[i];
+                err += fabs(xn[i] - xp[i]);
+            }
+            partial[tile] = err;
+        });
+        x.swap(xNew);
+
+        // Fixed summation order keeps the result independent of thread count
+        double error = 0.0;
+        for (double e : partial) {
+            error += e;
+        }
+        telemetrySample("sparse.gaussJacobi.error", iter + 1, error);
+        result.residualHistory.push_back(error);
+        result.iterations = iter + 1;
+        if (error < tolerance) {
+            result.converged = true;
+            break;
+        }
+    }
+    return result;
+}
+
+// Gauss-Seidel
+Result<IterativeResult> SparseMatrix::gaussSeidel(const vector<double>& b, int maxIterations,
+                                                  double tolerance) const {
+    TELEMETRY_SCOPE("sparse.gaussSeidel");
+    if (rows != cols) {
+        return Result<IterativeResult>(StatusCode::NotSquare, "Matrix must be square for Gauss-Seidel method");
+    }
+    if (rows != (int)b.size()) {
+        return Result<IterativeResult>(StatusCode::DimensionMismatch,
+                                       "Vector b must have the same size as matrix rows");
+    }
+
+    int n = rows;
+    vector<double> invDiag = diagonal();
+    for (int i = 0; i < n; i++) {
+        if (fabs(invDiag[i]) < 1e-10) {
+            return Result<IterativeResult>(StatusCode::ZeroDiagonal,
+                                           "Zero diagonal element detected. Cannot use Gauss-Seidel method");
+        }
+        invDiag[i] = 1.0 / invDiag[i];
+    }
+
+    IterativeResult result;
+    vector<double>& x = result.x;
+    x.assign(n, 0.0);
+    const int* idx = colIdx.data();
+    const double* val = values.data();
+    const int* ptr = rowPtr.data();
+
+    for (int iter = 0; iter < maxIterations; iter++) {
+        // In-place sweep; the change in each entry is measured as it is
+        // written, so no copy of the previous iterate is needed
+        double error = 0.0;
+        for (int i = 0; i < n; i++) {
+            double r = b[i] - rowDot(idx + ptr[i], val + ptr[i], ptr[i + 1] - ptr[i], x.data());
+            double delta = r * invDiag[i];
+            x[i] += delta;
+            error += fabs(delta);
+        }
+        telemetrySample("sparse.gaussSeidel.error", iter + 1, error);
+        result.residualHistory.push_back(error);
+        result.iterations = iter + 1;
+        if (error < tolerance) {
+            result.converged = true;
+            break;
+        }
+    }
+    return result;
+}
+
+int SparseMatrix::colorRows(vector<int>& order, vector<int>& colorStart) const {
+    int n = rows;
+    SparseMatrix t = transpose();
+    vector<int> color(n, -1);
+    vector<int> seen;  // seen[c] == i when a neighbour of row i has color c
+    int colors = 0;
+    const SparseMatrix* patterns[2] = {this, &t};
+
+    for (int i = 0; i < n; i++) {
+        for (const SparseMatrix* m : patterns) {
+            for (int k = m->rowPtr[i]; k < m->rowPtr[i + 1]; k++) {
+                int c = color[m->colIdx[k]];
+                if (c >= 0) {
+                    seen[c] = i;
+                }
+            }
+        }
+        int c = 0;
+        while (c < colors && seen[c] == i) {
+            c++;
+        }
+        if (c == colors) {
+            colors++;
+            seen.push_back(-1);
+        }
+        color[i] = c;
+    }
+
+    colorStart.assign(colors + 1, 0);
+    for (int i = 0; i < n; i++) {
+        colorStart[color[i] + 1]++;
+    }
+    for (int c = 0; c < colors; c++) {
+        colorStart[c + 1] += colorStart[c];
+    }
+    order.resize(n);
+    vector<int> next(colorStart.begin(), colorStart.end() - 1);
+    for (int i = 0; i < n; i++) {
+        order[next[color[i]]++] = i;
+    }
+    return colors;
+}
+
+Result<IterativeResult> SparseMatrix::multicolorGaussSeidel(const vector<double>& b, int maxIterations,
+                                                            double tolerance, Convergence criterion) const {
+    return relax(b, 1.0, false, maxIterations, tolerance, criterion, "Multicolor Gauss-Seidel");
+}
+
+Result<IterativeResult> SparseMatrix::sor(const vector<double>& b, double omega, int maxIterations, double tolerance,
+                                          Convergence criterion) const {
+    return relax(b, omega, false, maxIterations, tolerance, criterion, "SOR");
+}
+
+Result<IterativeResult> SparseMatrix::ssor(const vector<double>& b, double omega, int maxIterations, double tolerance,
+                                           Convergence criterion) const {
+    return relax(b, omega, true, maxIterations, tolerance, criterion, "SSOR");
+}
+
+Result<IterativeResult> SparseMatrix::relax(const vector<double>& b, double omega, bool symmetric,
+                                            int maxIterations, double tolerance, Convergence criterion,
+                                            const string& method) const {
+    TELEMETRY_SCOPE("sparse.relax");
+    if (rows != cols) {
+        return Result<IterativeResult>(StatusCode::NotSquare, "Matrix must be square for " + method + " method");
+    }
+    if (rows != (int)b.size()) {
+        return Result<IterativeResult>(StatusCode::DimensionMismatch,
+                                       "Vector b must have the same size as matrix rows");
+    }
+    if (omega <= 0.0 || omega >= 2.0) {
+        return Result<IterativeResult>(StatusCode::InvalidArgument, "Relaxation factor must lie in (0, 2)");
+    }
+
+    int n = rows;
+    vector<double> invDiag = diagonal();
+    for (int i = 0; i < n; i++) {
+        if (fabs(invDiag[i]) < 1e-10) {
+            return Result<IterativeResult>(StatusCode::ZeroDiagonal,
+                                           "Zero diagonal element detected. Cannot use " + method + " method");
+        }
+        invDiag[i] = omega / invDiag[i];
+    }
+
+    vector<int> order, colorStart;
+    int colors = colorRows(order, colorStart);
+
+    IterativeResult result;
+    vector<double>& x = result.x;
+    x.assign(n, 0.0);
+    vector<double> r;
+    vector<double> partial((n + ROW_TILE - 1) / ROW_TILE);
+    const int* idx = colIdx.data();
+    const double* val = values.data();
+    const int* ptr = rowPtr.data();
+    double* xp = x.data();
+    double bNorm = 0.0;
+    for (double v : b) {
+        bNorm += v * v;
+    }
+    bNorm = sqrt(bNorm);
+
+    // Rows of one color only read unknowns of other colors (and their own),
+    // so each color is a race-free parallel update
+    double change = 0.0;
+    auto sweepColor = [&](int c) {
+        int first = colorStart[c];
+        int count = colorStart[c + 1] - first;
+        fill(partial.begin(), partial.end(), 0.0);
+        forRowTiles(count, [&](int tile, int k0, int k1) {
+            double largest = 0.0;
+            for (int k = first + k0; k < first + k1; k++) {
+                int i = order[k];
+                double delta = (b[i] - rowDot(idx + ptr[i], val + ptr[i], ptr[i + 1] - ptr[i], xp)) * invDiag[i];
+                xp[i] += delta;
+                largest = max(largest, fabs(delta));
+            }
+            partial[tile] = largest;
+        });
+        for (double p : partial) {
+            change = max(change, p);
+        }
+    };
+
+    for (int iter = 0; iter < maxIterations; iter++) {
+        change = 0.0;
+        for (int c = 0; c < colors; c++) {
+            sweepColor(c);
+        }
+        if (symmetric) {
+            for (int c = colors - 1; c >= 0; c--) {
+                sweepColor(c);
+            }
+        }
+
+        double error = change;
+        if (criterion == Convergence::RelativeResidual) {
+            multiply(x, r);
+            double s = 0.0;
+            for (int i = 0; i < n; i++) {
+                s += (b[i] - r[i]) * (b[i] - r[i]);
+            }
+            error = (bNorm > 0.0) ? sqrt(s) / bNorm : sqrt(s);
+        }
+        telemetrySample("sparse.relax.error", iter + 1, error);
+        result.residualHistory.push_back(error);
+        result.iterations = iter + 1;
+        if (error < tolerance) {
+            result.converged = true;
+            break;
+        }
+    }
+    return result;
+}
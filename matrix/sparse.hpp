@@ -0,0 +1,84 @@
+#ifndef SPARSE_HPP
+#define SPARSE_HPP
+#include "matrix.hpp"
+
+struct Triplet {
+    int row;
+    int col;
+    double value;
+};
+
+// Compressed sparse row matrix. Row i owns the entries
+// [rowPtr[i], rowPtr[i + 1]) of colIdx/values, with columns sorted.
+// The CSR form of the transpose doubles as the CSC form of the matrix.
+class SparseMatrix {
+private:
+    int rows, cols;
+    vector<int> rowPtr;
+    vector<int> colIdx;
+    vector<double> values;
+
+public:
+    SparseMatrix();
+    SparseMatrix(int r, int c);
+
+    // Duplicate (row, col) entries are summed; an out-of-bounds entry gives
+    // an empty matrix
+    static SparseMatrix fromTriplets(int r, int c, vector<Triplet> triplets);
+    // Keeps entries with |a_ij| > dropTolerance
+    static SparseMatrix fromDense(const Matrix& A, double dropTolerance = 0.0);
+
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    long long nonZeros() const { return (long long)values.size(); }
+    const vector<int>& rowPointers() const { return rowPtr; }
+    const vector<int>& columnIndices() const { return colIdx; }
+    const vector<double>& nonZeroValues() const { return values; }
+
+    double get(int i, int j) const;  // bounds checked by assert
+    vector<double> diagonal() const;
+    SparseMatrix transpose() const;
+    // Row i of the result is row order[i] of this matrix, in O(nnz)
+    SparseMatrix permuteRows(const vector<int>& order) const;
+    Matrix toDense() const;
+
+    // y = A x, rows split over the thread pool; operator* returns an empty
+    // vector when x has the wrong size
+    void multiply(const vector<double>& x, vector<double>& y) const;
+    vector<double> operator*(const vector<double>& x) const;
+
+    bool isDiagonallyDominant() const;
+
+    // Iterative solvers; each iteration costs O(nnz) instead of O(n^2).
+    // The history records the sum of |x_k+1 - x_k| over all entries.
+    Result<IterativeResult> gaussJacobi(const vector<double>& b, int maxIterations = 100,
+                                        double tolerance = 1e-6) const;
+    Result<IterativeResult> gaussSeidel(const vector<double>& b, int maxIterations = 100,
+                                        double tolerance = 1e-6) const;
+
+    // Greedy coloring of the graph of A + A^T: rows sharing a color never
+    // read each other's unknowns. Rows of color c are
+    // order[colorStart[c] .. colorStart[c + 1]). A 5-point grid gets two
+    // colors (red-black). Returns the number of colors.
+    int colorRows(vector<int>& order, vector<int>& colorStart) const;
+
+    // Multicolor relaxation: x_i += omega * (b_i - A_i x) / a_ii, one color
+    // at a time with the rows of a color updated in parallel. omega = 1 is
+    // Gauss-Seidel in the multicolor ordering; SSOR follows each forward
+    // sweep with a backward one and is symmetric for symmetric A. With only
+    // two colors the back-to-back sweeps of one color repeat work, so SSOR
+    // is then no faster than SOR; its use is as a symmetric smoother.
+    Result<IterativeResult> multicolorGaussSeidel(const vector<double>& b, int maxIterations = 100,
+                                                  double tolerance = 1e-6,
+                                                  Convergence criterion = Convergence::MaxChange) const;
+    Result<IterativeResult> sor(const vector<double>& b, double omega, int maxIterations = 100,
+                                double tolerance = 1e-6, Convergence criterion = Convergence::MaxChange) const;
+    Result<IterativeResult> ssor(const vector<double>& b, double omega, int maxIterations = 100,
+                                 double tolerance = 1e-6, Convergence criterion = Convergence::MaxChange) const;
+
+private:
+    Result<IterativeResult> relax(const vector<double>& b, double omega, bool symmetric, int maxIterations,
+                                  double tolerance, Convergence criterion, const string& method) const;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#include "status.hpp"
+
+using namespace std;
+
+const char* statusCodeName(StatusCode code) {
+    switch (code) {
+        case StatusCode::Ok: return "Ok";
+        case StatusCode::InvalidArgument: return "InvalidArgument";
+        case StatusCode::DimensionMismatch: return "DimensionMismatch";
+        case StatusCode::NotSquare: return "NotSquare";
+        case StatusCode::Singular: return "Singular";
+        case StatusCode::NotSymmetric: return "NotSymmetric";
+        case StatusCode::NotPositiveDefinite: return "NotPositiveDefinite";
+        case StatusCode::ZeroDiagonal: return "ZeroDiagonal";
+        case StatusCode::NotConverged: return "NotConverged";
+        case StatusCode::IoError: return "IoError";
+        case StatusCode::FormatError: return "FormatError";
+        case StatusCode::ChecksumMismatch: return "ChecksumMismatch";
+    }
+    return "Unknown";
+}
+
+string Status::toString() const {
+    if (ok()) {
+        return "Ok";
+    }
+    return string(statusCodeName(code_)) + ": " + text;
+}
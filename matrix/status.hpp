@@ -0,0 +1,75 @@
+#ifndef STATUS_HPP
+#define STATUS_HPP
+#include <string>
+#include <utility>
+
+using namespace std;
+
+// Outcome of a library call. The library itself never prints: a failed
+// call returns a Status (or a Result holding one) and the caller decides
+// whether and how to report it. On success no message is built, so the
+// success path costs one enum compare.
+enum class StatusCode {
+    Ok,
+    InvalidArgument,     // e.g. omega outside (0, 2)
+    DimensionMismatch,   // operand shapes do not fit together
+    NotSquare,
+    Singular,            // zero or tiny pivot
+    NotSymmetric,
+    NotPositiveDefinite,
+    ZeroDiagonal,        // the stationary methods divide by a_ii
+    NotConverged,        // an iteration ran out before reaching its tolerance
+    IoError,             // cannot open, read or write a file
+    FormatError,         // the file is not what it claims to be
+    ChecksumMismatch
+};
+
+const char* statusCodeName(StatusCode code);
+
+class Status {
+private:
+    StatusCode code_;
+    string text;
+
+public:
+    Status() : code_(StatusCode::Ok) {}
+    Status(StatusCode c, string message) : code_(c), text(move(message)) {}
+
+    bool ok() const { return code_ == StatusCode::Ok; }
+    explicit operator bool() const { return ok(); }
+    StatusCode code() const { return code_; }
+    const string& message() const { return text; }
+    // "NotSquare: Matrix must be square for ...", or "Ok"
+    string toString() const;
+};
+
+// A value or the Status saying why there is none, in the manner of
+// std::expected. A failed Result holds a default-constructed value.
+template<typename T>
+class Result {
+private:
+    T val;
+    Status st;
+
+public:
+    Result(T value) : val(move(value)) {}
+    Result(Status failure) : val(), st(move(failure)) {}
+    Result(StatusCode code, string message) : val(), st(code, move(message)) {}
+
+    bool ok() const { return st.ok(); }
+    explicit operator bool() const { return ok(); }
+    const Status& status() const { return st; }
+
+    T& value() & { return val; }
+    const T& value() const& { return val; }
+    T&& value() && { return move(val); }
+    // The value, or `fallback` on failure
+    T valueOr(T fallback) && { return ok() ? move(val) : move(fallback); }
+
+    T& operator*() & { return val; }
+    const T& operator*() const& { return val; }
+    T* operator->() { return &val; }
+    const T* operator->() const { return &val; }
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "telemetry.hpp"
+#include <atomic>
+#include <map>
+#include <fstream>
+#include <charconv>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+#if MATRIX_TELEMETRY
+
+const long long RING_SIZE = 1 << 16;  // a power of two
+
+TelemetryEvent ring[RING_SIZE];
+atomic<long long> head(0);
+atomic<int> nextThread(0);
+
+const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+int threadNumber() {
+    thread_local int number = nextThread.fetch_add(1);
+    return number;
+}
+
+#endif
+
+const char* kindName(TelemetryKind kind) {
+    switch (kind) {
+        case TelemetryKind::Span: return "span";
+        case TelemetryKind::Counter: return "counter";
+        default: return "sample";
+    }
+}
+
+string number(double v) {
+    if (!isfinite(v)) {
+        return "null";
+    }
+    char buf[32];
+    to_chars_result r = to_chars(buf, buf + sizeof(buf), v);
+    return string(buf, r.ptr);
+}
+
+}
+
+#if MATRIX_TELEMETRY
+
+long long telemetryNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+void telemetryRecord(const TelemetryEvent& event) {
+    long long slot = head.fetch_add(1, memory_order_relaxed) & (RING_SIZE - 1);
+    ring[slot] = event;
+    ring[slot].thread = threadNumber();
+}
+
+vector<TelemetryEvent> telemetrySnapshot() {
+    long long h = head.load();
+    long long n = min(h, RING_SIZE);
+    vector<TelemetryEvent> events;
+    events.reserve(n);
+    for (long long k = h - n; k < h; k++) {
+        events.push_back(ring[k & (RING_SIZE - 1)]);
+    }
+    return events;
+}
+
+long long telemetryDropped() {
+    return max(0LL, head.load() - RING_SIZE);
+}
+
+void telemetryReset() {
+    head.store(0);
+}
+
+#else
+
+vector<TelemetryEvent> telemetrySnapshot() {
+    return vector<TelemetryEvent>();
+}
+
+long long telemetryDropped() {
+    return 0;
+}
+
+void telemetryReset() {}
+
+#endif
+
+string telemetryToJson() {
+    vector<TelemetryEvent> events = telemetrySnapshot();
+
+    struct Summary {
+        TelemetryKind kind;
+        long long calls;
+        double total, least, most;
+    };
+    map<string, Summary> summary;
+    for (const TelemetryEvent& e : events) {
+        // Spans summarise their duration in seconds, the rest their values
+        double v = e.kind == TelemetryKind::Span ? e.duration * 1e-9 : e.value;
+        auto it = summary.find(e.name);
+        if (it == summary.end()) {
+            summary[e.name] = Summary{e.kind, 1, v, v, v};
+        } else {
+            it->second.calls++;
+            it->second.total += v;
+            it->second.least = min(it->second.least, v);
+            it->second.most = max(it->second.most, v);
+        }
+    }
+
+    string json = string("{\"enabled\": ") + (telemetryEnabled ? "true" : "false") +
+                  ", \"dropped\": " + to_string(telemetryDropped()) + ",\n \"summary\": [";
+    bool first = true;
+    for (const auto& s : summary) {
+        json += first ? "\n  " : ",\n  ";
+        first = false;
+        json += string("{\"name\": \"") + s.first + "\", \"kind\": \"" + kindName(s.second.kind) +
+                "\", \"calls\": " + to_string(s.second.calls) + ", \"total\": " + number(s.second.total) +
+                ", \"min\": " + number(s.second.least) + ", \"max\": " + number(s.second.most) + "}";
+    }
+    json += "],\n \"events\": [";
+    first = true;
+    for (const TelemetryEvent& e : events) {
+        json += first ? "\n  " : ",\n  ";
+        first = false;
+        json += string("{\"kind\": \"") + kindName(e.kind) + "\", \"name\": \"" + e.name +
+                "\", \"thread\": " + to_string(e.thread) + ", \"start_ns\": " + to_string(e.start);
+        if (e.kind == TelemetryKind::Span) {
+            json += ", \"duration_ns\": " + to_string(e.duration) + ", \"intervals\": " + to_string(e.count);
+        } else if (e.kind == TelemetryKind::Sample) {
+            json += ", \"index\": " + to_string(e.count) + ", \"value\": " + number(e.value);
+        } else {
+            json += ", \"value\": " + number(e.value);
+        }
+        json += "}";
+    }
+    json += "]}\n";
+    return json;
+}
+
+string telemetryToCsv() {
+    string csv = "kind,name,thread,start_ns,duration_ns,count,value\n";
+    for (const TelemetryEvent& e : telemetrySnapshot()) {
+        csv += string(kindName(e.kind)) + "," + e.name + "," + to_string(e.thread) + "," + to_string(e.start) +
+               "," + to_string(e.duration) + "," + to_string(e.count) + "," + number(e.value) + "\n";
+    }
+    return csv;
+}
+
+bool writeTelemetry(const string& path) {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        return false;
+    }
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    string text = csv ? telemetryToCsv() : telemetryToJson();
+    out.write(text.data(), (streamsize)text.size());
+    return (bool)out;
+}
@@ -0,0 +1,132 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+
+using namespace std;
+
+// Lightweight instrumentation of the hot paths: scoped timers, counters and
+// per-iteration samples, recorded into a fixed-size process-wide ring
+// buffer that keeps the most recent events.
+//
+// Compiled in only when MATRIX_TELEMETRY is defined to a non-zero value
+// (e.g. -DMATRIX_TELEMETRY=1). Otherwise every class below is empty and
+// every call an inline no-op, so instrumented kernels cost nothing.
+//
+// Recording takes one atomic increment and no locks or allocation. Export
+// is meant for quiet moments: a snapshot taken while kernels are still
+// recording may include events that are being overwritten.
+#ifndef MATRIX_TELEMETRY
+#define MATRIX_TELEMETRY 0
+#endif
+
+enum class TelemetryKind : uint8_t { Span, Counter, Sample };
+
+struct TelemetryEvent {
+    TelemetryKind kind;
+    const char* name;    // a string literal, e.g. "lu.trailing_update"
+    int thread;          // small per-thread number, 0 for the first thread seen
+    long long start;     // Span: ns since the first event of the process
+    long long duration;  // Span: total ns
+    long long count;     // Span: intervals folded in; Sample: iteration
+    double value;        // Counter: amount added; Sample: the value
+};
+
+const bool telemetryEnabled = MATRIX_TELEMETRY != 0;
+
+#if MATRIX_TELEMETRY
+
+long long telemetryNow();
+void telemetryRecord(const TelemetryEvent& event);
+
+inline void telemetryCount(const char* name, double amount) {
+    telemetryRecord(TelemetryEvent{TelemetryKind::Counter, name, 0, telemetryNow(), 0, 1, amount});
+}
+inline void telemetrySample(const char* name, long long index, double value) {
+    telemetryRecord(TelemetryEvent{TelemetryKind::Sample, name, 0, telemetryNow(), 0, index, value});
+}
+
+// Times its own lifetime as one span
+class TelemetryScope {
+private:
+    const char* name;
+    long long start;
+
+public:
+    explicit TelemetryScope(const char* n) : name(n), start(telemetryNow()) {}
+    ~TelemetryScope() {
+        telemetryRecord(TelemetryEvent{TelemetryKind::Span, name, 0, start, telemetryNow() - start, 1, 0.0});
+    }
+    TelemetryScope(const TelemetryScope&) = delete;
+    TelemetryScope& operator=(const TelemetryScope&) = delete;
+};
+
+// Accumulates many short begin()/end() intervals of one phase, such as the
+// pivot search of every column, and records them as a single span when
+// destroyed. Not thread-safe: time the phase from the coordinating thread.
+class TelemetryPhase {
+private:
+    const char* name;
+    long long first, mark, total, intervals;
+
+public:
+    explicit TelemetryPhase(const char* n) : name(n), first(-1), mark(0), total(0), intervals(0) {}
+    ~TelemetryPhase() {
+        if (intervals > 0) {
+            telemetryRecord(TelemetryEvent{TelemetryKind::Span, name, 0, first, total, intervals, 0.0});
+        }
+    }
+    TelemetryPhase(const TelemetryPhase&) = delete;
+    TelemetryPhase& operator=(const TelemetryPhase&) = delete;
+
+    void begin() {
+        mark = telemetryNow();
+        if (first < 0) {
+            first = mark;
+        }
+    }
+    void end() {
+        total += telemetryNow() - mark;
+        intervals++;
+    }
+};
+
+#else
+
+inline void telemetryCount(const char*, double) {}
+inline void telemetrySample(const char*, long long, double) {}
+
+class TelemetryScope {
+public:
+    explicit TelemetryScope(const char*) {}
+};
+
+class TelemetryPhase {
+public:
+    explicit TelemetryPhase(const char*) {}
+    void begin() {}
+    void end() {}
+};
+
+#endif
+
+#define TELEMETRY_CONCAT_(a, b) a##b
+#define TELEMETRY_CONCAT(a, b) TELEMETRY_CONCAT_(a, b)
+// Times the rest of the enclosing block
+#define TELEMETRY_SCOPE(name) TelemetryScope TELEMETRY_CONCAT(telemetryScope, __LINE__)(name)
+
+// Events still in the ring, oldest first, and how many were overwritten
+vector<TelemetryEvent> telemetrySnapshot();
+long long telemetryDropped();
+void telemetryReset();
+
+// Every event plus a per-name summary (calls, total, min, max), as one
+// JSON document; or one CSV row per event
+string telemetryToJson();
+string telemetryToCsv();
+// CSV when the path ends in ".csv", JSON otherwise
+bool writeTelemetry(const string& path);
+
+#endif
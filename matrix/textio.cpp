@@ -0,0 +1,327 @@
+#include "textio.hpp"
+#include "threadpool.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// Bytes per parse task; chunk ends are moved forward to the next newline
+const size_t CHUNK_BYTES = 1 << 20;
+
+// Whole file contents, mapped read-only where possible
+class FileText {
+private:
+    const char* text;
+    size_t bytes;
+    void* mapped;
+    vector<char> copy;
+
+public:
+    FileText() : text(nullptr), bytes(0), mapped(nullptr) {}
+    ~FileText() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapped) {
+            munmap(mapped, bytes);
+        }
+#endif
+    }
+    FileText(const FileText&) = delete;
+    FileText& operator=(const FileText&) = delete;
+
+    bool open(const string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                mapped = p;
+                text = static_cast<const char*>(p);
+                bytes = (size_t)st.st_size;
+                ::close(fd);
+                return true;
+            }
+        }
+        ::close(fd);
+#endif
+        ifstream in(path, ios::binary);
+        if (!in) {
+            return false;
+        }
+        copy.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        text = copy.data();
+        bytes = copy.size();
+        return true;
+    }
+
+    const char* begin() const { return text; }
+    const char* end() const { return text + bytes; }
+};
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Reads one whitespace-delimited token as a double. from_chars does not
+// take a leading '+', which operator>> does, so that is skipped here.
+inline bool parseNumber(const char* first, const char* last, double& value) {
+    const char* p = first;
+    if (p < last && *p == '+') {
+        p++;
+    }
+    from_chars_result r = from_chars(p, last, value);
+    return r.ec == errc() && r.ptr == last && p < last;
+}
+
+// Position bookkeeping for error messages
+struct Cursor {
+    const char* p;
+    long long line;
+    const char* lineStart;
+};
+
+void skipSpace(Cursor& c, const char* end) {
+    while (c.p < end && isSpace(*c.p)) {
+        if (*c.p == '\n') {
+            c.line++;
+            c.lineStart = c.p + 1;
+        }
+        c.p++;
+    }
+}
+
+const char* tokenEnd(const char* p, const char* end) {
+    while (p < end && !isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+TextParseError errorAt(const Cursor& c, const string& message) {
+    return TextParseError{true, c.line, (long long)(c.p - c.lineStart) + 1, message};
+}
+
+string tokenText(const char* p, const char* end) {
+    const size_t shown = 32;
+    string t(p, tokenEnd(p, end));
+    return t.size() > shown ? t.substr(0, shown) + "..." : t;
+}
+
+// Header integers (dimensions): non-negative and within int range
+bool parseDimension(Cursor& c, const char* end, const string& what, long long& value, TextParseError& error) {
+    skipSpace(c, end);
+    if (c.p == end) {
+        error = errorAt(c, "missing " + what);
+        return false;
+    }
+    const char* last = tokenEnd(c.p, end);
+    from_chars_result r = from_chars(c.p, last, value);
+    if (r.ec != errc() || r.ptr != last || value < 0 || value > INT32_MAX) {
+        error = errorAt(c, "invalid " + what + " '" + tokenText(c.p, end) + "'");
+        return false;
+    }
+    c.p = last;
+    return true;
+}
+
+// Parses rows x cols values from [body, end) into dst (row i at dst + i * ld).
+// `line` and `lineStart` locate body for error messages.
+bool parseValues(const char* body, const char* end, long long line, const char* lineStart,
+                 int rows, int cols, double* dst, int ld, TextParseError& error) {
+    long long expected = (long long)rows * cols;
+
+    // Row mode when the first line of values, on a line of its own after
+    // the header, holds exactly one row
+    bool rowMode = false;
+    {
+        Cursor c{body, line, lineStart};
+        skipSpace(c, end);
+        const char* p = c.line > line ? c.p : end;
+        long long count = 0;
+        while (p < end && *p != '\n') {
+            while (p < end && *p != '\n' && isSpace(*p)) {
+                p++;
+            }
+            if (p < end && *p != '\n') {
+                count++;
+                p = tokenEnd(p, end);
+            }
+        }
+        rowMode = (count == cols && cols > 0);
+    }
+
+    // Newline-aligned chunks
+    vector<const char*> starts(1, body);
+    while (end - starts.back() > (ptrdiff_t)CHUNK_BYTES) {
+        const char* p = starts.back() + CHUNK_BYTES;
+        while (p < end && *p != '\n') {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        starts.push_back(p + 1);
+    }
+    int chunks = (int)starts.size();
+    starts.push_back(end);
+
+    // Pass 1: values and newlines per chunk, plus the first bad row line
+    struct Count {
+        long long tokens;
+        long long newlines;
+        long long badLine;  // chunk-local line index, -1 if none
+        long long badCount;
+    };
+    vector<Count> counts(chunks);
+    ThreadPool::instance().run(chunks, [&](int k) {
+        Count n{0, 0, -1, 0};
+        long long onLine = 0;
+        for (const char* p = starts[k]; p < starts[k + 1];) {
+            if (*p == '\n') {
+                if (rowMode && onLine != 0 && onLine != cols && n.badLine < 0) {
+                    n.badLine = n.newlines;
+                    n.badCount = onLine;
+                }
+                onLine = 0;
+                n.newlines++;
+                p++;
+            } else if (isSpace(*p)) {
+                p++;
+            } else {
+                n.tokens++;
+                onLine++;
+                p = tokenEnd(p, starts[k + 1]);
+            }
+        }
+        if (rowMode && onLine != 0 && onLine != cols && n.badLine < 0) {
+            n.badLine = n.newlines;
+            n.badCount = onLine;
+        }
+        counts[k] = n;
+    });
+
+    vector<long long> firstToken(chunks + 1, 0), firstLine(chunks + 1, line);
+    for (int k = 0; k < chunks; k++) {
+        if (counts[k].badLine >= 0) {
+            long long at = firstLine[k] + counts[k].badLine;
+            error = TextParseError{true, at, 1, "expected " + to_string(cols) + " values on this line, found " +
+                                              to_string(counts[k].badCount)};
+            return false;
+        }
+        firstToken[k + 1] = firstToken[k] + counts[k].tokens;
+        firstLine[k + 1] = firstLine[k] + counts[k].newlines;
+    }
+    if (firstToken[chunks] < expected) {
+        error = TextParseError{true, firstLine[chunks], 0, "expected " + to_string(expected) + " values, found " +
+                                                         to_string(firstToken[chunks])};
+        return false;
+    }
+
+    // Pass 2: parse every value straight into place. Each chunk keeps its
+    // own first error; the earliest chunk's is reported.
+    vector<TextParseError> errors(chunks, TextParseError{true, 0, 0, ""});
+    ThreadPool::instance().run(chunks, [&](int k) {
+        const char* chunkEnd = starts[k + 1];
+        Cursor c{starts[k], firstLine[k], k == 0 ? lineStart : starts[k]};
+        long long index = firstToken[k];
+        for (;;) {
+            skipSpace(c, chunkEnd);
+            if (c.p == chunkEnd) {
+                return;
+            }
+            const char* last = tokenEnd(c.p, chunkEnd);
+            if (index >= expected) {
+                errors[k] = errorAt(c, "unexpected extra value '" + tokenText(c.p, chunkEnd) + "'");
+                return;
+            }
+            double value;
+            if (!parseNumber(c.p, last, value)) {
+                errors[k] = errorAt(c, "malformed number '" + tokenText(c.p, chunkEnd) + "'");
+                return;
+            }
+            dst[(size_t)(index / cols) * ld + index % cols] = value;
+            index++;
+            c.p = last;
+        }
+    });
+    for (int k = 0; k < chunks; k++) {
+        if (!errors[k].message.empty()) {
+            error = errors[k];
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+bool parseMatrixText(const string& path, Matrix& out, TextParseError& error) {
+    TELEMETRY_SCOPE("io.parseMatrixText");
+    FileText file;
+    if (!file.open(path)) {
+        error = TextParseError{false, 0, 0, "cannot open file"};
+        return false;
+    }
+    telemetryCount("io.bytes_read", (double)(file.end() - file.begin()));
+    Cursor c{file.begin(), 1, file.begin()};
+    long long r, cl;
+    if (!parseDimension(c, file.end(), "row count", r, error) ||
+        !parseDimension(c, file.end(), "column count", cl, error)) {
+        return false;
+    }
+
+    Matrix m((int)r, (int)cl);
+    if (r > 0 && cl > 0 &&
+        !parseValues(c.p, file.end(), c.line, c.lineStart, (int)r, (int)cl, m.raw(), m.stride(), error)) {
+        return false;
+    }
+    out = move(m);
+    return true;
+}
+
+bool parseVectorText(const string& path, vector<double>& out, TextParseError& error) {
+    TELEMETRY_SCOPE("io.parseVectorText");
+    FileText file;
+    if (!file.open(path)) {
+        error = TextParseError{false, 0, 0, "cannot open file"};
+        return false;
+    }
+    telemetryCount("io.bytes_read", (double)(file.end() - file.begin()));
+    Cursor c{file.begin(), 1, file.begin()};
+    long long n;
+    if (!parseDimension(c, file.end(), "size", n, error)) {
+        return false;
+    }
+
+    vector<double> v(n);
+    if (n > 0 && !parseValues(c.p, file.end(), c.line, c.lineStart, (int)n, 1, v.data(), 1, error)) {
+        return false;
+    }
+    out.swap(v);
+    return true;
+}
+
+string describe(const string& path, const TextParseError& error) {
+    if (error.line <= 0) {
+        return path + ": " + error.message;
+    }
+    string where = path + ":" + to_string(error.line);
+    if (error.column > 0) {
+        where += ":" + to_string(error.column);
+    }
+    return where + ": " + error.message;
+}
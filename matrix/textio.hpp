@@ -0,0 +1,28 @@
+#ifndef TEXTIO_HPP
+#define TEXTIO_HPP
+#include "matrix.hpp"
+
+// Parser for the whitespace-separated text files: a "rows cols" header
+// followed by rows x cols values for a matrix, or a "size" header followed
+// by size values for a vector.
+//
+// The file is split into newline-aligned chunks that are parsed on the
+// thread pool with std::from_chars, which ignores the locale. A first pass
+// counts the values in each chunk, so the second can write every value
+// straight to its place in the output. When the first line of values holds
+// exactly one row, every line is expected to hold one row, and a line that
+// does not is reported. Other layouts are read as a plain stream of values.
+struct TextParseError {
+    bool opened;       // false when the file could not be opened at all
+    long long line;    // 1-based; 0 when the problem is not at one place
+    long long column;  // 1-based byte column within the line
+    string message;
+};
+
+bool parseMatrixText(const string& path, Matrix& out, TextParseError& error);
+bool parseVectorText(const string& path, vector<double>& out, TextParseError& error);
+
+// "path:line:column: message", or "path: message" without a position
+string describe(const string& path, const TextParseError& error);
+
+#endif
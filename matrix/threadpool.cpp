@@ -0,0 +1,171 @@
+#include "threadpool.hpp"
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Set on pool workers, and on the caller while it helps with a job, so
+// nested parallel regions fall back to running inline.
+thread_local bool insideJob = false;
+
+// Areas smaller than this are done inline; waking the pool costs more.
+const long long minParallelArea = 1 << 15;
+
+int defaultThreadCount() {
+    const char* env = getenv("MATRIX_NUM_THREADS");
+    if (env) {
+        int n = atoi(env);
+        if (n > 0) {
+            return n;
+        }
+    }
+    int hw = (int)thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+}
+
+ThreadPool::ThreadPool()
+    : job(nullptr), jobTasks(0), nextTask(0), finishedTasks(0),
+      activeWorkers(0), generation(0), stopping(false) {
+    start(defaultThreadCount());
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::start(int threads) {
+    stopping = false;
+    for (int t = 1; t < threads; t++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread& w : workers) {
+        w.join();
+    }
+    workers.clear();
+}
+
+void ThreadPool::resize(int threads) {
+    threads = max(threads, 1);
+    lock_guard<mutex> guard(runLock);
+    if (threads == size()) {
+        return;
+    }
+    stop();
+    start(threads);
+}
+
+void ThreadPool::drain(const function<void(int)>& fn, int tasks) {
+    int t;
+    while ((t = nextTask.fetch_add(1)) < tasks) {
+        fn(t);
+        if (finishedTasks.fetch_add(1) + 1 == tasks) {
+            lock_guard<mutex> guard(lock);
+            done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerLoop() {
+    insideJob = true;
+    unsigned long seen = 0;
+    while (true) {
+        const function<void(int)>* fn;
+        int tasks;
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || (generation != seen && job); });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            fn = job;
+            tasks = jobTasks;
+            activeWorkers++;
+        }
+        drain(*fn, tasks);
+        {
+            lock_guard<mutex> guard(lock);
+            activeWorkers--;
+        }
+        done.notify_all();
+    }
+}
+
+void ThreadPool::run(int tasks, const function<void(int)>& fn) {
+    if (tasks <= 0) {
+        return;
+    }
+    if (tasks == 1 || insideJob || workers.empty()) {
+        for (int t = 0; t < tasks; t++) {
+            fn(t);
+        }
+        return;
+    }
+
+    lock_guard<mutex> serial(runLock);
+    {
+        lock_guard<mutex> guard(lock);
+        job = &fn;
+        jobTasks = tasks;
+        nextTask = 0;
+        finishedTasks = 0;
+        generation++;
+    }
+    wake.notify_all();
+
+    insideJob = true;
+    drain(fn, tasks);
+    insideJob = false;
+
+    // Wait for stragglers too, so none of them still holds `fn` when the
+    // next job is published.
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [&] { return finishedTasks == tasks && activeWorkers == 0; });
+    job = nullptr;
+}
+
+void setNumThreads(int threads) {
+    ThreadPool::instance().resize(threads);
+}
+
+int getNumThreads() {
+    return ThreadPool::instance().size();
+}
+
+void parallelTiles(int rows, int cols, int tileRows, int tileCols,
+                   const function<void(int, int, int, int)>& fn) {
+    if (rows <= 0 || cols <= 0) {
+        return;
+    }
+    int tilesDown = (rows + tileRows - 1) / tileRows;
+    int tilesAcross = (cols + tileCols - 1) / tileCols;
+    auto tile = [&](int t) {
+        int i0 = (t / tilesAcross) * tileRows;
+        int j0 = (t % tilesAcross) * tileCols;
+        fn(i0, min(i0 + tileRows, rows), j0, min(j0 + tileCols, cols));
+    };
+    if ((long long)rows * cols < minParallelArea) {
+        for (int t = 0; t < tilesDown * tilesAcross; t++) {
+            tile(t);
+        }
+        return;
+    }
+    ThreadPool::instance().run(tilesDown * tilesAcross, tile);
+}
@@ -0,0 +1,66 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+// Process-wide pool of persistent worker threads shared by every Matrix
+// kernel. Its size defaults to MATRIX_NUM_THREADS, or the hardware
+// concurrency when that is unset, and can be changed with setNumThreads().
+//
+// Work is handed out as numbered tasks. Kernels split their output into
+// tiles whose shape does not depend on the thread count and never combine
+// partial results across tiles, so results are bit-identical whatever the
+// pool size.
+class ThreadPool {
+private:
+    vector<thread> workers;
+    mutex lock;
+    mutex runLock;  // one job at a time
+    condition_variable wake;
+    condition_variable done;
+
+    const function<void(int)>* job;
+    int jobTasks;
+    atomic<int> nextTask;
+    atomic<int> finishedTasks;
+    int activeWorkers;
+    unsigned long generation;
+    bool stopping;
+
+    ThreadPool();
+    void start(int threads);
+    void stop();
+    void workerLoop();
+    void drain(const function<void(int)>& fn, int tasks);
+
+public:
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& instance();
+
+    // Threads taking part in a job, the calling thread included
+    int size() const { return (int)workers.size() + 1; }
+    void resize(int threads);
+
+    // Calls fn(t) for every t in [0, tasks) and returns once all are done.
+    // Calls made from inside a task run serially on the calling thread.
+    void run(int tasks, const function<void(int)>& fn);
+};
+
+void setNumThreads(int threads);
+int getNumThreads();
+
+// Splits [0, rows) x [0, cols) into tileRows x tileCols tiles and calls
+// fn(i0, i1, j0, j1) for each, in parallel once the area is worth it.
+void parallelTiles(int rows, int cols, int tileRows, int tileCols,
+                   const function<void(int, int, int, int)>& fn);
+
+#endif